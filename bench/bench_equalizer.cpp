@@ -0,0 +1,93 @@
+// Time to run 60 s of 44.1 kHz stereo through the equalizer, for each sample
+// format the file and CD pipelines feed it, with every band boosted (limiter
+// on) and with every band cut (limiter off).
+
+#include "equalizer.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QList>
+#include <QRandomGenerator>
+
+#include <cstdio>
+
+namespace {
+constexpr int SAMPLE_RATE = 44100;
+constexpr int CHANNELS = 2;
+constexpr int SECONDS = 60;
+// Frames per call, about what the decoder hands over per buffer
+constexpr int BUFFER_FRAMES = 4096;
+
+template<typename T>
+QList<T> makeSignal(qint64 samples);
+
+template<>
+QList<qint16> makeSignal(qint64 samples)
+{
+    QList<qint16> signal(samples);
+    for (qint16 &sample : signal) {
+        sample = qint16(QRandomGenerator::global()->bounded(-16384, 16384));
+    }
+    return signal;
+}
+
+template<>
+QList<qint32> makeSignal(qint64 samples)
+{
+    QList<qint32> signal(samples);
+    for (qint32 &sample : signal) {
+        sample = qint32(QRandomGenerator::global()->bounded(-(1 << 30), 1 << 30));
+    }
+    return signal;
+}
+
+template<>
+QList<float> makeSignal(qint64 samples)
+{
+    QList<float> signal(samples);
+    for (float &sample : signal) {
+        sample = float(QRandomGenerator::global()->generateDouble() - 0.5);
+    }
+    return signal;
+}
+
+template<typename T>
+void run(const char *format, const char *setting, float bandDb)
+{
+    EqualizerParameters parameters;
+    parameters.enabled = true;
+    for (float &gain : parameters.bandsDb) {
+        gain = bandDb;
+    }
+    Equalizer equalizer;
+    equalizer.setParameters(parameters);
+
+    const qint64 frames = qint64(SAMPLE_RATE) * SECONDS;
+    QList<T> signal = makeSignal<T>(frames * CHANNELS);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (qint64 start = 0; start < frames; start += BUFFER_FRAMES) {
+        const qint64 count = qMin<qint64>(BUFFER_FRAMES, frames - start);
+        equalizer.process(signal.data() + start * CHANNELS, count, CHANNELS, SAMPLE_RATE);
+    }
+    const double elapsed = timer.nsecsElapsed() / 1e9;
+
+    std::printf("%-6s %-10s %8.3f s  %6.3f%% of real time\n", format, setting, elapsed,
+                100.0 * elapsed / SECONDS);
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    std::printf("%d s of %d Hz stereo, 10 bands\n", SECONDS, SAMPLE_RATE);
+    run<qint16>("int16", "+6 dB", 6.0f);
+    run<qint16>("int16", "-6 dB", -6.0f);
+    run<qint32>("int32", "+6 dB", 6.0f);
+    run<qint32>("int32", "-6 dB", -6.0f);
+    run<float>("float", "+6 dB", 6.0f);
+    run<float>("float", "-6 dB", -6.0f);
+    return 0;
+}
@@ -0,0 +1,94 @@
+// Time to remove tracks from playlists of growing size: a tenth of the rows
+// one call at a time, as deleting them one by one in the view does, the same
+// rows as a single scattered selection, and the whole playlist with clear().
+// Removal should grow with the rows removed, not with the playlist.
+
+#include "qmediaplaylist.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMediaMetaData>
+#include <QUrl>
+
+#include <cstdio>
+
+namespace {
+const QList<int> PLAYLIST_SIZES = {1000, 5000, 20000, 50000};
+// One row in REMOVE_EVERY is removed
+constexpr int REMOVE_EVERY = 10;
+
+void fill(QMediaPlaylist &playlist, int count)
+{
+    QList<QMediaMetaData> items;
+    items.reserve(count);
+    for (int track = 0; track < count; ++track) {
+        QMediaMetaData metaData;
+        metaData.insert(QMediaMetaData::Url,
+                        QUrl::fromLocalFile(QStringLiteral("/nonexistent/bench/%1.flac").arg(track)));
+        metaData.insert(QMediaMetaData::Title, QStringLiteral("Track %1").arg(track));
+        metaData.insert(QMediaMetaData::Duration, qint64(180000));
+        items.append(metaData);
+    }
+    playlist.addMedia(items);
+}
+
+QList<int> scatteredRows(int count)
+{
+    QList<int> rows;
+    for (int row = 0; row < count; row += REMOVE_EVERY) {
+        rows.append(row);
+    }
+    return rows;
+}
+
+double removeOneByOne(int count)
+{
+    QMediaPlaylist playlist;
+    fill(playlist, count);
+    const QList<int> rows = scatteredRows(count);
+
+    QElapsedTimer timer;
+    timer.start();
+    // From the end, so the rows still to remove keep their index
+    for (auto row = rows.crbegin(); row != rows.crend(); ++row) {
+        playlist.removeMedia(*row);
+    }
+    return timer.nsecsElapsed() / 1e6;
+}
+
+double removeSelection(int count)
+{
+    QMediaPlaylist playlist;
+    fill(playlist, count);
+    const QList<int> rows = scatteredRows(count);
+
+    QElapsedTimer timer;
+    timer.start();
+    playlist.removeMedia(rows);
+    return timer.nsecsElapsed() / 1e6;
+}
+
+double removeAll(int count)
+{
+    QMediaPlaylist playlist;
+    fill(playlist, count);
+
+    QElapsedTimer timer;
+    timer.start();
+    playlist.clear();
+    return timer.nsecsElapsed() / 1e6;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    std::printf("%8s %8s %14s %14s %14s\n", "tracks", "removed", "one by one", "selection", "clear");
+    for (int count : PLAYLIST_SIZES) {
+        std::printf("%8d %8d %11.2f ms %11.2f ms %11.2f ms\n", count, int(scatteredRows(count).size()),
+                    removeOneByOne(count), removeSelection(count), removeAll(count));
+    }
+    return 0;
+}
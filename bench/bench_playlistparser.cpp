@@ -0,0 +1,103 @@
+// Time to parse extended M3U playlists of growing size from a local file,
+// through the mapped fast path (a file url) and through the QIODevice path
+// reading a QFile in blocks, and to load them into a QMediaPlaylist.
+
+#include "qmediaplaylist.h"
+#include "qplaylistfileparser.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QUrl>
+
+#include <cstdio>
+
+namespace {
+const QList<int> PLAYLIST_SIZES = {10000, 50000, 100000};
+
+bool writePlaylist(const QString &path, int count)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write("#EXTM3U\n");
+    for (int track = 0; track < count; ++track) {
+        const int album = track / 12;
+        file.write(QStringLiteral("#EXTINF:%1,Artist %2 - Track %3 of Album %4\n"
+                                  "/media/music/Artist %2/Album %4/%3 - Track %3.flac\n")
+                       .arg(180 + track % 120)
+                       .arg(album / 4)
+                       .arg(track % 12 + 1)
+                       .arg(album)
+                       .toUtf8());
+    }
+    return true;
+}
+
+// Milliseconds to parse path, with entries found stored in *items
+double parse(const QString &path, bool mapped, int *items)
+{
+    QPlaylistFileParser parser;
+    *items = 0;
+    QObject::connect(&parser, &QPlaylistFileParser::itemsFound,
+                     [items](const QList<QMediaMetaData> &found) { *items += found.size(); });
+
+    QFile file(path);
+    QElapsedTimer timer;
+    timer.start();
+    if (mapped) {
+        parser.start(QUrl::fromLocalFile(path));
+    } else {
+        file.open(QIODevice::ReadOnly);
+        parser.start(&file, QStringLiteral("audio/x-mpegurl"));
+    }
+    return timer.nsecsElapsed() / 1e6;
+}
+
+double load(const QString &path, int *items)
+{
+    QMediaPlaylist playlist;
+    QElapsedTimer timer;
+    timer.start();
+    playlist.load(QUrl::fromLocalFile(path));
+    const double elapsed = timer.nsecsElapsed() / 1e6;
+    *items = playlist.mediaCount();
+    return elapsed;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        std::printf("could not create a temporary directory\n");
+        return 1;
+    }
+
+    std::printf("%8s %14s %14s %14s\n", "entries", "mapped", "QFile", "into playlist");
+    for (int count : PLAYLIST_SIZES) {
+        const QString path = dir.filePath(QStringLiteral("bench-%1.m3u").arg(count));
+        if (!writePlaylist(path, count)) {
+            std::printf("could not write %s\n", qPrintable(path));
+            return 1;
+        }
+
+        int mappedItems = 0;
+        int fileItems = 0;
+        int loadedItems = 0;
+        const double mapped = parse(path, true, &mappedItems);
+        const double streamed = parse(path, false, &fileItems);
+        const double loaded = load(path, &loadedItems);
+        if (mappedItems != count || fileItems != count || loadedItems != count) {
+            std::printf("%8d entries read as %d mapped, %d from QFile, %d loaded\n", count, mappedItems,
+                        fileItems, loadedItems);
+            return 1;
+        }
+        std::printf("%8d %11.2f ms %11.2f ms %11.2f ms\n", count, mapped, streamed, loaded);
+    }
+    return 0;
+}
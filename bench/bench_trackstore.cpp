@@ -0,0 +1,139 @@
+// Resident memory of a playlist's track data at 10k, 50k and 100k tracks, as
+// the playlist used to hold it (a url per entry in the playlist and the
+// playqueue, and a QMediaMetaData per url) and as the TrackStore holds it.
+//
+// Freed memory is not reliably returned to the system, so each figure is
+// taken in a child process that builds one layout and reports its growth.
+
+#include "trackstore.h"
+
+#include <QCoreApplication>
+#include <QList>
+#include <QMap>
+#include <QMediaMetaData>
+#include <QProcess>
+#include <QUrl>
+
+#include <cstdio>
+#include <unistd.h>
+
+namespace {
+constexpr int TRACKS_PER_ALBUM = 12;
+constexpr int ALBUMS_PER_ARTIST = 4;
+constexpr int GENRES = 24;
+const QList<int> TRACK_COUNTS = {10000, 50000, 100000};
+
+// Resident set size in bytes, from /proc/self/statm
+qint64 residentBytes()
+{
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    if (!statm) {
+        return 0;
+    }
+    long size = 0;
+    long resident = 0;
+    if (std::fscanf(statm, "%ld %ld", &size, &resident) != 2) {
+        resident = 0;
+    }
+    std::fclose(statm);
+    return qint64(resident) * sysconf(_SC_PAGESIZE);
+}
+
+// Tags of a library laid out as artists of albums of tracks, as a full parse
+// would report them
+QMediaMetaData makeMetaData(int track)
+{
+    const int album = track / TRACKS_PER_ALBUM;
+    const int artist = album / ALBUMS_PER_ARTIST;
+    const QString artistName = QStringLiteral("Artist %1").arg(artist);
+    const QString albumName = QStringLiteral("Album %1").arg(album);
+    const QString title = QStringLiteral("Track %1 of %2").arg(track % TRACKS_PER_ALBUM + 1).arg(albumName);
+
+    QMediaMetaData metaData;
+    metaData.insert(QMediaMetaData::Url,
+                    QUrl::fromLocalFile(QStringLiteral("/media/music/%1/%2/%3.flac")
+                                            .arg(artistName, albumName, title)));
+    metaData.insert(QMediaMetaData::Title, title);
+    metaData.insert(QMediaMetaData::AlbumArtist, artistName);
+    metaData.insert(QMediaMetaData::AlbumTitle, albumName);
+    metaData.insert(QMediaMetaData::Genre, QStringLiteral("Genre %1").arg(artist % GENRES));
+    metaData.insert(QMediaMetaData::TrackNumber, qint64(track % TRACKS_PER_ALBUM + 1));
+    metaData.insert(QMediaMetaData::Date, qint64(1970 + album % 50));
+    metaData.insert(QMediaMetaData::Duration, qint64(180000 + track % 120000));
+    metaData.insert(QMediaMetaData::AudioBitRate, qint64(900000));
+    metaData.insert(QMediaMetaData::Comment, QStringLiteral("44100"));
+    return metaData;
+}
+
+qint64 measureMetaDataMap(int count)
+{
+    const qint64 before = residentBytes();
+
+    QList<QUrl> playlist;
+    QList<QUrl> playqueue;
+    QMap<QUrl, QMediaMetaData> metaData;
+    for (int track = 0; track < count; ++track) {
+        const QMediaMetaData trackMetaData = makeMetaData(track);
+        const QUrl url = trackMetaData.value(QMediaMetaData::Url).toUrl();
+        playlist.append(url);
+        metaData.insert(url, trackMetaData);
+    }
+    playqueue = playlist;
+    // Detach the copy, as the first shuffle or move did
+    playqueue.detach();
+
+    return residentBytes() - before;
+}
+
+qint64 measureTrackStore(int count)
+{
+    const qint64 before = residentBytes();
+
+    TrackStore tracks;
+    QList<TrackStore::TrackId> playlist;
+    QList<TrackStore::TrackId> playqueue;
+    for (int track = 0; track < count; ++track) {
+        const QMediaMetaData metaData = makeMetaData(track);
+        const TrackStore::TrackId id = tracks.intern(metaData.value(QMediaMetaData::Url).toUrl());
+        tracks.retain(id);
+        tracks.setMetaData(id, metaData, true);
+        playlist.append(id);
+    }
+    playqueue = playlist;
+    playqueue.detach();
+
+    return residentBytes() - before;
+}
+
+// Runs this program on one layout and size, returning the bytes it reported
+qint64 measureInChild(const QString &layout, int count)
+{
+    QProcess child;
+    child.start(QCoreApplication::applicationFilePath(), {layout, QString::number(count)});
+    if (!child.waitForFinished(-1) || child.exitCode() != 0) {
+        return -1;
+    }
+    return child.readAllStandardOutput().trimmed().toLongLong();
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    const QStringList arguments = app.arguments();
+    if (arguments.size() == 3) {
+        const int count = arguments.at(2).toInt();
+        const qint64 bytes = arguments.at(1) == "store" ? measureTrackStore(count) : measureMetaDataMap(count);
+        std::printf("%lld\n", static_cast<long long>(bytes));
+        return 0;
+    }
+
+    std::printf("%8s %14s %14s\n", "tracks", "metadata map", "track store");
+    for (int count : TRACK_COUNTS) {
+        const qint64 map = measureInChild("map", count);
+        const qint64 store = measureInChild("store", count);
+        std::printf("%8d %11.1f MB %11.1f MB\n", count, map / 1048576.0, store / 1048576.0);
+    }
+    return 0;
+}
@@ -5,3 +5,49 @@ AudioSource::AudioSource(QObject *parent)
 {
 
 }
+
+const PlaybackClock *AudioSource::playbackClock() const
+{
+    return nullptr;
+}
+
+Equalizer *AudioSource::equalizer()
+{
+    return nullptr;
+}
+
+void AudioSource::handleEq()
+{
+    Equalizer *eq = equalizer();
+    if (eq == nullptr) {
+        emit eqEnabledChanged(false);
+        return;
+    }
+
+    // Like PL: the button opens the editor and keeps showing the EQ state
+    emit eqEnabledChanged(eq->isEnabled());
+    emit showEqualizerRequested();
+}
+
+void AudioSource::setEqualizerParameters(const EqualizerParameters &parameters)
+{
+    Equalizer *eq = equalizer();
+    if (eq == nullptr) {
+        return;
+    }
+
+    eq->setParameters(parameters);
+    emit eqEnabledChanged(parameters.enabled);
+}
+
+bool AudioSource::loadEqualizer()
+{
+    Equalizer *eq = equalizer();
+    if (eq == nullptr) {
+        return false;
+    }
+
+    const EqualizerParameters parameters = Equalizer::loadParameters();
+    eq->setParameters(parameters);
+    return parameters.enabled;
+}
@@ -3,7 +3,9 @@
 
 #include <QObject>
 #include "mediaplayer.h"
+#include "equalizer.h"
 
+class PlaybackClock;
 
 class AudioSource : public QObject
 {
@@ -11,12 +13,21 @@ class AudioSource : public QObject
 public:
     explicit AudioSource(QObject *parent = nullptr);
 
+    // Sources that own their audio sink expose a clock the view can poll for
+    // smooth progress. Others report progress through positionChanged only.
+    virtual const PlaybackClock *playbackClock() const;
+
+    // Sources that process PCM themselves expose their equalizer stage.
+    // Others keep the EQ button off.
+    virtual Equalizer *equalizer();
+
 signals:
     void playbackStateChanged(MediaPlayer::PlaybackState state);
     void positionChanged(qint64 progress);
     void dataEmitted(const QByteArray& data, QAudioFormat format);
     void metadataChanged(QMediaMetaData metadata);
     void durationChanged(qint64 duration);
+    void outputFormatChanged(int sampleRate, bool resampled);
     void eqEnabledChanged(bool enabled);
     void plEnabledChanged(bool enabled);
     void shuffleEnabledChanged(bool enabled);
@@ -24,6 +35,7 @@ signals:
     void messageSet(QString message, qint64 timeout);
     void messageClear();
     void requestActivation(); // Asks the coordinator to be selected, coordinator can ignore this
+    void showEqualizerRequested();
 
 public slots:
     virtual void activate() = 0;
@@ -38,6 +50,13 @@ public slots:
     virtual void handleShuffle() = 0;
     virtual void handleRepeat() = 0;
     virtual void handleSeek(int mseconds) = 0;
+    virtual void handleEq();
+    // Applies settings edited in the equalizer view, which persists them
+    void setEqualizerParameters(const EqualizerParameters &parameters);
+
+protected:
+    // Applies the persisted EQ settings, returns whether the EQ is on
+    bool loadEqualizer();
 
 };
 
@@ -261,6 +261,8 @@ void AudioSourceWSpectrumCapture::startSpectrum()
     pwLoopThread = QtConcurrent::run(&AudioSourceWSpectrumCapture::pwLoop, this);
 
     dataEmitTimer->start();
+    l.unlock();
+    emit spectrumRunningChanged(true);
 }
 
 void AudioSourceWSpectrumCapture::stopSpectrum()
@@ -278,4 +280,6 @@ void AudioSourceWSpectrumCapture::stopSpectrum()
         #endif
         do_quit(&this->pwData, 1);
     }
+    l.unlock();
+    emit spectrumRunningChanged(false);
 }
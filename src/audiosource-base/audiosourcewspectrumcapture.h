@@ -45,6 +45,7 @@ private:
     QFuture<void> pwLoopThread;
 
 signals:
+    void spectrumRunningChanged(bool running);
 
 };
 
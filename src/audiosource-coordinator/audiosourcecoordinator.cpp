@@ -45,18 +45,22 @@ void AudioSourceCoordinator::setSource(int newSource)
         disconnect(view, &PlayerView::shuffleClicked, sources[currentSource], &AudioSource::handleShuffle);
         disconnect(view, &PlayerView::repeatClicked, sources[currentSource], &AudioSource::handleRepeat);
         disconnect(view, &PlayerView::plClicked, sources[currentSource], &AudioSource::handlePl);
+        disconnect(view, &PlayerView::eqClicked, sources[currentSource], &AudioSource::handleEq);
 
         disconnect(sources[currentSource], &AudioSource::playbackStateChanged, view, &PlayerView::setPlaybackState);
         disconnect(sources[currentSource], &AudioSource::positionChanged, view, &PlayerView::setPosition);
         disconnect(sources[currentSource], &AudioSource::dataEmitted, view, &PlayerView::setSpectrumData);
         disconnect(sources[currentSource], &AudioSource::metadataChanged, view, &PlayerView::setMetadata);
         disconnect(sources[currentSource], &AudioSource::durationChanged, view, &PlayerView::setDuration);
+        disconnect(sources[currentSource], &AudioSource::outputFormatChanged, view, &PlayerView::setOutputFormat);
         disconnect(sources[currentSource], &AudioSource::eqEnabledChanged, view, &PlayerView::setEqEnabled);
         disconnect(sources[currentSource], &AudioSource::plEnabledChanged, view, &PlayerView::setPlEnabled);
         disconnect(sources[currentSource], &AudioSource::shuffleEnabledChanged, view, &PlayerView::setShuffleEnabled);
         disconnect(sources[currentSource], &AudioSource::repeatEnabledChanged, view, &PlayerView::setRepeatEnabled);
         disconnect(sources[currentSource], &AudioSource::messageSet, view, &PlayerView::setMessage);
         disconnect(sources[currentSource], &AudioSource::messageClear, view, &PlayerView::clearMessage);
+        disconnect(sources[currentSource], &AudioSource::showEqualizerRequested, this,
+                   &AudioSourceCoordinator::showEqualizerRequested);
     }
 
     currentSource = newSource;
@@ -73,25 +77,38 @@ void AudioSourceCoordinator::setSource(int newSource)
     connect(view, &PlayerView::shuffleClicked, sources[currentSource], &AudioSource::handleShuffle);
     connect(view, &PlayerView::repeatClicked, sources[currentSource], &AudioSource::handleRepeat);
     connect(view, &PlayerView::plClicked, sources[currentSource], &AudioSource::handlePl);
+    connect(view, &PlayerView::eqClicked, sources[currentSource], &AudioSource::handleEq);
 
     connect(sources[currentSource], &AudioSource::playbackStateChanged, view, &PlayerView::setPlaybackState);
     connect(sources[currentSource], &AudioSource::positionChanged, view, &PlayerView::setPosition);
     connect(sources[currentSource], &AudioSource::dataEmitted, view, &PlayerView::setSpectrumData);
     connect(sources[currentSource], &AudioSource::metadataChanged, view, &PlayerView::setMetadata);
     connect(sources[currentSource], &AudioSource::durationChanged, view, &PlayerView::setDuration);
+    connect(sources[currentSource], &AudioSource::outputFormatChanged, view, &PlayerView::setOutputFormat);
     connect(sources[currentSource], &AudioSource::eqEnabledChanged, view, &PlayerView::setEqEnabled);
     connect(sources[currentSource], &AudioSource::plEnabledChanged, view, &PlayerView::setPlEnabled);
     connect(sources[currentSource], &AudioSource::shuffleEnabledChanged, view, &PlayerView::setShuffleEnabled);
     connect(sources[currentSource], &AudioSource::repeatEnabledChanged, view, &PlayerView::setRepeatEnabled);
     connect(sources[currentSource], &AudioSource::messageSet, view, &PlayerView::setMessage);
     connect(sources[currentSource], &AudioSource::messageClear, view, &PlayerView::clearMessage);
+    connect(sources[currentSource], &AudioSource::showEqualizerRequested, this,
+            &AudioSourceCoordinator::showEqualizerRequested);
 
     view->setSourceLabel(sourceLabels[currentSource]);
+    view->setPlaybackClock(sources[currentSource]->playbackClock());
+    view->setOutputFormat(0, false);
 
     // activate new source
     sources[currentSource]->activate();
 }
 
+void AudioSourceCoordinator::setEqualizerParameters(const EqualizerParameters &parameters)
+{
+    if (currentSource >= 0) {
+        sources[currentSource]->setEqualizerParameters(parameters);
+    }
+}
+
 void AudioSourceCoordinator::setVolume(int volume)
 {
     system_audio->setVolume(volume);
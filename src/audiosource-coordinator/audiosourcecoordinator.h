@@ -16,9 +16,11 @@ public:
 
 signals:
     void sourceChanged(int source);
+    void showEqualizerRequested();
 
 public slots:
     void setSource(int source);
+    void setEqualizerParameters(const EqualizerParameters &parameters);
     void setVolume(int volume);
     void setBalance(int balance);
 
@@ -61,10 +61,22 @@ AudioSourceCDNative::AudioSourceCDNative(QObject *parent)
 
 AudioSourceCDNative::~AudioSourceCDNative() = default;
 
+const PlaybackClock *AudioSourceCDNative::playbackClock() const
+{
+    return m_engine->playbackClock();
+}
+
+Equalizer *AudioSourceCDNative::equalizer()
+{
+    return m_engine->equalizer();
+}
+
 void AudioSourceCDNative::activate()
 {
     m_isActive = true;
-    emit eqEnabledChanged(false);
+    emit eqEnabledChanged(loadEqualizer());
+    const int outputRate = m_engine->outputSampleRate();
+    emit outputFormatChanged(outputRate, outputRate != 44100);
     emit plEnabledChanged(false);
     emit shuffleEnabledChanged(m_shuffleEnabled);
     emit repeatEnabledChanged(m_repeatEnabled);
@@ -17,6 +17,9 @@ public:
     explicit AudioSourceCDNative(QObject *parent = nullptr);
     ~AudioSourceCDNative() override;
 
+    const PlaybackClock *playbackClock() const override;
+    Equalizer *equalizer() override;
+
 public slots:
     void activate() override;
     void deactivate() override;
@@ -2,6 +2,8 @@
 
 #include <cdio/paranoia/cdda.h>
 
+#include <QAudioDevice>
+#include <QDebug>
 #include <QMediaDevices>
 #include <QRandomGenerator>
 #include <QThread>
@@ -9,6 +11,7 @@
 
 #include "cdpcmiodevice.h"
 #include "cdpcmringbuffer.h"
+#include "util.h"
 
 namespace {
 constexpr int CD_BYTES_PER_SECTOR = 2352;
@@ -30,6 +33,7 @@ CDNativePlaybackEngine::CDNativePlaybackEngine(QObject *parent)
     m_audioFormat.setSampleRate(44100);
     m_audioFormat.setChannelCount(2);
     m_audioFormat.setSampleFormat(QAudioFormat::Int16);
+    m_pcmDevice->setEqualizer(&m_equalizer, m_audioFormat.channelCount(), m_audioFormat.sampleRate());
 
     m_positionTimer.setInterval(POSITION_TICK_MS);
     connect(&m_positionTimer, &QTimer::timeout, this, &CDNativePlaybackEngine::updatePositionTick);
@@ -77,6 +81,7 @@ void CDNativePlaybackEngine::setTracks(const QList<CDNativeTrack> &tracks)
     m_currentOrderIndex = findOrderIndexForTrack(m_currentLogicalIndex);
     emit durationChanged(m_durationMs);
     emit activeTrackChanged(resolveTrackIndexForPosition(m_positionMs));
+    publishClock();
     emit positionChanged(m_positionMs);
 }
 
@@ -128,6 +133,7 @@ void CDNativePlaybackEngine::play()
         }
         m_canResumeFromPause = false;
         m_positionTimer.start();
+        publishClock();
         return;
     }
 
@@ -147,6 +153,7 @@ void CDNativePlaybackEngine::pause()
         m_audioSink->suspend();
     }
     m_positionTimer.stop();
+    publishClock();
 }
 
 void CDNativePlaybackEngine::stop()
@@ -174,6 +181,7 @@ void CDNativePlaybackEngine::stop()
     }
 
     emit activeTrackChanged(m_currentLogicalIndex);
+    publishClock();
     emit positionChanged(m_positionMs);
 }
 
@@ -308,6 +316,7 @@ void CDNativePlaybackEngine::seek(qint64 mseconds)
     }
 
     emit activeTrackChanged(m_currentLogicalIndex);
+    publishClock();
     emit positionChanged(m_positionMs);
 }
 
@@ -321,6 +330,25 @@ qint64 CDNativePlaybackEngine::duration() const
     return m_durationMs;
 }
 
+const PlaybackClock *CDNativePlaybackEngine::playbackClock() const
+{
+    return &m_clock;
+}
+
+Equalizer *CDNativePlaybackEngine::equalizer()
+{
+    return &m_equalizer;
+}
+
+int CDNativePlaybackEngine::outputSampleRate() const
+{
+    const QAudioDevice device = QMediaDevices::defaultAudioOutput();
+    if (device.isFormatSupported(m_audioFormat)) {
+        return m_audioFormat.sampleRate();
+    }
+    return device.preferredFormat().sampleRate();
+}
+
 int CDNativePlaybackEngine::currentTrackIndex() const
 {
     if (m_shuffleEnabled.load()) {
@@ -458,6 +486,7 @@ void CDNativePlaybackEngine::advanceToNextShuffleTrack()
     }
 
     emit activeTrackChanged(m_currentLogicalIndex);
+    publishClock();
     emit positionChanged(m_positionMs);
 }
 
@@ -486,6 +515,7 @@ void CDNativePlaybackEngine::finishNaturalPlayback()
     }
 
     emit activeTrackChanged(m_currentLogicalIndex);
+    publishClock();
     emit positionChanged(m_positionMs);
     emit playbackFinished();
 }
@@ -493,10 +523,13 @@ void CDNativePlaybackEngine::finishNaturalPlayback()
 void CDNativePlaybackEngine::updatePositionTick()
 {
     if (m_audioSink != nullptr) {
-        const qint64 processedMs = qMax<qint64>(0, m_audioSink->processedUSecs() / 1000);
-        m_positionMs = qBound<qint64>(0, m_positionAnchorMs + processedMs, m_durationMs);
+        m_positionMs = qBound<qint64>(0, m_positionAnchorMs + sinkPlayedMs(), m_durationMs);
     }
 
+    // Continuous progress is published through the playback clock; the
+    // positionChanged signal is reserved for discontinuities.
+    bool discontinuity = false;
+
     if (m_shuffleEnabled.load() && !m_tracks.isEmpty()) {
         const qint64 trackStart = trackStartMs(m_currentLogicalIndex);
         const qint64 trackEnd = trackStart + trackPlaybackDurationMs(m_currentLogicalIndex);
@@ -515,6 +548,7 @@ void CDNativePlaybackEngine::updatePositionTick()
             m_positionMs = 0;
             m_positionAnchorMs = 0;
             m_positionTimer.stop();
+            discontinuity = true;
 
             if (m_audioSink != nullptr) {
                 m_audioSink->suspend();
@@ -534,10 +568,35 @@ void CDNativePlaybackEngine::updatePositionTick()
         if (activeTrack != m_currentLogicalIndex) {
             m_currentLogicalIndex = activeTrack;
             emit activeTrackChanged(m_currentLogicalIndex);
+            discontinuity = true;
         }
     }
 
-    emit positionChanged(m_positionMs);
+    publishClock();
+    if (discontinuity) {
+        emit positionChanged(m_positionMs);
+    }
+}
+
+void CDNativePlaybackEngine::publishClock()
+{
+    const bool running = m_positionTimer.isActive() && !m_transportStartPending;
+    const int trackIndex = currentTrackIndex();
+    const qint64 originMs = trackIndex >= 0 ? trackStartMs(trackIndex) : 0;
+    m_clock.publish(m_positionMs * 1000, running, originMs * 1000);
+}
+
+qint64 CDNativePlaybackEngine::sinkPlayedMs() const
+{
+    const QAudio::State state = m_audioSink->state();
+    if (state != QAudio::ActiveState && state != QAudio::IdleState) {
+        return 0;
+    }
+
+    // Frames the sink pulled from us, minus what is still queued in the device.
+    const qint64 bufferedBytes = qMax<qint64>(0, m_audioSink->bufferSize() - m_audioSink->bytesFree());
+    const qint64 playedBytes = qMax<qint64>(0, m_pcmDevice->bytesConsumed() - bufferedBytes);
+    return m_audioFormat.durationForBytes(playedBytes) / 1000;
 }
 
 void CDNativePlaybackEngine::ensureSink()
@@ -546,6 +605,10 @@ void CDNativePlaybackEngine::ensureSink()
         return;
     }
 
+    const int outputRate = outputSampleRate();
+    qCDebug(lcAudioOutput) << "CDNativePlaybackEngine: output" << outputRate << "Hz,"
+             << (outputRate == m_audioFormat.sampleRate() ? "native path" : "resampled by the sound server");
+
     m_audioSink = new QAudioSink(QMediaDevices::defaultAudioOutput(), m_audioFormat, this);
     m_audioSink->setBufferSize(CD_BYTES_PER_SECTOR * AUDIO_SINK_BUFFER_SECTORS);
     m_audioSink->setVolume(m_transitionMutePending ? 0.0f : 1.0f);
@@ -553,6 +616,7 @@ void CDNativePlaybackEngine::ensureSink()
 
 void CDNativePlaybackEngine::recreateSink()
 {
+    m_equalizer.reset();
     if (m_audioSink != nullptr) {
         m_audioSink->reset();
         m_audioSink->suspend();
@@ -613,6 +677,7 @@ void CDNativePlaybackEngine::startTransportWhenReady()
 
     if (m_audioSink != nullptr && m_audioSink->state() != QAudio::ActiveState) {
         m_positionAnchorMs = m_positionMs;
+        m_pcmDevice->resetBytesConsumed();
         m_audioSink->start(m_pcmDevice);
 
         if (m_transitionMutePending) {
@@ -633,6 +698,7 @@ void CDNativePlaybackEngine::startTransportWhenReady()
     if (!m_positionTimer.isActive()) {
         m_positionTimer.start();
     }
+    publishClock();
 }
 
 void CDNativePlaybackEngine::startReaderLoop()
@@ -10,6 +10,8 @@
 #include <atomic>
 
 #include "cdnativetrack.h"
+#include "equalizer.h"
+#include "playbackclock.h"
 
 class CDPcmRingBuffer;
 class CDPcmIODevice;
@@ -43,6 +45,12 @@ public:
     qint64 position() const;
     qint64 duration() const;
     int currentTrackIndex() const;
+    const PlaybackClock *playbackClock() const;
+    Equalizer *equalizer();
+
+    // Rate the output device runs at. Differs from 44100 when the device
+    // can't take CD audio natively and the sound server resamples it.
+    int outputSampleRate() const;
 
 signals:
     void positionChanged(qint64 positionMs);
@@ -75,6 +83,8 @@ private:
     bool m_transitionMutePending = false;
 
     QTimer m_positionTimer;
+    PlaybackClock m_clock;
+    Equalizer m_equalizer;
 
     std::atomic_bool m_readerRunning{false};
     std::atomic_bool m_readerStopRequested{false};
@@ -89,6 +99,8 @@ private:
     qint64 trackLastLba(int index) const;
 
     void updatePositionTick();
+    void publishClock();
+    qint64 sinkPlayedMs() const;
     void finishNaturalPlayback();
     void advanceToNextShuffleTrack();
     void ensureSink();
@@ -3,6 +3,7 @@
 #include <QThread>
 
 #include "cdpcmringbuffer.h"
+#include "equalizer.h"
 
 CDPcmIODevice::CDPcmIODevice(CDPcmRingBuffer *ringBuffer, QObject *parent)
     : QIODevice(parent)
@@ -43,6 +44,23 @@ void CDPcmIODevice::notifyReadyRead()
     }, Qt::QueuedConnection);
 }
 
+qint64 CDPcmIODevice::bytesConsumed() const
+{
+    return m_bytesConsumed.load(std::memory_order_relaxed);
+}
+
+void CDPcmIODevice::resetBytesConsumed()
+{
+    m_bytesConsumed.store(0, std::memory_order_relaxed);
+}
+
+void CDPcmIODevice::setEqualizer(Equalizer *equalizer, int channels, int sampleRate)
+{
+    m_equalizer = equalizer;
+    m_channels = qMax(1, channels);
+    m_sampleRate = sampleRate;
+}
+
 qint64 CDPcmIODevice::readData(char *data, qint64 maxSize)
 {
     if (m_ringBuffer == nullptr || data == nullptr || maxSize <= 0) {
@@ -56,7 +74,21 @@ qint64 CDPcmIODevice::readData(char *data, qint64 maxSize)
         }
     }
 
-    return m_ringBuffer->read(data, static_cast<int>(maxSize));
+    // Hand out whole frames only so the equalizer never sees a split sample
+    const qint64 bytesPerFrame = m_channels * static_cast<qint64>(sizeof(qint16));
+    maxSize -= maxSize % bytesPerFrame;
+    if (maxSize <= 0) {
+        return 0;
+    }
+
+    const int bytesRead = m_ringBuffer->read(data, static_cast<int>(maxSize));
+    m_bytesConsumed.fetch_add(bytesRead, std::memory_order_relaxed);
+
+    if (m_equalizer != nullptr && m_equalizer->isEnabled() && bytesRead > 0) {
+        m_equalizer->process(reinterpret_cast<qint16 *>(data), bytesRead / bytesPerFrame,
+                             m_channels, m_sampleRate);
+    }
+    return bytesRead;
 }
 
 qint64 CDPcmIODevice::writeData(const char *, qint64)
@@ -2,8 +2,10 @@
 #define CDPCMIODEVICE_H
 
 #include <QIODevice>
+#include <atomic>
 
 class CDPcmRingBuffer;
+class Equalizer;
 
 class CDPcmIODevice : public QIODevice
 {
@@ -17,12 +19,24 @@ public:
     qint64 bytesAvailable() const override;
     void notifyReadyRead();
 
+    // Bytes handed to the sink since the last reset, used for the playback clock.
+    qint64 bytesConsumed() const;
+    void resetBytesConsumed();
+
+    // Applied to PCM as the sink pulls it, so EQ changes are heard
+    // immediately instead of after the ring buffer drains.
+    void setEqualizer(Equalizer *equalizer, int channels, int sampleRate);
+
 protected:
     qint64 readData(char *data, qint64 maxSize) override;
     qint64 writeData(const char *data, qint64 maxSize) override;
 
 private:
     CDPcmRingBuffer *m_ringBuffer = nullptr;
+    Equalizer *m_equalizer = nullptr;
+    int m_channels = 2;
+    int m_sampleRate = 44100;
+    std::atomic<qint64> m_bytesConsumed{0};
 };
 
 #endif // CDPCMIODEVICE_H
@@ -6,6 +6,9 @@
 
 //#define DISPLAY_BUFFERING
 
+// How long before the end of a track the drive holding the next one is woken
+#define WAKE_AHEAD_MS 15000
+
 
 AudioSourceFile::AudioSourceFile(QObject *parent, PlaylistModel *playlistModel)
     : AudioSourceWSpectrumCapture{parent}
@@ -14,11 +17,15 @@ AudioSourceFile::AudioSourceFile(QObject *parent, PlaylistModel *playlistModel)
 
     connect(m_player, &MediaPlayer::durationChanged, this, &AudioSourceFile::durationChanged);
     connect(m_player, &MediaPlayer::positionChanged, this, &AudioSourceFile::positionChanged);
+    connect(m_player, &MediaPlayer::positionChanged, this, &AudioSourceFile::handlePositionChanged);
     connect(m_player, QOverload<>::of(&MediaPlayer::metaDataChanged), this,
             &AudioSourceFile::handleMetaDataChanged);
     connect(m_player, &MediaPlayer::mediaStatusChanged, this, &AudioSourceFile::handleMediaStatusChanged);
     connect(m_player, &MediaPlayer::bufferProgressChanged, this, &AudioSourceFile::handleBufferingProgress);
     connect(m_player, &MediaPlayer::errorChanged, this, &AudioSourceFile::handleMediaError);
+    connect(m_player, &MediaPlayer::outputFormatChanged, this, [this]() {
+        emit outputFormatChanged(m_player->format().sampleRate(), m_player->isResampling());
+    });
 
     m_playlistModel = playlistModel;
     m_playlist = m_playlistModel->playlist();
@@ -27,9 +34,51 @@ AudioSourceFile::AudioSourceFile(QObject *parent, PlaylistModel *playlistModel)
             &AudioSourceFile::handlePlaylistPositionChanged);
     connect(m_playlist, &QMediaPlaylist::mediaAboutToBeRemoved, this,
             &AudioSourceFile::handlePlaylistMediaRemoved);
+    connect(m_playlist, &QMediaPlaylist::mediaInserted, this,
+            &AudioSourceFile::handlePlaylistMediaInserted);
+
+    m_loudnessScanner = new LoudnessScanner(this);
+    connect(m_loudnessScanner, &LoudnessScanner::scanned, this, &AudioSourceFile::handleLoudnessScanned);
+    connect(this, &AudioSourceWSpectrumCapture::spectrumRunningChanged, m_loudnessScanner,
+            [this](bool running) { m_loudnessScanner->setPaused(LoudnessScanner::VisualizerRunning, running); });
 
     connect(m_player, &MediaPlayer::playbackStateChanged, this, &AudioSourceFile::playbackStateChanged);
 
+    // Fires WAKE_AHEAD_MS before the end of the track, re-armed whenever the
+    // remaining time changes (play, pause, seek, duration known)
+    m_wakeTimer = new QTimer(this);
+    m_wakeTimer->setSingleShot(true);
+    connect(m_wakeTimer, &QTimer::timeout, this, &AudioSourceFile::wakeNextTrack);
+    connect(m_player, &MediaPlayer::playbackStateChanged, this, &AudioSourceFile::armWakeAhead);
+    connect(m_player, &MediaPlayer::durationChanged, this, &AudioSourceFile::armWakeAhead);
+
+    // Pick up where the last session left off, paused
+    m_session = new PlaylistSession(m_playlist, this);
+    m_session->setPlaybackClock(m_player->playbackClock());
+    const qint64 position = m_session->restore();
+    shuffleEnabled = m_playlist->isShuffled();
+    if (position > 0) {
+        m_player->setPosition(position);
+    }
+
+    // Browsable from the last index at once, brought up to date in the background
+    m_library = new MusicLibrary(this);
+    m_library->start();
+}
+
+const PlaybackClock *AudioSourceFile::playbackClock() const
+{
+    return m_player->playbackClock();
+}
+
+Equalizer *AudioSourceFile::equalizer()
+{
+    return m_player->equalizer();
+}
+
+MusicLibrary *AudioSourceFile::library() const
+{
+    return m_library;
 }
 
 void AudioSourceFile::activate()
@@ -38,7 +87,8 @@ void AudioSourceFile::activate()
     emit positionChanged(m_player->position());
     emit metadataChanged(m_player->metaData());
     emit durationChanged(m_player->duration());
-    emit eqEnabledChanged(false);
+    emit outputFormatChanged(m_player->format().sampleRate(), m_player->isResampling());
+    emit eqEnabledChanged(loadEqualizer());
     emit plEnabledChanged(true);
     emit shuffleEnabledChanged(shuffleEnabled);
     emit repeatEnabledChanged(repeatEnabled);
@@ -132,6 +182,12 @@ void AudioSourceFile::handleSeek(int mseconds)
 {
     m_player->setPosition(mseconds);
 
+    // Seeking back out of the last seconds wakes the drive again next time
+    const qint64 duration = m_player->duration();
+    if (duration <= 0 || duration - mseconds > WAKE_AHEAD_MS) {
+        m_nextTrackWoken = false;
+    }
+    armWakeAhead();
 }
 
 void AudioSourceFile::handleMetaDataChanged()
@@ -142,6 +198,10 @@ void AudioSourceFile::handleMetaDataChanged()
 
 void AudioSourceFile::handleMediaStatusChanged(MediaPlayer::MediaStatus status)
 {
+    // Keep the loudness scanner out of the way while the decoder catches up
+    m_loudnessScanner->setPaused(LoudnessScanner::DecoderBusy,
+                                 status == MediaPlayer::LoadingMedia || status == MediaPlayer::StalledMedia);
+
     // handle status message
     switch (status) {
     case MediaPlayer::NoMedia:
@@ -202,7 +262,11 @@ void AudioSourceFile::setStatusInfo(const QString &info)
 
 void AudioSourceFile::handlePlaylistPositionChanged(int)
 {
-    m_player->setSource(m_playlist->currentQueueMedia());
+    const QUrl url = m_playlist->currentQueueMedia();
+    m_prefetcher.recordOpen(url);
+    m_player->setSource(url);
+    updateReplayGain();
+    prefetchUpcoming();
 
     if (shouldBePlaying) {
         m_player->play();
@@ -224,6 +288,76 @@ void AudioSourceFile::handlePlaylistMediaRemoved(int from, int to)
     }
 }
 
+void AudioSourceFile::handlePlaylistMediaInserted(int start, int end)
+{
+    QList<QUrl> urls;
+    for (int i = start; i <= end; ++i) {
+        urls.append(m_playlist->media(i));
+    }
+    m_loudnessScanner->enqueue(urls);
+}
+
+void AudioSourceFile::handleLoudnessScanned(const QUrl &url)
+{
+    // Only fill in a gain that was missing at track start; changing it later
+    // would be an audible jump.
+    if (m_replayGainPending && url.toLocalFile() == m_playlist->currentQueueMedia().toLocalFile()) {
+        updateReplayGain();
+    }
+}
+
+void AudioSourceFile::handlePositionChanged()
+{
+    m_session->markPositionDirty();
+}
+
+void AudioSourceFile::armWakeAhead()
+{
+    m_wakeTimer->stop();
+    const qint64 duration = m_player->duration();
+    if (m_nextTrackWoken || duration <= 0 || m_player->playbackState() != MediaPlayer::PlayingState) {
+        return;
+    }
+    m_wakeTimer->start(int(qMax<qint64>(0, duration - m_player->position() - WAKE_AHEAD_MS)));
+}
+
+void AudioSourceFile::wakeNextTrack()
+{
+    // Give a sleeping drive time to spin up before the next track opens
+    m_nextTrackWoken = true;
+    const int next = m_playlist->nextQueueIndex();
+    if (next >= 0) {
+        m_prefetcher.wake(m_playlist->queueMedia(next));
+    }
+}
+
+void AudioSourceFile::prefetchUpcoming()
+{
+    m_nextTrackWoken = false;
+    armWakeAhead();
+
+    QList<QUrl> upcoming;
+    for (int step = 1; step <= TrackPrefetcher::TRACKS_AHEAD; ++step) {
+        const int index = m_playlist->nextQueueIndex(step);
+        if (index < 0) {
+            break;
+        }
+        upcoming.append(m_playlist->queueMedia(index));
+    }
+    m_prefetcher.prefetch(upcoming);
+}
+
+void AudioSourceFile::updateReplayGain()
+{
+    const QUrl url = m_playlist->currentQueueMedia();
+    bool known = false;
+    m_player->setReplayGain(m_loudnessScanner->gainFor(url, &known));
+    m_replayGainPending = !known;
+    if (!known) {
+        m_loudnessScanner->prioritize(url);
+    }
+}
+
 void AudioSourceFile::jump(const QModelIndex &index)
 {
     if (index.isValid()) {
@@ -237,12 +371,18 @@ void AudioSourceFile::jump(const QModelIndex &index)
 void AudioSourceFile::addToPlaylist(const QList<QUrl> &urls)
 {
     const int previousMediaCount = m_playlist->mediaCount();
+    // One insertion for each run of files between playlists
+    QList<QUrl> media;
     for (auto &url : urls) {
-        if (isPlaylist(url))
+        if (isPlaylist(url)) {
+            m_playlist->addMedia(media);
+            media.clear();
             m_playlist->load(url);
-        else
-            m_playlist->addMedia(url);
+        } else {
+            media.append(url);
+        }
     }
+    m_playlist->addMedia(media);
     if (m_playlist->mediaCount() > previousMediaCount) {
         // Start playing only if not already playing
         if(m_player->playbackState() == MediaPlayer::PlaybackState::StoppedState) {
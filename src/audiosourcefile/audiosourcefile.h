@@ -2,11 +2,16 @@
 #define AUDIOSOURCEFILE_H
 
 #include <QObject>
+#include <QTimer>
 
 #include "audiosourcewspectrumcapture.h"
 #include "qmediaplaylist.h"
 #include "playlistmodel.h"
 #include "mediaplayer.h"
+#include "loudnessscanner.h"
+#include "musiclibrary.h"
+#include "playlistsession.h"
+#include "trackprefetcher.h"
 
 class AudioSourceFile : public AudioSourceWSpectrumCapture
 {
@@ -14,6 +19,10 @@ class AudioSourceFile : public AudioSourceWSpectrumCapture
 public:
     explicit AudioSourceFile(QObject *parent = nullptr, PlaylistModel *playlistModel = nullptr);
 
+    const PlaybackClock *playbackClock() const override;
+    Equalizer *equalizer() override;
+    MusicLibrary *library() const;
+
 signals:
     void showPlaylistRequested();
 
@@ -42,12 +51,24 @@ private slots:
     void handleMediaError();
     void handlePlaylistPositionChanged(int);
     void handlePlaylistMediaRemoved(int, int);
+    void handlePlaylistMediaInserted(int start, int end);
+    void handleLoudnessScanned(const QUrl &url);
+    void handlePositionChanged();
+    void armWakeAhead();
+    void wakeNextTrack();
 
 
 private:
     MediaPlayer *m_player = nullptr;
     QMediaPlaylist *m_playlist = nullptr;
     PlaylistModel *m_playlistModel = nullptr;
+    LoudnessScanner *m_loudnessScanner = nullptr;
+    PlaylistSession *m_session = nullptr;
+    MusicLibrary *m_library = nullptr;
+    bool m_replayGainPending = false;
+    TrackPrefetcher m_prefetcher;
+    bool m_nextTrackWoken = false;
+    QTimer *m_wakeTimer = nullptr;
 
     QString m_statusInfo;
 
@@ -56,6 +77,8 @@ private:
     bool shouldBePlaying = false;
 
     void setStatusInfo(const QString &info);
+    void updateReplayGain();
+    void prefetchUpcoming();
 
 };
 
@@ -0,0 +1,260 @@
+#include "loudnessmeter.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+constexpr double ABSOLUTE_GATE_LUFS = -70.0;
+constexpr double RELATIVE_GATE_LU = -10.0;
+constexpr double BIN_WIDTH_LU = 0.1;
+
+double energyToLoudness(double energy)
+{
+    return -0.691 + 10.0 * std::log10(energy);
+}
+
+double loudnessToEnergy(double loudness)
+{
+    return std::pow(10.0, (loudness + 0.691) / 10.0);
+}
+
+const double *binEnergies()
+{
+    static double energies[LoudnessMeter::HISTOGRAM_BINS];
+    static const bool initialized = [] {
+        for (int i = 0; i < LoudnessMeter::HISTOGRAM_BINS; ++i) {
+            energies[i] = loudnessToEnergy(ABSOLUTE_GATE_LUFS + (i + 0.5) * BIN_WIDTH_LU);
+        }
+        return true;
+    }();
+    Q_UNUSED(initialized);
+    return energies;
+}
+
+inline double runBiquad(double x, double b0, double b1, double b2, double a1, double a2, double *z)
+{
+    const double y = b0 * x + z[0];
+    z[0] = b1 * x - a1 * y + z[1];
+    z[1] = b2 * x - a2 * y;
+    return y;
+}
+} // namespace
+
+bool LoudnessMeter::configure(int sampleRate, int channels)
+{
+    if (sampleRate <= 0 || channels <= 0 || channels > LOUDNESS_MAX_CHANNELS) {
+        m_sampleRate = 0;
+        return false;
+    }
+
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+
+    // Surround channels weigh more, LFE is ignored (BS.1770 table 3, 5.1 order)
+    for (int c = 0; c < LOUDNESS_MAX_CHANNELS; ++c) {
+        m_channelWeights[c] = 1.0;
+    }
+    if (channels == 6) {
+        m_channelWeights[3] = 0.0;
+        m_channelWeights[4] = 1.41;
+        m_channelWeights[5] = 1.41;
+    }
+
+    // K-weighting: the BS.1770 pre-filter (high shelf) and RLB high-pass,
+    // derived for the actual sample rate rather than the 48 kHz table.
+    {
+        const double f0 = 1681.974450955533;
+        const double gainDb = 3.999843853973347;
+        const double q = 0.7071752369554196;
+        const double k = std::tan(M_PI * f0 / sampleRate);
+        const double vh = std::pow(10.0, gainDb / 20.0);
+        const double vb = std::pow(vh, 0.4996667741545416);
+        const double a0 = 1.0 + k / q + k * k;
+        m_shelf.b0 = (vh + vb * k / q + k * k) / a0;
+        m_shelf.b1 = 2.0 * (k * k - vh) / a0;
+        m_shelf.b2 = (vh - vb * k / q + k * k) / a0;
+        m_shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+        m_shelf.a2 = (1.0 - k / q + k * k) / a0;
+    }
+    {
+        const double f0 = 38.13547087602444;
+        const double q = 0.5003270373238773;
+        const double k = std::tan(M_PI * f0 / sampleRate);
+        const double a0 = 1.0 + k / q + k * k;
+        m_highPass.b0 = 1.0;
+        m_highPass.b1 = -2.0;
+        m_highPass.b2 = 1.0;
+        m_highPass.a1 = 2.0 * (k * k - 1.0) / a0;
+        m_highPass.a2 = (1.0 - k / q + k * k) / a0;
+    }
+
+    std::memset(m_state, 0, sizeof(m_state));
+    m_subBlockFrames = qMax(1, sampleRate / 10);
+    m_subBlockPosition = 0;
+    m_subBlockEnergy = 0.0;
+    std::memset(m_recentEnergy, 0, sizeof(m_recentEnergy));
+    m_subBlockCount = 0;
+    m_histogram = QList<quint32>(HISTOGRAM_BINS, 0);
+
+    buildPeakFilter();
+    std::memset(m_peakHistory, 0, sizeof(m_peakHistory));
+    m_peakPosition = 0;
+    m_truePeak = 0.0f;
+    return true;
+}
+
+bool LoudnessMeter::isConfigured() const
+{
+    return m_sampleRate > 0;
+}
+
+void LoudnessMeter::process(const float *samples, qint64 frames)
+{
+    if (!isConfigured() || samples == nullptr) {
+        return;
+    }
+
+    const Biquad shelf = m_shelf;
+    const Biquad highPass = m_highPass;
+    float truePeak = m_truePeak;
+
+    for (qint64 i = 0; i < frames; ++i) {
+        const float *frame = samples + i * m_channels;
+        double energy = 0.0;
+
+        for (int c = 0; c < m_channels; ++c) {
+            const float x = frame[c];
+            double *state = m_state[c];
+            double y = runBiquad(x, shelf.b0, shelf.b1, shelf.b2, shelf.a1, shelf.a2, state);
+            y = runBiquad(y, highPass.b0, highPass.b1, highPass.b2, highPass.a1, highPass.a2, state + 2);
+            energy += m_channelWeights[c] * y * y;
+
+            // History is stored twice so the filter window is always contiguous
+            float *history = m_peakHistory[c];
+            history[m_peakPosition] = x;
+            history[m_peakPosition + PEAK_TAPS] = x;
+            const float *window = history + m_peakPosition + 1;
+
+            truePeak = qMax(truePeak, std::fabs(x));
+            for (int phase = 0; phase < OVERSAMPLING; ++phase) {
+                const float *coefficients = m_peakCoefficients[phase];
+                float sum = 0.0f;
+                for (int k = 0; k < PEAK_TAPS; ++k) {
+                    sum += coefficients[k] * window[k];
+                }
+                truePeak = qMax(truePeak, std::fabs(sum));
+            }
+        }
+
+        m_peakPosition = m_peakPosition + 1 == PEAK_TAPS ? 0 : m_peakPosition + 1;
+        m_subBlockEnergy += energy;
+        if (++m_subBlockPosition == m_subBlockFrames) {
+            finishSubBlock();
+        }
+    }
+
+    m_truePeak = truePeak;
+
+    // Flush denormals left behind by silence
+    for (int c = 0; c < m_channels; ++c) {
+        for (double &z : m_state[c]) {
+            if (std::fabs(z) < 1e-30) {
+                z = 0.0;
+            }
+        }
+    }
+}
+
+const QList<quint32> &LoudnessMeter::histogram() const
+{
+    return m_histogram;
+}
+
+float LoudnessMeter::truePeak() const
+{
+    return m_truePeak;
+}
+
+double LoudnessMeter::integratedLoudness(const QList<quint32> &histogram)
+{
+    if (histogram.size() != HISTOGRAM_BINS) {
+        return ABSOLUTE_GATE_LUFS - 1.0;
+    }
+
+    const double *energies = binEnergies();
+    double energy = 0.0;
+    quint64 blocks = 0;
+    for (int i = 0; i < HISTOGRAM_BINS; ++i) {
+        energy += energies[i] * histogram[i];
+        blocks += histogram[i];
+    }
+    if (blocks == 0) {
+        return ABSOLUTE_GATE_LUFS - 1.0;
+    }
+
+    // Every histogrammed block already passed the absolute gate
+    const double relativeGate = energyToLoudness(energy / blocks) + RELATIVE_GATE_LU;
+    const int firstBin = qMax(0, int(std::ceil((relativeGate - ABSOLUTE_GATE_LUFS) / BIN_WIDTH_LU - 0.5)));
+
+    energy = 0.0;
+    blocks = 0;
+    for (int i = firstBin; i < HISTOGRAM_BINS; ++i) {
+        energy += energies[i] * histogram[i];
+        blocks += histogram[i];
+    }
+    if (blocks == 0) {
+        return ABSOLUTE_GATE_LUFS - 1.0;
+    }
+    return energyToLoudness(energy / blocks);
+}
+
+void LoudnessMeter::finishSubBlock()
+{
+    m_recentEnergy[m_subBlockCount % 4] = m_subBlockEnergy;
+    ++m_subBlockCount;
+    m_subBlockEnergy = 0.0;
+    m_subBlockPosition = 0;
+
+    if (m_subBlockCount < 4) {
+        return;
+    }
+
+    const double blockEnergy = (m_recentEnergy[0] + m_recentEnergy[1] + m_recentEnergy[2] + m_recentEnergy[3])
+                               / (4.0 * m_subBlockFrames);
+    if (blockEnergy <= 0.0) {
+        return;
+    }
+    const double loudness = energyToLoudness(blockEnergy);
+    if (loudness < ABSOLUTE_GATE_LUFS) {
+        return;
+    }
+    const int bin = qMin(HISTOGRAM_BINS - 1, int((loudness - ABSOLUTE_GATE_LUFS) / BIN_WIDTH_LU));
+    ++m_histogram[bin];
+}
+
+void LoudnessMeter::buildPeakFilter()
+{
+    // Windowed sinc interpolator with the cutoff at the input Nyquist
+    // frequency, split into one sub-filter per oversampling phase.
+    constexpr int length = OVERSAMPLING * PEAK_TAPS;
+    const double centre = (length - 1) / 2.0;
+
+    for (int phase = 0; phase < OVERSAMPLING; ++phase) {
+        double sum = 0.0;
+        double taps[PEAK_TAPS];
+        for (int k = 0; k < PEAK_TAPS; ++k) {
+            const int n = k * OVERSAMPLING + phase;
+            const double x = (n - centre) / OVERSAMPLING;
+            const double sinc = x == 0.0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+            const double window = 0.42 - 0.5 * std::cos(2.0 * M_PI * (n + 0.5) / length)
+                                  + 0.08 * std::cos(4.0 * M_PI * (n + 0.5) / length);
+            taps[k] = sinc * window;
+            sum += taps[k];
+        }
+        // Tap k applies to the sample k frames back; the window is stored
+        // oldest first, so reverse while normalising each phase to unity gain.
+        for (int k = 0; k < PEAK_TAPS; ++k) {
+            m_peakCoefficients[phase][PEAK_TAPS - 1 - k] = static_cast<float>(taps[k] / sum);
+        }
+    }
+}
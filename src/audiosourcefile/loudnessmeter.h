@@ -0,0 +1,74 @@
+#ifndef LOUDNESSMETER_H
+#define LOUDNESSMETER_H
+
+#include <QList>
+#include <QtGlobal>
+
+#define LOUDNESS_MAX_CHANNELS 8
+
+// ITU-R BS.1770 / EBU R128 loudness measurement.
+//
+// Samples are K-weighted and integrated over 400 ms blocks with 75% overlap.
+// Instead of keeping every block, block loudness goes into a 0.1 LU
+// histogram: integrated loudness (with the absolute and relative gates) is
+// computed from it, and the histograms of several tracks can simply be added
+// up to get the loudness of an album. True peak is measured on a 4x
+// oversampled signal.
+class LoudnessMeter
+{
+public:
+    static constexpr int HISTOGRAM_BINS = 750; // -70 to +5 LUFS
+
+    LoudnessMeter() = default;
+
+    bool configure(int sampleRate, int channels);
+    bool isConfigured() const;
+
+    // Interleaved frames in [-1, 1]
+    void process(const float *samples, qint64 frames);
+
+    const QList<quint32> &histogram() const;
+    float truePeak() const; // linear, 1.0 is full scale
+
+    // Gated loudness in LUFS, or a value below -70 if nothing passed the gate
+    static double integratedLoudness(const QList<quint32> &histogram);
+
+private:
+    struct Biquad {
+        double b0 = 1.0;
+        double b1 = 0.0;
+        double b2 = 0.0;
+        double a1 = 0.0;
+        double a2 = 0.0;
+    };
+
+    static constexpr int OVERSAMPLING = 4;
+    static constexpr int PEAK_TAPS = 12; // per oversampling phase
+
+    int m_sampleRate = 0;
+    int m_channels = 0;
+    double m_channelWeights[LOUDNESS_MAX_CHANNELS] = {};
+
+    Biquad m_shelf;
+    Biquad m_highPass;
+    double m_state[LOUDNESS_MAX_CHANNELS][4] = {};
+
+    // 100 ms sub-blocks; a gating block is the last four of them
+    int m_subBlockFrames = 0;
+    int m_subBlockPosition = 0;
+    double m_subBlockEnergy = 0.0;
+    double m_recentEnergy[4] = {};
+    int m_subBlockCount = 0;
+
+    QList<quint32> m_histogram;
+
+    float m_peakCoefficients[OVERSAMPLING][PEAK_TAPS] = {};
+    float m_peakHistory[LOUDNESS_MAX_CHANNELS][2 * PEAK_TAPS] = {};
+    int m_peakPosition = 0;
+    float m_truePeak = 0.0f;
+
+    void finishSubBlock();
+    void buildPeakFilter();
+};
+
+#endif // LOUDNESSMETER_H
@@ -0,0 +1,624 @@
+#include "loudnessscanner.h"
+
+#include "loudnessmeter.h"
+#include "util.h"
+
+#include <QAudioBuffer>
+#include <QAudioDecoder>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QThread>
+
+#include <taglib/fileref.h>
+#include <taglib/tag.h>
+#include <taglib/tpropertymap.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr quint32 CACHE_MAGIC = 0x4c4c4e44; // "LLND"
+constexpr quint32 CACHE_VERSION = 2;
+
+// ReplayGain 2.0 reference level
+constexpr double REFERENCE_LUFS = -18.0;
+// Opus R128_*_GAIN tags are relative to -23 LUFS
+constexpr double R128_REFERENCE_LUFS = -23.0;
+
+bool toFloat(const QAudioBuffer &buffer, QList<float> *output)
+{
+    const qint64 count = qint64(buffer.frameCount()) * buffer.format().channelCount();
+    output->resize(count);
+    float *out = output->data();
+
+    switch (buffer.format().sampleFormat()) {
+    case QAudioFormat::UInt8: {
+        const quint8 *in = buffer.constData<quint8>();
+        for (qint64 i = 0; i < count; ++i) {
+            out[i] = (int(in[i]) - 128) * (1.0f / 128.0f);
+        }
+        return true;
+    }
+    case QAudioFormat::Int16: {
+        const qint16 *in = buffer.constData<qint16>();
+        for (qint64 i = 0; i < count; ++i) {
+            out[i] = in[i] * (1.0f / 32768.0f);
+        }
+        return true;
+    }
+    case QAudioFormat::Int32: {
+        const qint32 *in = buffer.constData<qint32>();
+        for (qint64 i = 0; i < count; ++i) {
+            out[i] = in[i] * (1.0f / 2147483648.0f);
+        }
+        return true;
+    }
+    case QAudioFormat::Float: {
+        const float *in = buffer.constData<float>();
+        std::copy(in, in + count, out);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool tagValue(const TagLib::PropertyMap &properties, const char *key, QString *value)
+{
+    const auto it = properties.find(key);
+    if (it == properties.end() || it->second.isEmpty()) {
+        return false;
+    }
+    *value = QString::fromStdString(it->second.front().to8Bit(true)).trimmed();
+    return true;
+}
+
+// "-6.48 dB" -> -6.48
+bool parseGain(const QString &text, float *gainDb)
+{
+    QString number = text;
+    if (number.endsWith("dB", Qt::CaseInsensitive)) {
+        number.chop(2);
+    }
+    bool ok = false;
+    const float value = number.trimmed().toFloat(&ok);
+    if (ok) {
+        *gainDb = value;
+    }
+    return ok;
+}
+
+bool parsePeak(const QString &text, float *peak)
+{
+    bool ok = false;
+    const float value = text.toFloat(&ok);
+    if (ok && value > 0.0f) {
+        *peak = value;
+        return true;
+    }
+    return false;
+}
+
+float gainFromLoudness(double loudness)
+{
+    // Silence: nothing passed the gate, leave it alone
+    if (loudness < -70.0) {
+        return 0.0f;
+    }
+    return static_cast<float>(REFERENCE_LUFS - loudness);
+}
+} // namespace
+
+LoudnessScanner::LoudnessScanner(QObject *parent)
+    : QObject{parent}
+{
+    m_maxWorkers = qMax(1, QThread::idealThreadCount());
+    m_pool.setMaxThreadCount(m_maxWorkers);
+    m_pool.setThreadPriority(QThread::LowestPriority);
+}
+
+LoudnessScanner::~LoudnessScanner()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_queue.clear();
+        m_gate.wakeAll();
+    }
+    m_pool.waitForDone();
+}
+
+void LoudnessScanner::enqueue(const QList<QUrl> &urls)
+{
+    QMutexLocker locker(&m_mutex);
+    for (const QUrl &url : urls) {
+        if (!url.isLocalFile() || isPlaylist(url)) {
+            continue;
+        }
+        const QString path = url.toLocalFile();
+        if (m_queued.contains(path) || m_records.contains(path)) {
+            continue;
+        }
+        m_queued.insert(path);
+        m_queue.append(path);
+    }
+    startWorkers();
+}
+
+void LoudnessScanner::prioritize(const QUrl &url)
+{
+    if (!url.isLocalFile()) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    const QString path = url.toLocalFile();
+    if (m_records.contains(path)) {
+        return;
+    }
+    if (m_queued.contains(path)) {
+        m_queue.removeOne(path);
+    } else {
+        m_queued.insert(path);
+    }
+    m_queue.prepend(path);
+    startWorkers();
+}
+
+void LoudnessScanner::setPaused(PauseReason reason, bool paused)
+{
+    QMutexLocker locker(&m_mutex);
+    if (paused) {
+        m_pauseReasons |= reason;
+    } else {
+        m_pauseReasons &= ~reason;
+    }
+    m_gate.wakeAll();
+}
+
+LoudnessInfo LoudnessScanner::lookup(const QUrl &url) const
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_records.constFind(url.toLocalFile());
+    if (it == m_records.constEnd()) {
+        return LoudnessInfo();
+    }
+
+    const Record &record = it.value();
+    if (record.fromTags) {
+        return record.tags;
+    }
+
+    LoudnessInfo info;
+    info.valid = true;
+    info.trackGainDb = gainFromLoudness(record.loudness);
+    info.trackPeak = record.peak;
+
+    // Album gain only once it can no longer change
+    const auto album = m_albums.constFind(record.albumKey);
+    if (album != m_albums.constEnd() && album->complete) {
+        info.hasAlbumGain = true;
+        info.albumGainDb = album->gainDb;
+        info.albumPeak = album->peak;
+    }
+    return info;
+}
+
+float LoudnessScanner::gainFor(const QUrl &url, bool *known) const
+{
+    const LoudnessInfo info = lookup(url);
+    if (known != nullptr) {
+        *known = info.valid;
+    }
+
+    const GainMode mode = gainMode();
+    if (!info.valid || mode == NoGain) {
+        return 1.0f;
+    }
+
+    const bool album = mode == AlbumGain && info.hasAlbumGain;
+    const float gainDb = (album ? info.albumGainDb : info.trackGainDb) + preampDb();
+    const float peak = album ? info.albumPeak : info.trackPeak;
+    float gain = std::pow(10.0f, gainDb / 20.0f);
+    if (peak > 0.0f) {
+        gain = qMin(gain, 1.0f / peak);
+    }
+    return gain;
+}
+
+LoudnessScanner::GainMode LoudnessScanner::gainMode()
+{
+    QSettings settings;
+    const QString mode = settings.value("replaygain/mode", "track").toString();
+    if (mode == "album") {
+        return AlbumGain;
+    }
+    if (mode == "off") {
+        return NoGain;
+    }
+    return TrackGain;
+}
+
+float LoudnessScanner::preampDb()
+{
+    QSettings settings;
+    return settings.value("replaygain/preamp", 0.0f).toFloat();
+}
+
+void LoudnessScanner::startWorkers()
+{
+    while (!m_stopping && m_workers < m_maxWorkers && m_workers < m_queue.size()) {
+        ++m_workers;
+        m_pool.start([this]() { runWorker(); });
+    }
+}
+
+void LoudnessScanner::runWorker()
+{
+    while (true) {
+        QString path;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_stopping || m_queue.isEmpty()) {
+                --m_workers;
+                return;
+            }
+            path = m_queue.takeFirst();
+        }
+
+        Record record;
+        QList<quint32> histogram;
+        QStringList tracks;
+        bool ok = false;
+        const QFileInfo info(path);
+        if (info.isFile() && enterGate()) {
+            const QString cacheFile = cacheFilePath(info);
+            const bool cached = loadRecord(cacheFile, &record, &histogram);
+            if (!cached) {
+                readTags(path, &record);
+            }
+            // The first track of an album found lists the others
+            bool albumKnown = true;
+            if (!record.albumKey.isEmpty()) {
+                QMutexLocker locker(&m_mutex);
+                albumKnown = m_albums.contains(record.albumKey);
+            }
+            if (!albumKnown) {
+                tracks = albumTracks(path, record.albumKey.mid(info.absolutePath().size() + 1));
+            }
+            leaveGate();
+
+            ok = cached || record.fromTags || measure(path, &record, &histogram);
+            if (ok && !cached) {
+                saveRecord(cacheFile, record, histogram);
+            }
+        }
+
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!tracks.isEmpty()) {
+                addAlbum(record.albumKey, tracks);
+            }
+            m_queued.remove(path);
+            if (ok) {
+                m_records.insert(path, record);
+            }
+            // A track that failed doesn't hold up its album either
+            finishTrack(path, ok ? histogram : QList<quint32>(), record.peak);
+            startWorkers();
+        }
+        if (ok) {
+            emit scanned(QUrl::fromLocalFile(path));
+        }
+    }
+}
+
+// Called with m_mutex held. Queues the tracks of a newly found album that
+// aren't scanned or queued yet.
+void LoudnessScanner::addAlbum(const QString &key, const QStringList &tracks)
+{
+    if (m_albums.contains(key)) {
+        return;
+    }
+
+    Album album;
+    album.histogram = QList<quint32>(LoudnessMeter::HISTOGRAM_BINS, 0);
+    for (const QString &track : tracks) {
+        if (m_records.contains(track)) {
+            continue;
+        }
+        album.pending.insert(track);
+        m_pendingAlbum.insert(track, key);
+        if (!m_queued.contains(track)) {
+            m_queued.insert(track);
+            m_queue.append(track);
+        }
+    }
+    m_albums.insert(key, album);
+}
+
+// Called with m_mutex held. Merges the histogram of a scanned track into its
+// album, and works out the album gain when it was the last one.
+void LoudnessScanner::finishTrack(const QString &path, const QList<quint32> &histogram, float peak)
+{
+    const QString key = m_pendingAlbum.take(path);
+    if (key.isEmpty()) {
+        return;
+    }
+
+    Album &album = m_albums[key];
+    album.pending.remove(path);
+    // Tracks with ReplayGain tags have no histogram and are left out
+    if (histogram.size() == LoudnessMeter::HISTOGRAM_BINS) {
+        for (int i = 0; i < LoudnessMeter::HISTOGRAM_BINS; ++i) {
+            album.histogram[i] += histogram[i];
+        }
+        album.peak = qMax(album.peak, peak);
+    }
+    if (album.pending.isEmpty()) {
+        album.complete = true;
+        album.gainDb = gainFromLoudness(LoudnessMeter::integratedLoudness(album.histogram));
+        album.histogram = QList<quint32>();
+    }
+}
+
+int LoudnessScanner::allowedWorkers() const
+{
+    if (m_pauseReasons & DecoderBusy) {
+        return 0;
+    }
+    if (m_pauseReasons & VisualizerRunning) {
+        return 1;
+    }
+    return m_maxWorkers;
+}
+
+bool LoudnessScanner::enterGate()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_stopping && m_active >= allowedWorkers()) {
+        m_gate.wait(&m_mutex);
+    }
+    if (m_stopping) {
+        return false;
+    }
+    ++m_active;
+    return true;
+}
+
+void LoudnessScanner::leaveGate()
+{
+    QMutexLocker locker(&m_mutex);
+    --m_active;
+    m_gate.wakeAll();
+}
+
+bool LoudnessScanner::measure(const QString &path, Record *record, QList<quint32> *histogram)
+{
+    QAudioDecoder decoder;
+    QEventLoop loop;
+    LoudnessMeter meter;
+    QList<float> samples;
+    int channels = 0;
+    bool ok = true;
+    bool done = false;
+
+    auto finish = [&]() {
+        done = true;
+        loop.quit();
+    };
+
+    // The gate is taken per buffer; while it's closed the decoder's queue
+    // fills up and decoding stalls with it.
+    connect(&decoder, &QAudioDecoder::bufferReady, &loop, [&]() {
+        while (ok && decoder.bufferAvailable()) {
+            const QAudioBuffer buffer = decoder.read();
+            if (!enterGate()) {
+                ok = false;
+                break;
+            }
+            const QAudioFormat format = buffer.format();
+            if (!meter.isConfigured()) {
+                channels = format.channelCount();
+                ok = meter.configure(format.sampleRate(), channels);
+            }
+            if (ok && format.channelCount() == channels && toFloat(buffer, &samples)) {
+                meter.process(samples.constData(), buffer.frameCount());
+            }
+            leaveGate();
+        }
+        if (!ok) {
+            decoder.stop();
+            finish();
+        }
+    });
+    connect(&decoder, &QAudioDecoder::finished, &loop, finish);
+    connect(&decoder, QOverload<QAudioDecoder::Error>::of(&QAudioDecoder::error), &loop, [&]() {
+        ok = false;
+        finish();
+    });
+
+    decoder.setSource(QUrl::fromLocalFile(path));
+    decoder.start();
+    if (!done) {
+        loop.exec();
+    }
+
+    if (!ok || !meter.isConfigured()) {
+        return false;
+    }
+    *histogram = meter.histogram();
+    record->loudness = float(LoudnessMeter::integratedLoudness(*histogram));
+    record->peak = meter.truePeak();
+    return true;
+}
+
+void LoudnessScanner::readTags(const QString &path, Record *record)
+{
+    TagLib::FileRef f(path.toLocal8Bit().data());
+    if (f.isNull()) {
+        return;
+    }
+
+    if (f.tag()) {
+        const QString album = QString::fromStdString(f.tag()->album().toCString(true));
+        if (!album.isEmpty()) {
+            record->albumKey = QFileInfo(path).absolutePath() + '|' + album;
+        }
+    }
+
+    const TagLib::PropertyMap properties = f.file()->properties();
+    LoudnessInfo &tags = record->tags;
+    QString value;
+
+    if (tagValue(properties, "REPLAYGAIN_TRACK_GAIN", &value) && parseGain(value, &tags.trackGainDb)) {
+        tags.valid = true;
+        if (tagValue(properties, "REPLAYGAIN_TRACK_PEAK", &value)) {
+            parsePeak(value, &tags.trackPeak);
+        }
+        if (tagValue(properties, "REPLAYGAIN_ALBUM_GAIN", &value) && parseGain(value, &tags.albumGainDb)) {
+            tags.hasAlbumGain = true;
+            if (tagValue(properties, "REPLAYGAIN_ALBUM_PEAK", &value)) {
+                parsePeak(value, &tags.albumPeak);
+            }
+        }
+    } else if (tagValue(properties, "R128_TRACK_GAIN", &value)) {
+        // Q7.8 fixed point dB; Opus carries no peak value
+        bool ok = false;
+        const int q78 = value.toInt(&ok);
+        if (ok) {
+            tags.valid = true;
+            tags.trackGainDb = float(q78 / 256.0 + REFERENCE_LUFS - R128_REFERENCE_LUFS);
+            if (tagValue(properties, "R128_ALBUM_GAIN", &value)) {
+                const int albumQ78 = value.toInt(&ok);
+                if (ok) {
+                    tags.hasAlbumGain = true;
+                    tags.albumGainDb = float(albumQ78 / 256.0 + REFERENCE_LUFS - R128_REFERENCE_LUFS);
+                }
+            }
+        }
+    }
+
+    record->fromTags = tags.valid;
+}
+
+// Audio files next to path with album as their album tag, path included
+QStringList LoudnessScanner::albumTracks(const QString &path, const QString &album)
+{
+    const QDir dir = QFileInfo(path).absoluteDir();
+    QStringList tracks;
+    for (const QString &name : dir.entryList(audioFileFilters(), QDir::Files)) {
+        const QString track = dir.absoluteFilePath(name);
+        if (track == path) {
+            tracks.append(track);
+            continue;
+        }
+        TagLib::FileRef f(track.toLocal8Bit().data(), false);
+        if (!f.isNull() && f.tag() && QString::fromStdString(f.tag()->album().toCString(true)) == album) {
+            tracks.append(track);
+        }
+    }
+    return tracks;
+}
+
+QString LoudnessScanner::cacheFilePath(const QFileInfo &info)
+{
+    const QString key = QString("%1|%2|%3")
+                            .arg(info.canonicalFilePath())
+                            .arg(info.size())
+                            .arg(info.lastModified().toMSecsSinceEpoch());
+    const QByteArray hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1);
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/loudness/"
+           + QString::fromLatin1(hash.toHex()) + ".lnd";
+}
+
+bool LoudnessScanner::loadRecord(const QString &cacheFile, Record *record, QList<quint32> *histogram)
+{
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+        return false;
+    }
+
+    Record loaded;
+    LoudnessInfo &tags = loaded.tags;
+    quint32 bins = 0;
+    in >> loaded.fromTags >> loaded.albumKey >> tags.trackGainDb >> tags.trackPeak >> tags.hasAlbumGain
+        >> tags.albumGainDb >> tags.albumPeak >> loaded.loudness >> loaded.peak >> bins;
+    if (in.status() != QDataStream::Ok || bins > quint32(LoudnessMeter::HISTOGRAM_BINS)) {
+        return false;
+    }
+    tags.valid = loaded.fromTags;
+
+    // Only the non-empty bins are stored, and only for album tracks
+    QList<quint32> loadedHistogram;
+    if (bins > 0) {
+        loadedHistogram = QList<quint32>(LoudnessMeter::HISTOGRAM_BINS, 0);
+    }
+    for (quint32 i = 0; i < bins; ++i) {
+        quint16 bin = 0;
+        quint32 count = 0;
+        in >> bin >> count;
+        if (bin >= LoudnessMeter::HISTOGRAM_BINS || loaded.fromTags) {
+            return false;
+        }
+        loadedHistogram[bin] = count;
+    }
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    *record = loaded;
+    *histogram = loadedHistogram;
+    return true;
+}
+
+void LoudnessScanner::saveRecord(const QString &cacheFile, const Record &record, const QList<quint32> &histogram)
+{
+    QDir().mkpath(QFileInfo(cacheFile).absolutePath());
+
+    QSaveFile file(cacheFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "LoudnessScanner: could not write cache" << cacheFile;
+        return;
+    }
+
+    // The histogram is only needed again to merge into an album
+    const bool withHistogram = !record.albumKey.isEmpty();
+    quint32 bins = 0;
+    if (withHistogram) {
+        for (quint32 count : histogram) {
+            bins += count > 0 ? 1 : 0;
+        }
+    }
+
+    const LoudnessInfo &tags = record.tags;
+    QDataStream out(&file);
+    out << CACHE_MAGIC << CACHE_VERSION << record.fromTags << record.albumKey << tags.trackGainDb
+        << tags.trackPeak << tags.hasAlbumGain << tags.albumGainDb << tags.albumPeak << record.loudness
+        << record.peak << bins;
+    for (int i = 0; withHistogram && i < histogram.size(); ++i) {
+        if (histogram[i] > 0) {
+            out << quint16(i) << histogram[i];
+        }
+    }
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        qDebug() << "LoudnessScanner: could not write cache" << cacheFile;
+    }
+}
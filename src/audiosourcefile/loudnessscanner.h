@@ -0,0 +1,122 @@
+#ifndef LOUDNESSSCANNER_H
+#define LOUDNESSSCANNER_H
+
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+#include <QUrl>
+#include <QWaitCondition>
+
+class QFileInfo;
+
+// ReplayGain 2.0 values (reference -18 LUFS), gains in dB, peaks linear
+struct LoudnessInfo {
+    bool valid = false;
+    float trackGainDb = 0.0f;
+    float trackPeak = 1.0f;
+    bool hasAlbumGain = false;
+    float albumGainDb = 0.0f;
+    float albumPeak = 1.0f;
+};
+
+// Background loudness scanner for the file source.
+//
+// Files that carry ReplayGain (or Opus R128) tags are read, everything else
+// is decoded and measured with LoudnessMeter on a pool of low priority
+// threads. Results are cached on disk keyed by path, size and mtime. Only
+// the loudness and peak of each track are kept in memory.
+//
+// An album is the audio files sharing a directory and album tag. When the
+// first of them is scanned the rest are queued, and the block histograms of
+// its tracks are merged as they come in. Album gain is only reported once
+// every track has been measured; until then lookup() has track gain only.
+//
+// Work is gated between decoded buffers: it stops while the player's decoder
+// is loading or stalled and drops to a single thread while the visualizer
+// runs.
+class LoudnessScanner : public QObject
+{
+    Q_OBJECT
+public:
+    enum PauseReason {
+        DecoderBusy = 0x1,
+        VisualizerRunning = 0x2
+    };
+    enum GainMode {
+        NoGain,
+        TrackGain,
+        AlbumGain
+    };
+
+    explicit LoudnessScanner(QObject *parent = nullptr);
+    ~LoudnessScanner() override;
+
+    void enqueue(const QList<QUrl> &urls);
+    // Moves url to the front of the queue, queueing it if needed
+    void prioritize(const QUrl &url);
+    void setPaused(PauseReason reason, bool paused);
+
+    LoudnessInfo lookup(const QUrl &url) const;
+
+    // Linear gain for url under the configured mode and preamp, limited so
+    // the peak doesn't clip. Sets *known to whether loudness was available.
+    float gainFor(const QUrl &url, bool *known = nullptr) const;
+
+    static GainMode gainMode();
+    static float preampDb();
+
+signals:
+    void scanned(const QUrl &url);
+
+private:
+    struct Record {
+        bool fromTags = false;
+        QString albumKey;
+        LoudnessInfo tags;
+        float loudness = 0.0f; // integrated, LUFS
+        float peak = 0.0f;
+    };
+
+    struct Album {
+        QSet<QString> pending; // tracks not scanned yet
+        QList<quint32> histogram; // merged so far, dropped once complete
+        float peak = 0.0f;
+        bool complete = false;
+        float gainDb = 0.0f;
+    };
+
+    QThreadPool m_pool;
+    int m_maxWorkers = 1;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_gate;
+    QList<QString> m_queue;
+    QSet<QString> m_queued;
+    QHash<QString, Record> m_records;
+    QHash<QString, Album> m_albums;
+    QHash<QString, QString> m_pendingAlbum; // track -> album still waiting for it
+    int m_pauseReasons = 0;
+    int m_workers = 0;
+    int m_active = 0;
+    bool m_stopping = false;
+
+    void startWorkers();
+    void runWorker();
+    int allowedWorkers() const;
+    bool enterGate();
+    void leaveGate();
+
+    void addAlbum(const QString &key, const QStringList &tracks);
+    void finishTrack(const QString &path, const QList<quint32> &histogram, float peak);
+
+    bool measure(const QString &path, Record *record, QList<quint32> *histogram);
+    static void readTags(const QString &path, Record *record);
+    static QStringList albumTracks(const QString &path, const QString &album);
+    static QString cacheFilePath(const QFileInfo &info);
+    static bool loadRecord(const QString &cacheFile, Record *record, QList<quint32> *histogram);
+    static void saveRecord(const QString &cacheFile, const Record &record, const QList<quint32> &histogram);
+};
+
+#endif // LOUDNESSSCANNER_H
@@ -1,117 +1,692 @@
 #include "mediaplayer.h"
 
+#include "resampler.h"
+#include "seekindex.h"
+#include "seeksourcedevice.h"
+#include "metadatacache.h"
 #include "util.h"
 
-#include <QAudioOutput>
-#include <QMediaPlayer>
-#include <QMetaObject>
+#include <QAudioBuffer>
+#include <QAudioDecoder>
+#include <QAudioDevice>
+#include <QAudioSink>
+#include <QFutureWatcher>
+#include <QMediaDevices>
 #include <QTimer>
 
-class MediaPlayerBackend : public QObject
-{
-    Q_OBJECT
-public:
-    explicit MediaPlayerBackend(QObject *parent = nullptr)
-        : QObject(parent)
-    {
-        m_audioOutput = new QAudioOutput(this);
-        m_audioOutput->setVolume(1.0);
+#include <utility>
 
-        m_player = new QMediaPlayer(this);
-        m_player->setAudioOutput(m_audioOutput);
+namespace {
+constexpr int FEED_INTERVAL_MS = 20;
+constexpr int SINK_BUFFER_MS = 250;
 
-        m_positionTimer = new QTimer(this);
-        m_positionTimer->setInterval(200);
-        connect(m_positionTimer, &QTimer::timeout, this, [this]() {
-            emit positionChanged(m_player->position());
-        });
+// Rate of positionChanged during playback. Smooth progress is read from the
+// playback clock; this keeps signal-driven consumers (session, wake-ahead) fed.
+constexpr int POSITION_INTERVAL_MS = 1000;
 
-        connect(m_player, &QMediaPlayer::playbackStateChanged,
-                this, [this](QMediaPlayer::PlaybackState state) {
-                    emit playbackStateChanged(static_cast<int>(state));
-                });
+// Start decoding this far before a seek target so the decoder has primed
+// (MP3 bit reservoir, Vorbis block overlap) by the time it reaches it.
+constexpr qint64 SEEK_PREROLL_US = 100000;
 
-        connect(m_player, &QMediaPlayer::mediaStatusChanged,
-                this, [this](QMediaPlayer::MediaStatus status) {
-                    emit mediaStatusChanged(static_cast<int>(status));
-                });
+// Loudness normalisation gain. It is already limited by the track peak, the
+// bounds only guard against peaks measured before some later re-encode.
+template<typename T>
+void scaleSamples(T *samples, qint64 count, float gain, float low, float high)
+{
+    for (qint64 i = 0; i < count; ++i) {
+        samples[i] = static_cast<T>(qBound(low, samples[i] * gain, high));
+    }
+}
 
-        connect(m_player, &QMediaPlayer::durationChanged, this, &MediaPlayerBackend::durationChanged);
-        connect(m_player, &QMediaPlayer::positionChanged, this, &MediaPlayerBackend::positionChanged);
-        connect(m_player, &QMediaPlayer::bufferProgressChanged, this, &MediaPlayerBackend::bufferProgressChanged);
+// Output format for a source decoded at its native format: the native format
+// itself when the device takes it, otherwise the closest format that needs a
+// single conversion (bit depth only, then rate only, then both).
+QAudioFormat chooseOutputFormat(const QAudioDevice &device, const QAudioFormat &native)
+{
+    if (device.isFormatSupported(native)) {
+        return native;
+    }
 
-        connect(m_audioOutput, &QAudioOutput::volumeChanged,
-                this, &MediaPlayerBackend::volumeChanged);
+    const QAudioFormat preferred = device.preferredFormat();
+    QAudioFormat depthOnly = native;
+    depthOnly.setSampleFormat(preferred.sampleFormat());
+    QAudioFormat rateOnly = native;
+    rateOnly.setSampleRate(preferred.sampleRate());
+    QAudioFormat both = rateOnly;
+    both.setSampleFormat(preferred.sampleFormat());
+
+    for (const QAudioFormat &candidate : {depthOnly, rateOnly, both}) {
+        if (device.isFormatSupported(candidate)) {
+            return candidate;
+        }
+    }
+    return preferred;
+}
+}
 
-        connect(m_player, &QMediaPlayer::metaDataChanged, this, [this]() {
-            emit metaDataChanged(m_player->metaData());
-        });
+// Decodes the current source with QAudioDecoder and pushes PCM into a
+// QAudioSink we own, so the playback position can be derived from the frames
+// actually consumed by the sink instead of being polled from a player object.
+class MediaPlayerBackend : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MediaPlayerBackend(const QAudioFormat &format, PlaybackClock *clock, Equalizer *equalizer,
+                                QObject *parent = nullptr)
+        : QObject(parent)
+        , m_format(format)
+        , m_clock(clock)
+        , m_equalizer(equalizer)
+    {
+        m_decoder = new QAudioDecoder(this);
 
-        connect(m_player, &QMediaPlayer::errorChanged, this, [this]() {
-            emit errorChanged(static_cast<int>(m_player->error()), m_player->errorString());
+        connect(m_decoder, &QAudioDecoder::bufferReady, this, &MediaPlayerBackend::handleBufferReady);
+        connect(m_decoder, &QAudioDecoder::finished, this, [this]() {
+            m_decodeFinished = true;
+            feed();
+        });
+        connect(m_decoder, &QAudioDecoder::durationChanged, this, &MediaPlayerBackend::durationChanged);
+        connect(m_decoder, QOverload<QAudioDecoder::Error>::of(&QAudioDecoder::error),
+                this, &MediaPlayerBackend::handleDecoderError);
+
+        m_feedTimer = new QTimer(this);
+        m_feedTimer->setInterval(FEED_INTERVAL_MS);
+        connect(m_feedTimer, &QTimer::timeout, this, &MediaPlayerBackend::feed);
+
+        m_seekIndexWatcher = new QFutureWatcher<SeekIndex>(this);
+        connect(m_seekIndexWatcher, &QFutureWatcher<SeekIndex>::finished, this, [this]() {
+            const SeekIndex index = m_seekIndexWatcher->result();
+            if (index.isValid() && index.path() == m_source.toLocalFile()) {
+                m_seekIndex = index;
+            }
         });
     }
 
 public slots:
     void play()
     {
-        m_player->play();
-        m_positionTimer->start();
+        if (!m_hasSource || m_status == MediaPlayer::InvalidMedia) {
+            return;
+        }
+
+        if (m_status == MediaPlayer::EndOfMedia) {
+            restartDecoder(0);
+            setMediaStatus(MediaPlayer::LoadedMedia);
+        }
+
+        ensureSink();
+        if (m_sink->state() == QAudio::SuspendedState) {
+            m_sink->resume();
+        } else if (m_sinkDevice == nullptr) {
+            m_sinkDevice = m_sink->start();
+        }
+
+        setPlaybackState(MediaPlayer::PlayingState);
+        m_feedTimer->start();
+        feed();
     }
 
     void pause()
     {
-        m_player->pause();
-        m_positionTimer->stop();
+        m_feedTimer->stop();
+        if (m_sink != nullptr) {
+            m_sink->suspend();
+        }
+        setPlaybackState(MediaPlayer::PausedState);
+        publishClock();
     }
 
     void stop()
     {
-        m_player->stop();
-        m_positionTimer->stop();
+        m_feedTimer->stop();
+        setPlaybackState(MediaPlayer::StoppedState);
+        if (!m_hasSource) {
+            return;
+        }
+
+        restartDecoder(0);
+        if (m_status == MediaPlayer::EndOfMedia || m_status == MediaPlayer::StalledMedia
+            || m_status == MediaPlayer::BufferedMedia) {
+            setMediaStatus(MediaPlayer::LoadedMedia);
+        }
+        emit positionChanged(0);
     }
 
     void setSource(const QUrl &source)
     {
-        m_player->setSource(source);
+        m_feedTimer->stop();
+        m_decoder->stop();
+        resetSink();
+        setPlaybackState(MediaPlayer::StoppedState);
+
+        m_source = source;
+        m_hasSource = source.isValid() && !source.isEmpty();
+        m_pending = QAudioBuffer();
+        m_pendingOffset = 0;
+        m_anchorUs = 0;
+        m_seekTargetUs = 0;
+        m_decodedUs = 0;
+        m_decodeFinished = false;
+        m_formatResolved = false;
+        m_probeBuffer = QAudioBuffer();
+        m_resampling = false;
+        m_equalizer->reset();
+        m_seekIndex = SeekIndex();
+        m_mappedFile.reset();
+        publishClock();
+        emit errorChanged(QAudioDecoder::NoError, QString());
+
+        if (!m_hasSource) {
+            m_decoder->setSource(QUrl());
+            releaseSourceDevice();
+            setMediaStatus(MediaPlayer::NoMedia);
+            return;
+        }
+
+        // Local files are decoded from a shared mapping instead of read
+        // syscalls (pread on removable media); restarts and seeks reuse it.
+        if (source.isLocalFile()) {
+            m_mappedFile = QSharedPointer<MappedFile>::create(source.toLocalFile());
+            if (!m_mappedFile->isValid()) {
+                m_mappedFile.reset();
+            }
+        }
+
+        // Decode at the source's native format first; the output format is
+        // chosen once the first buffer shows what that is.
+        setMediaStatus(MediaPlayer::LoadingMedia);
+        m_decoder->setAudioFormat(QAudioFormat());
+        setDecoderStart(0);
+        m_decoder->start();
+
+        // Index entry points in the background the first time a file is
+        // played; later seeks jump straight to the nearest one.
+        if (source.isLocalFile() && SeekIndex::isIndexable(source.toLocalFile())) {
+            m_seekIndexWatcher->setFuture(SeekIndex::loadOrBuildAsync(source.toLocalFile()));
+        }
     }
 
     void clearSource()
     {
-        m_player->setSource(QUrl());
-        m_positionTimer->stop();
+        setSource(QUrl());
     }
 
     void setPosition(qint64 position)
     {
-        m_player->setPosition(position);
+        if (!m_hasSource) {
+            return;
+        }
+
+        restartDecoder(qMax<qint64>(0, position) * 1000);
+        if (m_status == MediaPlayer::EndOfMedia) {
+            setMediaStatus(MediaPlayer::LoadedMedia);
+        }
+        emit positionChanged(qMax<qint64>(0, position));
     }
 
     void setVolume(float volume)
     {
-        m_audioOutput->setVolume(volume);
+        m_volume = volume;
+        if (m_sink != nullptr) {
+            m_sink->setVolume(volume);
+        }
+        emit volumeChanged(volume);
+    }
+
+    void setReplayGain(float gain)
+    {
+        m_replayGain = gain;
     }
 
 signals:
-    void playbackStateChanged(int state);
-    void mediaStatusChanged(int status);
+    void playbackStateChanged(MediaPlayer::PlaybackState state);
+    void mediaStatusChanged(MediaPlayer::MediaStatus status);
     void durationChanged(qint64 duration);
     void positionChanged(qint64 position);
     void bufferProgressChanged(float progress);
     void volumeChanged(float volume);
     void metaDataChanged(const QMediaMetaData &metaData);
     void errorChanged(int error, const QString &errorString);
+    void outputFormatChanged(const QAudioFormat &format, int sourceSampleRate);
 
 private:
-    QMediaPlayer *m_player = nullptr;
-    QAudioOutput *m_audioOutput = nullptr;
-    QTimer *m_positionTimer = nullptr;
+    QAudioFormat m_format;
+    PlaybackClock *m_clock = nullptr;
+    Equalizer *m_equalizer = nullptr;
+    QAudioDecoder *m_decoder = nullptr;
+    SeekSourceDevice *m_sourceDevice = nullptr;
+    QAudioSink *m_sink = nullptr;
+    QIODevice *m_sinkDevice = nullptr;
+    QTimer *m_feedTimer = nullptr;
+
+    QUrl m_source;
+    bool m_hasSource = false;
+    bool m_decodeFinished = false;
+    float m_volume = 1.0f;
+    float m_replayGain = 1.0f;
+    MediaPlayer::PlaybackState m_state = MediaPlayer::StoppedState;
+    MediaPlayer::MediaStatus m_status = MediaPlayer::NoMedia;
+
+    // Decoded buffer currently being written to the sink. When the output
+    // rate differs from the source, the bytes written come from m_resampled.
+    QAudioBuffer m_pending;
+    QByteArray m_resampled;
+    qint64 m_pendingOffset = 0;
+
+    Resampler m_resampler;
+    bool m_resampling = false;
+
+    // First buffer of a source, read to learn its native format
+    QAudioBuffer m_probeBuffer;
+    bool m_formatResolved = false;
+
+    // Position of the first byte written since the last (re)start, and the
+    // amount written from there. Decoded frames before m_seekTargetUs are dropped.
+    qint64 m_anchorUs = 0;
+    qint64 m_bytesWritten = 0;
+    qint64 m_seekTargetUs = 0;
+
+    // Stream position of the next decoded buffer. Counted from the frames
+    // actually decoded, since timestamps from a mid-stream start are not
+    // reliable across backends.
+    qint64 m_decodedUs = 0;
+
+    SeekIndex m_seekIndex;
+    QSharedPointer<MappedFile> m_mappedFile;
+    QFutureWatcher<SeekIndex> *m_seekIndexWatcher = nullptr;
+
+    void handleBufferReady()
+    {
+        if (m_status == MediaPlayer::LoadingMedia) {
+            if (!m_formatResolved && !resolveOutputFormat()) {
+                return;
+            }
+            setMediaStatus(MediaPlayer::LoadedMedia);
+
+            QMediaMetaData metaData;
+            metaData.insert(QMediaMetaData::Url, m_source);
+            if (m_decoder->duration() > 0) {
+                metaData.insert(QMediaMetaData::Duration, m_decoder->duration());
+            }
+            emit metaDataChanged(metaData);
+        }
+
+        if (m_state == MediaPlayer::PlayingState) {
+            feed();
+        }
+    }
+
+    void handleDecoderError(QAudioDecoder::Error error)
+    {
+        m_feedTimer->stop();
+        resetSink();
+        setPlaybackState(MediaPlayer::StoppedState);
+        emit errorChanged(error, m_decoder->errorString());
+        setMediaStatus(MediaPlayer::InvalidMedia);
+    }
+
+    void feed()
+    {
+        if (m_sinkDevice != nullptr && m_state == MediaPlayer::PlayingState) {
+            const int bytesPerFrame = m_format.bytesPerFrame();
+            qint64 bytesFree = m_sink->bytesFree();
+
+            while (bytesFree >= bytesPerFrame) {
+                if (m_pendingOffset >= pendingSize() && !takeDecodedBuffer()) {
+                    break;
+                }
+
+                const qint64 available = pendingSize() - m_pendingOffset;
+                const qint64 chunk = (qMin(bytesFree, available) / bytesPerFrame) * bytesPerFrame;
+                if (chunk <= 0) {
+                    break;
+                }
+
+                const qint64 written = m_sinkDevice->write(pendingData() + m_pendingOffset, chunk);
+                if (written <= 0) {
+                    break;
+                }
+                m_pendingOffset += written;
+                m_bytesWritten += written;
+                bytesFree -= written;
+            }
+
+            updateStallState();
+        }
+
+        publishClock();
+        checkEndOfMedia();
+    }
+
+    bool resolveOutputFormat()
+    {
+        m_formatResolved = true;
+        m_probeBuffer = m_decoder->read();
+
+        const QAudioFormat native = m_probeBuffer.format();
+        if (!native.isValid()) {
+            return true;
+        }
+
+        const QAudioFormat output = chooseOutputFormat(QMediaDevices::defaultAudioOutput(), native);
+        qCDebug(lcAudioOutput) << "MediaPlayer: source" << native.sampleRate() << "Hz" << native.sampleFormat()
+                 << native.channelCount() << "ch, output" << output.sampleRate() << "Hz"
+                 << output.sampleFormat() << output.channelCount() << "ch,"
+                 << (output == native ? "native path"
+                     : output.sampleRate() == native.sampleRate() ? "sample format conversion"
+                                                                   : "resampled");
+
+        m_format = output;
+        emit outputFormatChanged(m_format, native.sampleRate());
+
+        // Rate conversion is ours; only a channel count change or an
+        // unrepresentable ratio is left to the decoder.
+        if (output.sampleRate() != native.sampleRate() && output.channelCount() == native.channelCount()
+            && m_resampler.configure(native.sampleRate(), output.sampleRate(), native.channelCount(),
+                                     Resampler::defaultQuality())) {
+            m_resampling = true;
+            qCDebug(lcAudioOutput) << "MediaPlayer: resampling" << native.sampleRate() << "->" << output.sampleRate()
+                     << "quality" << Resampler::defaultQuality();
+        }
+        if (m_sink != nullptr && m_sink->format() != m_format) {
+            ensureSink();
+            if (m_state == MediaPlayer::PlayingState) {
+                m_sinkDevice = m_sink->start();
+            }
+        }
+        if (output == native || m_resampling) {
+            return true;
+        }
+
+        // Let the decoder do the one conversion instead of stacking it with
+        // whatever the sound server would do.
+        m_decoder->stop();
+        m_decoder->setAudioFormat(output);
+        restartDecoder(m_anchorUs);
+        return false;
+    }
+
+    QAudioBuffer takeNextBuffer()
+    {
+        if (m_probeBuffer.isValid()) {
+            return std::exchange(m_probeBuffer, QAudioBuffer());
+        }
+        return m_decoder->read();
+    }
+
+    void applyReplayGain(QAudioBuffer &buffer)
+    {
+        const qint64 count = qint64(buffer.frameCount()) * buffer.format().channelCount();
+        switch (buffer.format().sampleFormat()) {
+        case QAudioFormat::Int16:
+            scaleSamples(buffer.data<qint16>(), count, m_replayGain, -32768.0f, 32767.0f);
+            break;
+        case QAudioFormat::Int32:
+            // Through float, a 24-bit mantissa is plenty at these gains
+            scaleSamples(buffer.data<qint32>(), count, m_replayGain, -2147483648.0f, 2147483520.0f);
+            break;
+        case QAudioFormat::Float:
+            scaleSamples(buffer.data<float>(), count, m_replayGain, -1.0f, 1.0f);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void applyEqualizer(QAudioBuffer &buffer)
+    {
+        const QAudioFormat format = buffer.format();
+        switch (format.sampleFormat()) {
+        case QAudioFormat::Int16:
+            m_equalizer->process(buffer.data<qint16>(), buffer.frameCount(), format.channelCount(), format.sampleRate());
+            break;
+        case QAudioFormat::Int32:
+            m_equalizer->process(buffer.data<qint32>(), buffer.frameCount(), format.channelCount(), format.sampleRate());
+            break;
+        case QAudioFormat::Float:
+            m_equalizer->process(buffer.data<float>(), buffer.frameCount(), format.channelCount(), format.sampleRate());
+            break;
+        default:
+            break;
+        }
+    }
+
+    bool takeDecodedBuffer()
+    {
+        while (m_probeBuffer.isValid() || m_decoder->bufferAvailable()) {
+            QAudioBuffer buffer = takeNextBuffer();
+            if (!buffer.isValid() || buffer.byteCount() <= 0) {
+                continue;
+            }
+
+            const qint64 bufferStartUs = m_decodedUs;
+            m_decodedUs += buffer.duration();
+
+            qint64 skipBytes = 0;
+            if (m_seekTargetUs > 0) {
+                if (m_decodedUs <= m_seekTargetUs) {
+                    continue;
+                }
+                const qint64 skipUs = qMax<qint64>(0, m_seekTargetUs - bufferStartUs);
+                skipBytes = qMin<qint64>(buffer.byteCount(),
+                                         buffer.format().bytesForFrames(buffer.format().framesForDuration(skipUs)));
+                m_seekTargetUs = 0;
+            }
+
+            m_pending = std::move(buffer);
+            m_pendingOffset = skipBytes;
+            if (m_replayGain != 1.0f) {
+                applyReplayGain(m_pending);
+            }
+            if (m_equalizer->isEnabled()) {
+                applyEqualizer(m_pending);
+            }
+            if (m_resampling) {
+                resamplePending();
+            }
+            if (m_pendingOffset < pendingSize()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool hasPendingData() const
+    {
+        return m_pendingOffset < pendingSize() || m_probeBuffer.isValid() || m_decoder->bufferAvailable();
+    }
+
+    void resamplePending()
+    {
+        const QAudioFormat source = m_pending.format();
+        const qint64 frames = m_pending.frameCount() - source.framesForBytes(m_pendingOffset);
+
+        // Capacity is kept across buffers, so this only grows a few times per track
+        m_resampled.resize(m_resampler.maxOutputFrames(frames) * m_format.bytesPerFrame());
+        const qint64 produced = m_resampler.process(m_pending.constData<char>() + m_pendingOffset,
+                                                    source.sampleFormat(), frames,
+                                                    m_resampled.data(), m_format.sampleFormat());
+        m_resampled.resize(m_format.bytesForFrames(produced));
+        m_pendingOffset = 0;
+    }
+
+    const char *pendingData() const
+    {
+        return m_resampling ? m_resampled.constData() : m_pending.constData<char>();
+    }
+
+    qint64 pendingSize() const
+    {
+        return m_resampling ? m_resampled.size() : m_pending.byteCount();
+    }
+
+    qint64 sinkBufferedBytes() const
+    {
+        if (m_sink == nullptr || m_sinkDevice == nullptr) {
+            return 0;
+        }
+        return qMax<qint64>(0, m_sink->bufferSize() - m_sink->bytesFree());
+    }
+
+    void updateStallState()
+    {
+        if (!hasPendingData() && !m_decodeFinished && sinkBufferedBytes() == 0) {
+            if (m_status != MediaPlayer::StalledMedia) {
+                setMediaStatus(MediaPlayer::StalledMedia);
+                emit bufferProgressChanged(0.0f);
+            }
+        } else if (m_status == MediaPlayer::StalledMedia || m_status == MediaPlayer::LoadedMedia) {
+            setMediaStatus(MediaPlayer::BufferedMedia);
+            emit bufferProgressChanged(1.0f);
+        }
+    }
+
+    void checkEndOfMedia()
+    {
+        if (m_state != MediaPlayer::PlayingState || !m_decodeFinished || hasPendingData()) {
+            return;
+        }
+
+        // Let the sink play out what it has queued before reporting the end.
+        if (sinkBufferedBytes() > 0) {
+            return;
+        }
+
+        m_feedTimer->stop();
+        resetSink();
+        setPlaybackState(MediaPlayer::StoppedState);
+        setMediaStatus(MediaPlayer::EndOfMedia);
+    }
+
+    void publishClock()
+    {
+        const qint64 bufferedBytes = sinkBufferedBytes();
+        const qint64 playedBytes = qMax<qint64>(0, m_bytesWritten - bufferedBytes);
+        const qint64 positionUs = m_anchorUs + m_format.durationForBytes(playedBytes);
+        m_clock->publish(positionUs, m_state == MediaPlayer::PlayingState && bufferedBytes > 0);
+    }
+
+    void restartDecoder(qint64 positionUs)
+    {
+        m_decoder->stop();
+        resetSink();
+
+        m_pending = QAudioBuffer();
+        m_pendingOffset = 0;
+        m_probeBuffer = QAudioBuffer();
+        // Keeps its capacity for the next buffer at the same rate
+        m_resampled.resize(0);
+        m_resampler.reset();
+        m_anchorUs = positionUs;
+        m_seekTargetUs = positionUs;
+        m_decodedUs = 0;
+        m_decodeFinished = false;
+        m_equalizer->reset();
+
+        if (m_state == MediaPlayer::PlayingState) {
+            ensureSink();
+            m_sinkDevice = m_sink->start();
+        }
+
+        setDecoderStart(positionUs);
+        m_decoder->start();
+        publishClock();
+    }
+
+    // Point the decoder at the seek index entry closest before positionUs, or
+    // at the whole file if there is none (decode from the start and drop).
+    void setDecoderStart(qint64 positionUs)
+    {
+        const SeekIndex::Entry entry = m_seekIndex.entryBefore(positionUs - SEEK_PREROLL_US);
+        const bool indexed = entry.offset > m_seekIndex.headerLength();
+
+        if (m_mappedFile) {
+            auto *device = new SeekSourceDevice(m_mappedFile, indexed ? m_seekIndex.headerLength() : 0,
+                                                indexed ? entry.offset : 0, this);
+            if (device->open(QIODevice::ReadOnly)) {
+                m_decoder->setSourceDevice(device);
+                releaseSourceDevice();
+                m_sourceDevice = device;
+                if (indexed) {
+                    m_decodedUs = m_seekIndex.sampleToUs(entry.sample);
+                }
+                return;
+            }
+            delete device;
+        }
+
+        // Not mappable: the decoder opens the file itself
+        if (m_sourceDevice != nullptr || m_decoder->source() != m_source) {
+            m_decoder->setSource(m_source);
+            releaseSourceDevice();
+        }
+    }
+
+    void releaseSourceDevice()
+    {
+        if (m_sourceDevice != nullptr && m_sourceDevice != m_decoder->sourceDevice()) {
+            m_sourceDevice->deleteLater();
+            m_sourceDevice = nullptr;
+        }
+    }
+
+    void ensureSink()
+    {
+        if (m_sink != nullptr) {
+            if (m_sink->format() == m_format) {
+                return;
+            }
+            // New source with a different output format
+            resetSink();
+            m_sink->deleteLater();
+            m_sink = nullptr;
+        }
+
+        m_sink = new QAudioSink(QMediaDevices::defaultAudioOutput(), m_format, this);
+        m_sink->setBufferSize(m_format.bytesForDuration(SINK_BUFFER_MS * 1000));
+        m_sink->setVolume(m_volume);
+    }
+
+    void resetSink()
+    {
+        if (m_sink != nullptr && m_sink->state() != QAudio::StoppedState) {
+            // Drop queued audio so nothing stale is heard after a discontinuity.
+            m_sink->reset();
+            m_sink->stop();
+        }
+        m_sinkDevice = nullptr;
+        m_bytesWritten = 0;
+    }
+
+    void setPlaybackState(MediaPlayer::PlaybackState state)
+    {
+        if (m_state == state) {
+            return;
+        }
+        m_state = state;
+        emit playbackStateChanged(state);
+    }
+
+    void setMediaStatus(MediaPlayer::MediaStatus status)
+    {
+        if (m_status == status) {
+            return;
+        }
+        m_status = status;
+        emit mediaStatusChanged(status);
+    }
 };
 
 MediaPlayer::MediaPlayer(QObject *parent)
     : QObject(parent)
 {
-    m_backend = new MediaPlayerBackend();
+    // Used until the first source reports its native format
+    m_format.setSampleFormat(QAudioFormat::Int16);
+    m_format.setSampleRate(DEFAULT_SAMPLE_RATE);
+    m_format.setChannelConfig(QAudioFormat::ChannelConfigStereo);
+    m_format.setChannelCount(2);
+
+    m_backend = new MediaPlayerBackend(m_format, &m_clock, &m_equalizer);
 
     connect(m_backend, &MediaPlayerBackend::playbackStateChanged,
         this, &MediaPlayer::handleBackendPlaybackStateChanged);
@@ -129,11 +704,18 @@ MediaPlayer::MediaPlayer(QObject *parent)
         this, &MediaPlayer::handleBackendMetaDataChanged);
     connect(m_backend, &MediaPlayerBackend::errorChanged,
         this, &MediaPlayer::handleBackendErrorChanged);
-
-    m_format.setSampleFormat(QAudioFormat::Int16);
-    m_format.setSampleRate(DEFAULT_SAMPLE_RATE);
-    m_format.setChannelConfig(QAudioFormat::ChannelConfigStereo);
-    m_format.setChannelCount(2);
+    connect(m_backend, &MediaPlayerBackend::outputFormatChanged,
+        this, &MediaPlayer::handleBackendOutputFormatChanged);
+
+    m_fallbackWatcher = new QFutureWatcher<QMediaMetaData>(this);
+    connect(m_fallbackWatcher, &QFutureWatcher<QMediaMetaData>::finished,
+        this, &MediaPlayer::handleFallbackMetaDataReady);
+
+    m_positionTimer = new QTimer(this);
+    m_positionTimer->setInterval(POSITION_INTERVAL_MS);
+    connect(m_positionTimer, &QTimer::timeout, this, [this]() {
+        emit positionChanged(m_clock.positionMs());
+    });
 }
 
 MediaPlayer::~MediaPlayer()
@@ -169,7 +751,7 @@ qint64 MediaPlayer::duration() const
 
 qint64 MediaPlayer::position() const
 {
-    return m_position;
+    return m_clock.positionMs();
 }
 
 float MediaPlayer::bufferProgress() const
@@ -207,6 +789,26 @@ QAudioFormat MediaPlayer::format()
     return m_format;
 }
 
+bool MediaPlayer::isResampling() const
+{
+    return m_sourceSampleRate > 0 && m_sourceSampleRate != m_format.sampleRate();
+}
+
+const PlaybackClock *MediaPlayer::playbackClock() const
+{
+    return &m_clock;
+}
+
+Equalizer *MediaPlayer::equalizer()
+{
+    return &m_equalizer;
+}
+
+void MediaPlayer::setReplayGain(float gain)
+{
+    m_backend->setReplayGain(gain);
+}
+
 bool MediaPlayer::isMissingTitle(const QMediaMetaData &metaData)
 {
     return metaData.value(QMediaMetaData::Title).toString().trimmed().isEmpty();
@@ -254,76 +856,43 @@ bool MediaPlayer::isMissingDuration(const QMediaMetaData &metaData)
     return metaData.value(QMediaMetaData::Duration).toLongLong() <= 0;
 }
 
-MediaPlayer::PlaybackState MediaPlayer::mapPlaybackState(int state)
-{
-    switch (static_cast<QMediaPlayer::PlaybackState>(state)) {
-    case QMediaPlayer::StoppedState:
-        return StoppedState;
-    case QMediaPlayer::PlayingState:
-        return PlayingState;
-    case QMediaPlayer::PausedState:
-        return PausedState;
-    }
-    return StoppedState;
-}
-
-MediaPlayer::MediaStatus MediaPlayer::mapMediaStatus(int status)
-{
-    switch (static_cast<QMediaPlayer::MediaStatus>(status)) {
-    case QMediaPlayer::NoMedia:
-        return NoMedia;
-    case QMediaPlayer::LoadingMedia:
-        return LoadingMedia;
-    case QMediaPlayer::LoadedMedia:
-        return LoadedMedia;
-    case QMediaPlayer::StalledMedia:
-        return StalledMedia;
-    case QMediaPlayer::BufferingMedia:
-        return BufferingMedia;
-    case QMediaPlayer::BufferedMedia:
-        return BufferedMedia;
-    case QMediaPlayer::EndOfMedia:
-        return EndOfMedia;
-    case QMediaPlayer::InvalidMedia:
-        return InvalidMedia;
-    }
-    return InvalidMedia;
-}
-
 MediaPlayer::Error MediaPlayer::mapError(int error)
 {
-    switch (static_cast<QMediaPlayer::Error>(error)) {
-    case QMediaPlayer::NoError:
+    switch (static_cast<QAudioDecoder::Error>(error)) {
+    case QAudioDecoder::NoError:
         return NoError;
-    case QMediaPlayer::ResourceError:
+    case QAudioDecoder::ResourceError:
         return ResourceError;
-    case QMediaPlayer::FormatError:
+    case QAudioDecoder::FormatError:
+    case QAudioDecoder::NotSupportedError:
         return FormatError;
-    case QMediaPlayer::NetworkError:
-        return NetworkError;
-    case QMediaPlayer::AccessDeniedError:
+    case QAudioDecoder::AccessDeniedError:
         return AccessDeniedError;
     }
     return FormatError;
 }
 
-void MediaPlayer::handleBackendPlaybackStateChanged(int state)
+void MediaPlayer::handleBackendPlaybackStateChanged(MediaPlayer::PlaybackState state)
 {
-    const PlaybackState mapped = mapPlaybackState(state);
-    if (mapped == m_state) {
+    if (state == m_state) {
         return;
     }
-    m_state = mapped;
+    m_state = state;
+    if (m_state == PlayingState) {
+        m_positionTimer->start();
+    } else {
+        m_positionTimer->stop();
+        emit positionChanged(m_clock.positionMs());
+    }
     emit playbackStateChanged(m_state);
 }
 
-void MediaPlayer::handleBackendMediaStatusChanged(int status)
+void MediaPlayer::handleBackendMediaStatusChanged(MediaPlayer::MediaStatus status)
 {
-    const MediaStatus mapped = mapMediaStatus(status);
-    if (mapped == m_status) {
+    if (status == m_status) {
         return;
     }
-    m_status = mapped;
+    m_status = status;
     emit mediaStatusChanged(m_status);
 }
 
@@ -344,11 +913,9 @@ void MediaPlayer::handleBackendDurationChanged(qint64 duration)
 
 void MediaPlayer::handleBackendPositionChanged(qint64 position)
 {
-    if (m_position == position) {
-        return;
-    }
-    m_position = position;
-    emit positionChanged(m_position);
+    // Only discontinuities (seek, stop, new source) arrive here; progress
+    // during playback is emitted from the clock by m_positionTimer.
+    emit positionChanged(position);
 }
 
 void MediaPlayer::handleBackendBufferProgressChanged(float progress)
@@ -367,100 +934,138 @@ void MediaPlayer::handleBackendVolumeChanged(float volume)
     emit volumeChanged(m_volume);
 }
 
-void MediaPlayer::handleBackendMetaDataChanged(const QMediaMetaData &metaData)
+bool MediaPlayer::needsFallback(const QMediaMetaData &metaData)
 {
-    m_metaData = metaData;
+    return isMissingTitle(metaData)
+           || isMissingAlbumTitle(metaData)
+           || isMissingAlbumArtist(metaData)
+           || isMissingGenre(metaData)
+           || isMissingTrackNumber(metaData)
+           || isMissingDate(metaData)
+           || isMissingBitrate(metaData)
+           || isMissingSampleRate(metaData)
+           || isMissingDuration(metaData);
+}
 
-    if (m_hasSource && m_sourceUrl.isValid() && !m_sourceUrl.isEmpty()) {
-        const bool needsFallback = isMissingTitle(m_metaData)
-                                   || isMissingAlbumTitle(m_metaData)
-                                   || isMissingAlbumArtist(m_metaData)
-                                   || isMissingGenre(m_metaData)
-                                   || isMissingTrackNumber(m_metaData)
-                                   || isMissingDate(m_metaData)
-                                   || isMissingBitrate(m_metaData)
-                                   || isMissingSampleRate(m_metaData)
-                                   || isMissingDuration(m_metaData);
-
-        if (needsFallback) {
-            const QMediaMetaData taglibMetaData = parseMetaData(m_sourceUrl);
-
-            if (isMissingTitle(m_metaData)) {
-                const QString title = taglibMetaData.value(QMediaMetaData::Title).toString().trimmed();
-                if (!title.isEmpty()) {
-                    m_metaData.insert(QMediaMetaData::Title, title);
-                }
-            }
+void MediaPlayer::mergeFallbackMetaData(const QMediaMetaData &fallback)
+{
+    if (isMissingTitle(m_metaData)) {
+        const QString title = fallback.value(QMediaMetaData::Title).toString().trimmed();
+        if (!title.isEmpty()) {
+            m_metaData.insert(QMediaMetaData::Title, title);
+        }
+    }
 
-            if (isMissingAlbumTitle(m_metaData)) {
-                const QString albumTitle = taglibMetaData.value(QMediaMetaData::AlbumTitle).toString().trimmed();
-                if (!albumTitle.isEmpty()) {
-                    m_metaData.insert(QMediaMetaData::AlbumTitle, albumTitle);
-                }
-            }
+    if (isMissingAlbumTitle(m_metaData)) {
+        const QString albumTitle = fallback.value(QMediaMetaData::AlbumTitle).toString().trimmed();
+        if (!albumTitle.isEmpty()) {
+            m_metaData.insert(QMediaMetaData::AlbumTitle, albumTitle);
+        }
+    }
 
-            if (isMissingAlbumArtist(m_metaData)) {
-                const QString albumArtist = taglibMetaData.value(QMediaMetaData::AlbumArtist).toString().trimmed();
-                if (!albumArtist.isEmpty()) {
-                    m_metaData.insert(QMediaMetaData::AlbumArtist, albumArtist);
-                }
-            }
+    if (isMissingAlbumArtist(m_metaData)) {
+        const QString albumArtist = fallback.value(QMediaMetaData::AlbumArtist).toString().trimmed();
+        if (!albumArtist.isEmpty()) {
+            m_metaData.insert(QMediaMetaData::AlbumArtist, albumArtist);
+        }
+    }
 
-            if (isMissingGenre(m_metaData)) {
-                const QString genre = taglibMetaData.value(QMediaMetaData::Genre).toString().trimmed();
-                if (!genre.isEmpty()) {
-                    m_metaData.insert(QMediaMetaData::Genre, genre);
-                }
-            }
+    if (isMissingGenre(m_metaData)) {
+        const QString genre = fallback.value(QMediaMetaData::Genre).toString().trimmed();
+        if (!genre.isEmpty()) {
+            m_metaData.insert(QMediaMetaData::Genre, genre);
+        }
+    }
 
-            if (isMissingTrackNumber(m_metaData)) {
-                const int trackNumber = taglibMetaData.value(QMediaMetaData::TrackNumber).toInt();
-                if (trackNumber > 0) {
-                    m_metaData.insert(QMediaMetaData::TrackNumber, trackNumber);
-                }
-            }
+    if (isMissingTrackNumber(m_metaData)) {
+        const int trackNumber = fallback.value(QMediaMetaData::TrackNumber).toInt();
+        if (trackNumber > 0) {
+            m_metaData.insert(QMediaMetaData::TrackNumber, trackNumber);
+        }
+    }
 
-            if (isMissingDate(m_metaData)) {
-                const QVariant date = taglibMetaData.value(QMediaMetaData::Date);
-                if (date.isValid() && !date.isNull()) {
-                    m_metaData.insert(QMediaMetaData::Date, date);
-                }
-            }
+    if (isMissingDate(m_metaData)) {
+        const QVariant date = fallback.value(QMediaMetaData::Date);
+        if (date.isValid() && !date.isNull()) {
+            m_metaData.insert(QMediaMetaData::Date, date);
+        }
+    }
 
-            if (isMissingBitrate(m_metaData)) {
-                const int bitrate = taglibMetaData.value(QMediaMetaData::AudioBitRate).toInt();
-                if (bitrate > 0) {
-                    m_metaData.insert(QMediaMetaData::AudioBitRate, bitrate);
-                }
-            }
+    if (isMissingBitrate(m_metaData)) {
+        const int bitrate = fallback.value(QMediaMetaData::AudioBitRate).toInt();
+        if (bitrate > 0) {
+            m_metaData.insert(QMediaMetaData::AudioBitRate, bitrate);
+        }
+    }
 
-            if (isMissingSampleRate(m_metaData)) {
-                bool ok = false;
-                const int sampleRate = taglibMetaData.value(QMediaMetaData::Comment).toString().toInt(&ok);
-                if (ok && sampleRate > 0) {
-                    m_metaData.insert(QMediaMetaData::Comment, QString::number(sampleRate));
-                }
-            }
+    if (isMissingSampleRate(m_metaData)) {
+        bool ok = false;
+        const int sampleRate = fallback.value(QMediaMetaData::Comment).toString().toInt(&ok);
+        if (ok && sampleRate > 0) {
+            m_metaData.insert(QMediaMetaData::Comment, QString::number(sampleRate));
+        }
+    }
 
-            if (isMissingDuration(m_metaData)) {
-                const qint64 duration = taglibMetaData.value(QMediaMetaData::Duration).toLongLong();
-                if (duration > 0) {
-                    m_metaData.insert(QMediaMetaData::Duration, duration);
-                }
-            }
+    if (isMissingDuration(m_metaData)) {
+        const qint64 duration = fallback.value(QMediaMetaData::Duration).toLongLong();
+        if (duration > 0) {
+            m_metaData.insert(QMediaMetaData::Duration, duration);
+        }
+    }
 
-            if (!m_metaData.value(QMediaMetaData::Url).isValid() || m_metaData.value(QMediaMetaData::Url).isNull()) {
-                const QUrl url = taglibMetaData.value(QMediaMetaData::Url).toUrl();
-                if (url.isValid() && !url.isEmpty()) {
-                    m_metaData.insert(QMediaMetaData::Url, url);
-                }
-            }
+    if (!m_metaData.value(QMediaMetaData::Url).isValid() || m_metaData.value(QMediaMetaData::Url).isNull()) {
+        const QUrl url = fallback.value(QMediaMetaData::Url).toUrl();
+        if (url.isValid() && !url.isEmpty()) {
+            m_metaData.insert(QMediaMetaData::Url, url);
         }
     }
+}
+
+void MediaPlayer::handleBackendMetaDataChanged(const QMediaMetaData &metaData)
+{
+    // The decoder only knows the URL and duration. Tags and audio properties
+    // come from the TagLib read started with the source, which has usually
+    // finished by the time the first buffer is decoded.
+    m_metaData = metaData;
+    if (m_fallbackReady && needsFallback(m_metaData)) {
+        mergeFallbackMetaData(m_fallbackMetaData);
+    }
 
     emit metaDataChanged();
 }
 
+void MediaPlayer::handleFallbackMetaDataReady()
+{
+    if (!m_hasSource || m_fallbackUrl != m_sourceUrl) {
+        // Source changed while parsing
+        return;
+    }
+
+    m_fallbackMetaData = m_fallbackWatcher->result();
+    m_fallbackReady = true;
+    mergeFallbackMetaData(m_fallbackMetaData);
+    emit metaDataChanged();
+}
+
+void MediaPlayer::requestFallbackMetaData()
+{
+    m_fallbackMetaData = QMediaMetaData{};
+    m_fallbackReady = false;
+    m_fallbackUrl = QUrl();
+    if (!m_hasSource) {
+        return;
+    }
+
+    // Use the cached metadata if there is any. Otherwise parse it (usually
+    // a persistent store hit) off the GUI thread while the decoder starts.
+    if (MetaDataCache::lookup(m_sourceUrl, &m_fallbackMetaData)) {
+        m_fallbackReady = true;
+    } else {
+        m_fallbackUrl = m_sourceUrl;
+        m_fallbackWatcher->setFuture(MetaDataCache::parseAsync(m_sourceUrl));
+    }
+}
+
 void MediaPlayer::handleBackendErrorChanged(int error, const QString &errorString)
 {
     const Error mapped = mapError(error);
@@ -472,10 +1077,19 @@ void MediaPlayer::handleBackendErrorChanged(int error, const QString &errorStrin
     }
 }
 
+void MediaPlayer::handleBackendOutputFormatChanged(const QAudioFormat &format, int sourceSampleRate)
+{
+    m_format = format;
+    m_sourceSampleRate = sourceSampleRate;
+    emit outputFormatChanged();
+}
+
 void MediaPlayer::setSource(const QUrl &source)
 {
     m_hasSource = source.isValid() && !source.isEmpty();
     m_sourceUrl = source;
+    m_metaData = QMediaMetaData{};
+    requestFallbackMetaData();
     m_backend->setSource(source);
 }
 
@@ -483,14 +1097,15 @@ void MediaPlayer::clearSource()
 {
     m_hasSource = false;
     m_sourceUrl = QUrl();
+    requestFallbackMetaData();
     m_backend->clearSource();
 
     m_metaData = QMediaMetaData{};
     m_duration = 0;
-    m_position = 0;
     m_bufferProgress = 0.0f;
     m_status = NoMedia;
     m_state = StoppedState;
+    m_positionTimer->stop();
     m_error = NoError;
     m_errorString.clear();
 
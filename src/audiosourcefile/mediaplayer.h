@@ -4,8 +4,12 @@
 
 #include "qmediametadata.h"
 #include "qurl.h"
+#include "playbackclock.h"
+#include "equalizer.h"
 #include <QAudioFormat>
+#include <QFutureWatcher>
 #include <QObject>
+#include <QTimer>
 
 class MediaPlayerBackend;
 
@@ -53,26 +57,39 @@ public:
     QMediaMetaData metaData() const;
     Error error() const;
     QString errorString() const;
+    // Format the sink runs at, and whether it differs in rate from the source
     QAudioFormat format();
+    bool isResampling() const;
+    const PlaybackClock *playbackClock() const;
+    Equalizer *equalizer();
+    // Linear loudness normalisation gain applied to decoded samples
+    void setReplayGain(float gain);
 
     ~MediaPlayer() override;
 
 private:
     MediaPlayerBackend *m_backend = nullptr;
+    PlaybackClock m_clock;
+    Equalizer m_equalizer;
 
     QAudioFormat m_format;
+    int m_sourceSampleRate = 0;
     QMediaMetaData m_metaData = QMediaMetaData{};
     Error m_error = NoError;
     MediaStatus m_status = MediaStatus::NoMedia;
     PlaybackState m_state = PlaybackState::StoppedState;
 
-    qint64 m_position = 0;
     qint64 m_duration = 0;
     float m_bufferProgress = 0.0;
     float m_volume = 1.0; // range: 0.0 - 1.0
     QString m_errorString;
     bool m_hasSource = false;
     QUrl m_sourceUrl;
+    QFutureWatcher<QMediaMetaData> *m_fallbackWatcher = nullptr;
+    QUrl m_fallbackUrl;
+    QMediaMetaData m_fallbackMetaData = QMediaMetaData{};
+    bool m_fallbackReady = false;
+    QTimer *m_positionTimer = nullptr;
 
     static bool isMissingTitle(const QMediaMetaData &metaData);
     static bool isMissingAlbumTitle(const QMediaMetaData &metaData);
@@ -83,20 +100,23 @@ private:
     static bool isMissingBitrate(const QMediaMetaData &metaData);
     static bool isMissingSampleRate(const QMediaMetaData &metaData);
     static bool isMissingDuration(const QMediaMetaData &metaData);
+    static bool needsFallback(const QMediaMetaData &metaData);
+    void mergeFallbackMetaData(const QMediaMetaData &fallback);
+    void requestFallbackMetaData();
 
-    static PlaybackState mapPlaybackState(int state);
-    static MediaStatus mapMediaStatus(int status);
     static Error mapError(int error);
 
 private slots:
-    void handleBackendPlaybackStateChanged(int state);
-    void handleBackendMediaStatusChanged(int status);
+    void handleBackendPlaybackStateChanged(MediaPlayer::PlaybackState state);
+    void handleBackendMediaStatusChanged(MediaPlayer::MediaStatus status);
     void handleBackendDurationChanged(qint64 duration);
     void handleBackendPositionChanged(qint64 position);
     void handleBackendBufferProgressChanged(float progress);
     void handleBackendVolumeChanged(float volume);
     void handleBackendMetaDataChanged(const QMediaMetaData &metaData);
     void handleBackendErrorChanged(int error, const QString &errorString);
+    void handleFallbackMetaDataReady();
+    void handleBackendOutputFormatChanged(const QAudioFormat &format, int sourceSampleRate);
 
 public slots:
     void setSource(const QUrl &source);
@@ -113,6 +133,7 @@ signals:
     void volumeChanged(float volume);
     void metaDataChanged();
     void errorChanged();
+    void outputFormatChanged();
 };
 
 #endif // MEDIAPLAYER_H
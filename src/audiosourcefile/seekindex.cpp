@@ -0,0 +1,656 @@
+#include "seekindex.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr quint32 CACHE_MAGIC = 0x4c534958; // "LSIX"
+constexpr quint32 CACHE_VERSION = 1;
+
+// Entry density. A seek lands at most this far before its target and the
+// remainder is decoded and dropped.
+constexpr int ENTRIES_PER_SECOND = 4;
+
+constexpr int MP3_BITRATES_KBPS[2][3][16] = {
+    // MPEG-1 layer I, II, III
+    {{0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},
+     {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+     {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0}},
+    // MPEG-2 / 2.5 layer I, II, III
+    {{0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+     {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+     {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}}};
+
+constexpr int MP3_SAMPLE_RATES[3] = {44100, 48000, 32000};
+
+struct Mp3Frame {
+    int length = 0;
+    int samples = 0;
+    int sampleRate = 0;
+};
+
+bool parseMp3Header(const uchar *p, Mp3Frame *frame)
+{
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) {
+        return false;
+    }
+
+    const int versionBits = (p[1] >> 3) & 0x03; // 0: 2.5, 1: reserved, 2: 2, 3: 1
+    const int layerBits = (p[1] >> 1) & 0x03;   // 1: III, 2: II, 3: I
+    const int bitrateIndex = (p[2] >> 4) & 0x0F;
+    const int rateIndex = (p[2] >> 2) & 0x03;
+    const int padding = (p[2] >> 1) & 0x01;
+    if (versionBits == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15
+        || rateIndex == 3) {
+        return false;
+    }
+
+    const bool mpeg1 = versionBits == 3;
+    const int layer = 4 - layerBits;
+    const int bitrate = MP3_BITRATES_KBPS[mpeg1 ? 0 : 1][layer - 1][bitrateIndex] * 1000;
+    int sampleRate = MP3_SAMPLE_RATES[rateIndex];
+    if (versionBits == 2) {
+        sampleRate /= 2;
+    } else if (versionBits == 0) {
+        sampleRate /= 4;
+    }
+
+    if (layer == 1) {
+        frame->samples = 384;
+        frame->length = (12 * bitrate / sampleRate + padding) * 4;
+    } else if (layer == 2) {
+        frame->samples = 1152;
+        frame->length = 144 * bitrate / sampleRate + padding;
+    } else {
+        frame->samples = mpeg1 ? 1152 : 576;
+        frame->length = (mpeg1 ? 144 : 72) * bitrate / sampleRate + padding;
+    }
+    frame->sampleRate = sampleRate;
+    return frame->length > 4;
+}
+
+// Xing/Info/VBRI frames carry no audio and decoders skip them at the start of
+// the stream, so they must not count towards sample positions.
+bool isMp3InfoFrame(const uchar *p, int length)
+{
+    const int limit = qMin(length - 4, 64);
+    for (int i = 4; i <= limit; ++i) {
+        if (std::memcmp(p + i, "Xing", 4) == 0 || std::memcmp(p + i, "Info", 4) == 0
+            || std::memcmp(p + i, "VBRI", 4) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+quint32 readLE32(const uchar *p)
+{
+    return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24);
+}
+
+qint64 readLE64(const uchar *p)
+{
+    return qint64(quint64(readLE32(p)) | (quint64(readLE32(p + 4)) << 32));
+}
+
+quint16 readLE16(const uchar *p)
+{
+    return quint16(p[0] | (p[1] << 8));
+}
+
+quint32 readBE24(const uchar *p)
+{
+    return (quint32(p[0]) << 16) | (quint32(p[1]) << 8) | quint32(p[2]);
+}
+
+quint64 readBE64(const uchar *p)
+{
+    quint64 value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+struct FlacFrame {
+    qint64 number = 0;
+    bool variableBlockSize = false;
+};
+
+// Frame header with a matching CRC-8. Sync codes also occur inside encoded
+// audio, the checksum is what makes a scan hit trustworthy.
+bool parseFlacFrameHeader(const uchar *p, qint64 available, FlacFrame *frame)
+{
+    if (available < 6 || p[0] != 0xFF || (p[1] & 0xFE) != 0xF8) {
+        return false;
+    }
+    const int blockSizeCode = p[2] >> 4;
+    const int rateCode = p[2] & 0x0F;
+    const int sampleSizeCode = (p[3] >> 1) & 0x07;
+    if (blockSizeCode == 0 || rateCode == 15 || (p[3] >> 4) > 10 || sampleSizeCode == 3
+        || (p[3] & 0x01)) {
+        return false;
+    }
+
+    // UTF-8 style coded frame or sample number
+    qint64 pos = 4;
+    int extra = 0;
+    qint64 number = p[pos];
+    if ((p[pos] & 0x80) == 0) {
+        extra = 0;
+    } else if ((p[pos] & 0xE0) == 0xC0) {
+        extra = 1;
+        number &= 0x1F;
+    } else if ((p[pos] & 0xF0) == 0xE0) {
+        extra = 2;
+        number &= 0x0F;
+    } else if ((p[pos] & 0xF8) == 0xF0) {
+        extra = 3;
+        number &= 0x07;
+    } else if ((p[pos] & 0xFC) == 0xF8) {
+        extra = 4;
+        number &= 0x03;
+    } else if ((p[pos] & 0xFE) == 0xFC) {
+        extra = 5;
+        number &= 0x01;
+    } else if (p[pos] == 0xFE) {
+        extra = 6;
+        number = 0;
+    } else {
+        return false;
+    }
+    if (pos + 1 + extra > available) {
+        return false;
+    }
+    for (int i = 1; i <= extra; ++i) {
+        if ((p[pos + i] & 0xC0) != 0x80) {
+            return false;
+        }
+        number = (number << 6) | (p[pos + i] & 0x3F);
+    }
+    pos += 1 + extra;
+
+    pos += blockSizeCode == 6 ? 1 : blockSizeCode == 7 ? 2 : 0;
+    pos += rateCode == 12 ? 1 : (rateCode == 13 || rateCode == 14) ? 2 : 0;
+    if (pos >= available) {
+        return false;
+    }
+
+    quint8 crc = 0;
+    for (qint64 i = 0; i < pos; ++i) {
+        crc ^= p[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? quint8((crc << 1) ^ 0x07) : quint8(crc << 1);
+        }
+    }
+    if (crc != p[pos]) {
+        return false;
+    }
+
+    frame->number = number;
+    frame->variableBlockSize = p[1] & 0x01;
+    return true;
+}
+
+QThreadPool *indexerPool()
+{
+    // One low priority thread: indexing is disk bound and must never compete
+    // with the decoder or the UI.
+    static QThreadPool pool;
+    static const bool configured = [] {
+        pool.setMaxThreadCount(1);
+        pool.setThreadPriority(QThread::LowPriority);
+        return true;
+    }();
+    Q_UNUSED(configured);
+    return &pool;
+}
+} // namespace
+
+bool SeekIndex::isValid() const
+{
+    return m_sampleRate > 0 && !m_entries.isEmpty();
+}
+
+QString SeekIndex::path() const
+{
+    return m_path;
+}
+
+int SeekIndex::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+qint64 SeekIndex::headerLength() const
+{
+    return m_headerLength;
+}
+
+SeekIndex::Entry SeekIndex::entryBefore(qint64 positionUs) const
+{
+    if (!isValid() || positionUs <= 0) {
+        return Entry{};
+    }
+
+    const qint64 sample = positionUs * m_sampleRate / 1000000;
+    auto it = std::upper_bound(m_entries.cbegin(), m_entries.cend(), sample,
+                               [](qint64 value, const Entry &entry) { return value < entry.sample; });
+    if (it == m_entries.cbegin()) {
+        return Entry{};
+    }
+    return *(it - 1);
+}
+
+qint64 SeekIndex::sampleToUs(qint64 sample) const
+{
+    if (m_sampleRate <= 0) {
+        return 0;
+    }
+    return sample * 1000000 / m_sampleRate;
+}
+
+bool SeekIndex::isIndexable(const QString &path)
+{
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "mp3" || suffix == "ogg" || suffix == "oga" || suffix == "opus" || suffix == "flac"
+           || suffix == "wav";
+}
+
+SeekIndex SeekIndex::loadOrBuild(const QString &path)
+{
+    SeekIndex index;
+    const QFileInfo info(path);
+    if (!info.isFile() || !isIndexable(path)) {
+        return index;
+    }
+
+    const QString cacheFile = cacheFilePath(info);
+    if (index.load(cacheFile)) {
+        index.m_path = path;
+        return index;
+    }
+
+    if (!index.build(path)) {
+        return SeekIndex();
+    }
+    if (!index.save(cacheFile)) {
+        qDebug() << "SeekIndex: could not write cache for" << path;
+    }
+    return index;
+}
+
+QFuture<SeekIndex> SeekIndex::loadOrBuildAsync(const QString &path)
+{
+    return QtConcurrent::run(indexerPool(), &SeekIndex::loadOrBuild, path);
+}
+
+QString SeekIndex::cacheFilePath(const QFileInfo &info)
+{
+    const QString key = QString("%1|%2|%3")
+                            .arg(info.canonicalFilePath())
+                            .arg(info.size())
+                            .arg(info.lastModified().toMSecsSinceEpoch());
+    const QByteArray hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1);
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/seekindex/"
+           + QString::fromLatin1(hash.toHex()) + ".idx";
+}
+
+bool SeekIndex::load(const QString &cacheFile)
+{
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint32 sampleRate = 0;
+    quint32 count = 0;
+    in >> magic >> version;
+    if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+        return false;
+    }
+    in >> sampleRate >> m_headerLength >> m_totalSamples >> count;
+    if (in.status() != QDataStream::Ok || sampleRate <= 0 || count == 0) {
+        return false;
+    }
+
+    m_entries.resize(count);
+    for (Entry &entry : m_entries) {
+        in >> entry.sample >> entry.offset;
+    }
+    if (in.status() != QDataStream::Ok) {
+        m_entries.clear();
+        return false;
+    }
+
+    m_sampleRate = sampleRate;
+    return true;
+}
+
+bool SeekIndex::save(const QString &cacheFile) const
+{
+    QDir().mkpath(QFileInfo(cacheFile).absolutePath());
+
+    QSaveFile file(cacheFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out << CACHE_MAGIC << CACHE_VERSION << qint32(m_sampleRate) << m_headerLength
+        << m_totalSamples << quint32(m_entries.size());
+    for (const Entry &entry : m_entries) {
+        out << entry.sample << entry.offset;
+    }
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+bool SeekIndex::build(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < 4) {
+        return false;
+    }
+
+    const uchar *data = file.map(0, file.size());
+    if (!data) {
+        return false;
+    }
+
+    m_path = path;
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    bool ok = false;
+    if (suffix == "mp3") {
+        ok = buildMp3(data, file.size());
+    } else if (suffix == "flac") {
+        ok = buildFlac(data, file.size());
+    } else if (suffix == "wav") {
+        ok = buildWav(data, file.size());
+    } else {
+        ok = buildOgg(data, file.size());
+    }
+    file.unmap(const_cast<uchar *>(data));
+
+    if (ok) {
+        qDebug() << "SeekIndex:" << path << m_entries.size() << "entries";
+    }
+    return ok && isValid();
+}
+
+bool SeekIndex::buildMp3(const uchar *data, qint64 size)
+{
+    qint64 pos = 0;
+
+    // Skip ID3v2 tag (syncsafe size, optional footer)
+    if (size >= 10 && std::memcmp(data, "ID3", 3) == 0) {
+        const qint64 tagSize = (qint64(data[6] & 0x7F) << 21) | (qint64(data[7] & 0x7F) << 14)
+                               | (qint64(data[8] & 0x7F) << 7) | qint64(data[9] & 0x7F);
+        pos = 10 + tagSize + ((data[5] & 0x10) ? 10 : 0);
+    }
+
+    // Find the first frame followed by another valid frame at the same rate
+    Mp3Frame frame;
+    Mp3Frame next;
+    while (pos + 4 <= size) {
+        if (parseMp3Header(data + pos, &frame) && pos + frame.length + 4 <= size
+            && parseMp3Header(data + pos + frame.length, &next)
+            && next.sampleRate == frame.sampleRate) {
+            break;
+        }
+        ++pos;
+    }
+    if (pos + 4 > size) {
+        return false;
+    }
+
+    m_sampleRate = frame.sampleRate;
+    m_headerLength = 0;
+    if (isMp3InfoFrame(data + pos, frame.length)) {
+        pos += frame.length;
+    }
+
+    qint64 sample = 0;
+    while (pos + 4 <= size) {
+        if (!parseMp3Header(data + pos, &frame) || frame.sampleRate != m_sampleRate) {
+            ++pos;
+            continue;
+        }
+        // Mid-stream resync: confirm with the following header before trusting it
+        if (pos + frame.length + 4 <= size
+            && (!parseMp3Header(data + pos + frame.length, &next)
+                || next.sampleRate != m_sampleRate)) {
+            ++pos;
+            continue;
+        }
+
+        appendEntry(sample, pos);
+        sample += frame.samples;
+        pos += frame.length;
+    }
+
+    m_totalSamples = sample;
+    return true;
+}
+
+bool SeekIndex::buildOgg(const uchar *data, qint64 size)
+{
+    qint64 pos = 0;
+    quint32 serial = 0;
+    qint64 preSkip = 0;
+    qint64 previousGranule = 0;
+    bool firstPage = true;
+    m_headerLength = -1;
+
+    while (pos + 27 <= size) {
+        if (std::memcmp(data + pos, "OggS", 4) != 0) {
+            ++pos;
+            continue;
+        }
+
+        const uchar headerType = data[pos + 5];
+        const qint64 granule = readLE64(data + pos + 6);
+        const quint32 pageSerial = readLE32(data + pos + 14);
+        const int segments = data[pos + 26];
+        if (pos + 27 + segments > size) {
+            break;
+        }
+        qint64 bodyLength = 0;
+        for (int i = 0; i < segments; ++i) {
+            bodyLength += data[pos + 27 + i];
+        }
+        const qint64 pageLength = 27 + segments + bodyLength;
+        if (pos + pageLength > size) {
+            break;
+        }
+        const uchar *body = data + pos + 27 + segments;
+
+        if (firstPage) {
+            firstPage = false;
+            serial = pageSerial;
+            if (bodyLength >= 16 && body[0] == 0x01 && std::memcmp(body + 1, "vorbis", 6) == 0) {
+                m_sampleRate = int(readLE32(body + 12));
+            } else if (bodyLength >= 12 && std::memcmp(body, "OpusHead", 8) == 0) {
+                // Opus granule positions always count 48 kHz samples
+                m_sampleRate = 48000;
+                preSkip = body[10] | (body[11] << 8);
+            } else {
+                return false;
+            }
+        } else if (pageSerial != serial) {
+            if (headerType & 0x02) {
+                // Chained stream: index only the first link
+                break;
+            }
+            pos += pageLength;
+            continue;
+        }
+
+        // Granule -1 means no packet finishes on this page
+        if (granule > 0) {
+            if (m_headerLength < 0) {
+                m_headerLength = pos;
+            }
+            // Pages starting with a continued packet are poor entry points:
+            // the decoder drops the partial packet.
+            if (!(headerType & 0x01)) {
+                appendEntry(qMax<qint64>(0, previousGranule - preSkip), pos);
+            }
+            previousGranule = granule;
+        }
+
+        pos += pageLength;
+    }
+
+    if (m_headerLength < 0) {
+        return false;
+    }
+    m_totalSamples = qMax<qint64>(0, previousGranule - preSkip);
+    return true;
+}
+
+bool SeekIndex::buildFlac(const uchar *data, qint64 size)
+{
+    if (size < 42 || std::memcmp(data, "fLaC", 4) != 0) {
+        return false;
+    }
+
+    // Metadata blocks: STREAMINFO first, SEEKTABLE optional, the first audio
+    // frame right after the last block.
+    qint64 pos = 4;
+    qint64 seekTable = -1;
+    qint64 seekTableLength = 0;
+    int fixedBlockSize = 0;
+    bool last = false;
+    while (!last && pos + 4 <= size) {
+        last = data[pos] & 0x80;
+        const int type = data[pos] & 0x7F;
+        const qint64 length = readBE24(data + pos + 1);
+        const uchar *body = data + pos + 4;
+        if (pos + 4 + length > size) {
+            return false;
+        }
+        if (type == 0 && length >= 18) {
+            const int minBlockSize = (body[0] << 8) | body[1];
+            const int maxBlockSize = (body[2] << 8) | body[3];
+            m_sampleRate = int((readBE24(body + 10) >> 4) & 0xFFFFF);
+            m_totalSamples = qint64((quint64(body[13] & 0x0F) << 32) | (quint64(body[14]) << 24)
+                                    | (quint64(body[15]) << 16) | (quint64(body[16]) << 8) | body[17]);
+            fixedBlockSize = minBlockSize == maxBlockSize ? minBlockSize : 0;
+        } else if (type == 3) {
+            seekTable = pos + 4;
+            seekTableLength = length;
+        }
+        pos += 4 + length;
+    }
+    if (!last || m_sampleRate <= 0) {
+        return false;
+    }
+    m_headerLength = pos;
+
+    // Offsets in the seek table are relative to the first frame. Placeholder
+    // points (sample number all ones) fill the end of the table.
+    if (seekTable >= 0) {
+        for (qint64 point = seekTable; point + 18 <= seekTable + seekTableLength; point += 18) {
+            const quint64 sample = readBE64(data + point);
+            if (sample == ~quint64(0)) {
+                break;
+            }
+            const qint64 offset = m_headerLength + qint64(readBE64(data + point + 8));
+            if (offset < size) {
+                appendEntry(qint64(sample), offset);
+            }
+        }
+        if (m_entries.size() > 1) {
+            return true;
+        }
+        m_entries.clear();
+    }
+
+    // No usable seek table: walk the frame headers. Frames carry no length,
+    // so every byte after a frame start is a candidate for the next one.
+    FlacFrame frame;
+    while (pos + 6 <= size) {
+        if (!parseFlacFrameHeader(data + pos, size - pos, &frame)) {
+            ++pos;
+            continue;
+        }
+        qint64 sample = frame.number;
+        if (!frame.variableBlockSize) {
+            if (fixedBlockSize <= 0) {
+                return false;
+            }
+            sample *= fixedBlockSize;
+        }
+        // A checksum collision inside audio data could still claim any
+        // position; one past the end of the stream is certainly one.
+        if (m_totalSamples <= 0 || sample < m_totalSamples) {
+            appendEntry(sample, pos);
+        }
+        pos += 6;
+    }
+    return true;
+}
+
+bool SeekIndex::buildWav(const uchar *data, qint64 size)
+{
+    if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    // Only uncompressed samples can be addressed by byte offset
+    qint64 pos = 12;
+    int blockAlign = 0;
+    while (pos + 8 <= size) {
+        const qint64 length = readLE32(data + pos + 4);
+        const uchar *body = data + pos + 8;
+        if (std::memcmp(data + pos, "fmt ", 4) == 0 && length >= 16 && pos + 8 + 16 <= size) {
+            const quint16 format = readLE16(body);
+            if (format != 1 && format != 3 && format != 0xFFFE) {
+                return false;
+            }
+            m_sampleRate = int(readLE32(body + 4));
+            blockAlign = readLE16(body + 12);
+        } else if (std::memcmp(data + pos, "data", 4) == 0) {
+            if (m_sampleRate <= 0 || blockAlign <= 0) {
+                return false;
+            }
+            m_headerLength = pos + 8;
+            const qint64 end = qMin(size, m_headerLength + length);
+            m_totalSamples = (end - m_headerLength) / blockAlign;
+
+            const qint64 spacing = m_sampleRate / ENTRIES_PER_SECOND;
+            for (qint64 sample = 0; sample < m_totalSamples; sample += spacing) {
+                appendEntry(sample, m_headerLength + sample * blockAlign);
+            }
+            return true;
+        }
+        // Chunks are padded to an even length
+        pos += 8 + length + (length & 1);
+    }
+    return false;
+}
+
+void SeekIndex::appendEntry(qint64 sample, qint64 offset)
+{
+    const qint64 spacing = m_sampleRate / ENTRIES_PER_SECOND;
+    if (!m_entries.isEmpty() && sample - m_entries.last().sample < spacing) {
+        return;
+    }
+    m_entries.append(Entry{sample, offset});
+}
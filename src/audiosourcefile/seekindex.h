@@ -0,0 +1,60 @@
+#ifndef SEEKINDEX_H
+#define SEEKINDEX_H
+
+#include <QFuture>
+#include <QList>
+#include <QString>
+
+class QFileInfo;
+
+// Sparse table of (sample position, byte offset) entry points for formats
+// whose decoders can start in the middle of the stream (MP3 frames, Ogg
+// pages, FLAC frames, PCM WAV blocks). Built once per file on a low priority thread and persisted in the
+// cache directory, keyed by path, size and mtime.
+class SeekIndex
+{
+public:
+    struct Entry {
+        qint64 sample = 0;
+        qint64 offset = 0;
+    };
+
+    SeekIndex() = default;
+
+    bool isValid() const;
+    QString path() const;
+    int sampleRate() const;
+
+    // Bytes at the start of the file that must be replayed before any entry
+    // point (Ogg codec headers, FLAC metadata, WAV chunks up to the samples).
+    // Zero for MP3.
+    qint64 headerLength() const;
+
+    // Last entry point at or before positionUs, found by binary search.
+    Entry entryBefore(qint64 positionUs) const;
+    qint64 sampleToUs(qint64 sample) const;
+
+    static bool isIndexable(const QString &path);
+    static SeekIndex loadOrBuild(const QString &path);
+    static QFuture<SeekIndex> loadOrBuildAsync(const QString &path);
+
+private:
+    QString m_path;
+    int m_sampleRate = 0;
+    qint64 m_headerLength = 0;
+    qint64 m_totalSamples = 0;
+    QList<Entry> m_entries;
+
+    static QString cacheFilePath(const QFileInfo &info);
+    bool load(const QString &cacheFile);
+    bool save(const QString &cacheFile) const;
+
+    bool build(const QString &path);
+    bool buildMp3(const uchar *data, qint64 size);
+    bool buildOgg(const uchar *data, qint64 size);
+    bool buildFlac(const uchar *data, qint64 size);
+    bool buildWav(const uchar *data, qint64 size);
+    void appendEntry(qint64 sample, qint64 offset);
+};
+
+#endif // SEEKINDEX_H
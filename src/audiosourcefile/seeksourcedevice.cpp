@@ -0,0 +1,202 @@
+#include "seeksourcedevice.h"
+
+#include <QDir>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+// Pages behind the read position are released in steps of this size...
+constexpr qint64 RELEASE_STEP_BYTES = 4 * 1024 * 1024;
+// ...keeping this much behind it for demuxers that step back a little
+constexpr qint64 KEEP_BEHIND_BYTES = 1024 * 1024;
+} // namespace
+
+MappedFile::MappedFile(const QString &path)
+    : m_file(path)
+{
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() <= 0) {
+        return;
+    }
+    m_size = m_file.size();
+    if (!isSafeToMap(path)) {
+        ::posix_fadvise(m_file.handle(), 0, m_size, POSIX_FADV_SEQUENTIAL);
+        return;
+    }
+
+    // Fails for files larger than the address space (32-bit userland); reads
+    // then go through the file descriptor too.
+    m_data = m_file.map(0, m_size);
+    if (m_data != nullptr) {
+        ::madvise(const_cast<uchar *>(m_data), m_size, MADV_SEQUENTIAL);
+    }
+}
+
+bool MappedFile::isValid() const
+{
+    return m_file.isOpen() && m_size > 0;
+}
+
+bool MappedFile::isMapped() const
+{
+    return m_data != nullptr;
+}
+
+QString MappedFile::path() const
+{
+    return m_file.fileName();
+}
+
+qint64 MappedFile::size() const
+{
+    return m_size;
+}
+
+qint64 MappedFile::read(qint64 offset, char *data, qint64 size) const
+{
+    size = qMin(size, m_size - offset);
+    if (size <= 0) {
+        return 0;
+    }
+    if (m_data != nullptr) {
+        std::memcpy(data, m_data + offset, size);
+        return size;
+    }
+
+    qint64 total = 0;
+    while (total < size) {
+        const ssize_t count = ::pread(m_file.handle(), data + total, size - total, offset + total);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return total > 0 ? total : (count < 0 ? -1 : 0);
+        }
+        total += count;
+    }
+    return total;
+}
+
+bool MappedFile::isSafeToMap(const QString &path)
+{
+    struct stat file;
+    if (::stat(QFile::encodeName(path).constData(), &file) != 0) {
+        return false;
+    }
+    // Fixed storage the system itself runs from; everything else may vanish
+    for (const QString &fixed : {QDir::rootPath(), QDir::homePath()}) {
+        struct stat mount;
+        if (::stat(QFile::encodeName(fixed).constData(), &mount) == 0 && mount.st_dev == file.st_dev) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MappedFile::release(qint64 from, qint64 to) const
+{
+    static const qint64 pageSize = ::sysconf(_SC_PAGESIZE);
+    from = (from + pageSize - 1) / pageSize * pageSize;
+    to = qMin(to, m_size) / pageSize * pageSize;
+    if (m_data != nullptr && to > from) {
+        ::madvise(const_cast<uchar *>(m_data) + from, to - from, MADV_DONTNEED);
+    }
+}
+
+SeekSourceDevice::SeekSourceDevice(const QSharedPointer<MappedFile> &file, qint64 headerLength,
+                                   qint64 offset, QObject *parent)
+    : QIODevice(parent)
+    , m_file(file)
+    , m_headerLength(qMax<qint64>(0, headerLength))
+    , m_offset(qMax(offset, m_headerLength))
+    , m_releasedTo(m_offset)
+{}
+
+bool SeekSourceDevice::open(OpenMode mode)
+{
+    if ((mode & QIODevice::WriteOnly) || m_file.isNull() || !m_file->isValid()) {
+        return false;
+    }
+    return QIODevice::open(mode);
+}
+
+bool SeekSourceDevice::isSequential() const
+{
+    return false;
+}
+
+qint64 SeekSourceDevice::size() const
+{
+    return m_headerLength + qMax<qint64>(0, m_file->size() - m_offset);
+}
+
+// Seeking only moves pos(); reads copy straight out of the mapping, or
+// pread() the file when it isn't mapped.
+qint64 SeekSourceDevice::readData(char *data, qint64 maxSize)
+{
+    qint64 total = 0;
+    qint64 filePos = 0;
+    qint64 readStart = -1;
+    while (total < maxSize) {
+        const qint64 devicePos = pos() + total;
+        qint64 available = 0;
+        if (devicePos < m_headerLength) {
+            filePos = devicePos;
+            available = m_headerLength - devicePos;
+        } else {
+            filePos = m_offset + (devicePos - m_headerLength);
+            available = m_file->size() - filePos;
+        }
+        if (available <= 0) {
+            break;
+        }
+
+        if (readStart < 0) {
+            readStart = filePos;
+        }
+        const qint64 chunk = m_file->read(filePos, data + total, qMin(available, maxSize - total));
+        if (chunk < 0) {
+            return total > 0 ? total : -1;
+        }
+        if (chunk == 0) {
+            break;
+        }
+        total += chunk;
+        filePos += chunk;
+    }
+
+    if (total > 0) {
+        releaseBehind(readStart, filePos);
+    }
+    return total;
+}
+
+qint64 SeekSourceDevice::writeData(const char *, qint64)
+{
+    return -1;
+}
+
+// Only a read that continues the previous one moves the read head. Demuxers
+// jump to the end of the file for trailing tags and come back; releasing up
+// to such a jump would drop the pages read ahead of the real head.
+void SeekSourceDevice::releaseBehind(qint64 readStart, qint64 readEnd)
+{
+    const bool sequential = readStart == m_readEnd;
+    m_readEnd = readEnd;
+    if (!m_file->isMapped()) {
+        return;
+    }
+
+    const qint64 releaseTo = readEnd - KEEP_BEHIND_BYTES;
+    if (releaseTo < m_releasedTo) {
+        // Seeked backwards, start over from the new position
+        m_releasedTo = qMax(m_offset, releaseTo);
+    } else if (sequential && releaseTo - m_releasedTo >= RELEASE_STEP_BYTES) {
+        m_file->release(m_releasedTo, releaseTo);
+        m_releasedTo = releaseTo;
+    }
+}
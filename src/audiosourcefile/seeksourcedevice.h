@@ -0,0 +1,73 @@
+#ifndef SEEKSOURCEDEVICE_H
+#define SEEKSOURCEDEVICE_H
+
+#include <QFile>
+#include <QIODevice>
+#include <QSharedPointer>
+
+// Shared read-only mapping of a local media file, advised for sequential
+// access. Created once per source and reused by every decoder restart, so a
+// seek only creates a new view into it.
+//
+// Only files on the root or home filesystem are mapped. A mapped read from a
+// device that goes away (USB stick, SD card, network share) raises SIGBUS
+// and takes the whole player down, so elsewhere reads go through pread() and
+// simply fail instead.
+class MappedFile
+{
+public:
+    explicit MappedFile(const QString &path);
+
+    bool isValid() const;
+    bool isMapped() const;
+    QString path() const;
+    qint64 size() const;
+
+    // Copies up to size bytes at offset into data, returns the bytes copied
+    // or -1 on a read error
+    qint64 read(qint64 offset, char *data, qint64 size) const;
+
+    // Lets the kernel reclaim the pages in [from, to) without waiting for
+    // memory pressure to find them; they are faulted back in (from the page
+    // cache if still there) if read again.
+    void release(qint64 from, qint64 to) const;
+
+private:
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+
+    static bool isSafeToMap(const QString &path);
+};
+
+// Read-only view of a mapped media file that starts at a seek index entry:
+// the first headerLength bytes of the file (codec headers) followed by the
+// file contents from offset onwards. Lets the decoder start in the middle of
+// a stream without parsing everything before the seek target. With both set
+// to zero it is simply the whole file.
+class SeekSourceDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    SeekSourceDevice(const QSharedPointer<MappedFile> &file, qint64 headerLength, qint64 offset,
+                     QObject *parent = nullptr);
+
+    bool open(OpenMode mode) override;
+    bool isSequential() const override;
+    qint64 size() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    QSharedPointer<MappedFile> m_file;
+    qint64 m_headerLength = 0;
+    qint64 m_offset = 0;
+    qint64 m_releasedTo = 0;
+    qint64 m_readEnd = -1;
+
+    void releaseBehind(qint64 readStart, qint64 readEnd);
+};
+
+#endif // SEEKSOURCEDEVICE_H
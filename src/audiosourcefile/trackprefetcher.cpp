@@ -0,0 +1,181 @@
+#include "trackprefetcher.h"
+#include "util.h"
+
+#include <QFile>
+#include <QThread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+// Total page cache the prefetcher may ask for across all upcoming tracks
+constexpr qint64 PREFETCH_BUDGET_BYTES = 64 * 1024 * 1024;
+
+// Bytes at the start of a file that decide whether playback starts cleanly
+constexpr qint64 HEAD_BYTES = 256 * 1024;
+
+// Residency checks run before queued prefetching, which they would skew
+constexpr int PROBE_PRIORITY = 1;
+
+int openForRead(const QString &path)
+{
+    return ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+}
+
+qint64 fileSize(int fd)
+{
+    const off_t size = ::lseek(fd, 0, SEEK_END);
+    return size < 0 ? 0 : qint64(size);
+}
+
+// Offset of the first page in [0, length) that is not in the page cache,
+// or -1 if all of them are. If residency can't be checked, assume nothing is.
+qint64 firstMissingByte(int fd, qint64 length)
+{
+    if (length <= 0) {
+        return -1;
+    }
+    void *map = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+
+    const long pageSize = ::sysconf(_SC_PAGESIZE);
+    QByteArray pages((length + pageSize - 1) / pageSize, 0);
+    qint64 missing = 0;
+    if (::mincore(map, length, reinterpret_cast<unsigned char *>(pages.data())) == 0) {
+        missing = -1;
+        for (qint64 i = 0; i < pages.size(); ++i) {
+            if (!(pages[i] & 1)) {
+                missing = i * pageSize;
+                break;
+            }
+        }
+    }
+    ::munmap(map, length);
+    return missing;
+}
+} // namespace
+
+TrackPrefetcher::TrackPrefetcher()
+{
+    m_pool.setMaxThreadCount(1);
+    m_pool.setThreadPriority(QThread::LowPriority);
+}
+
+TrackPrefetcher::~TrackPrefetcher()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void TrackPrefetcher::prefetch(const QList<QUrl> &upcoming)
+{
+    QList<QString> paths;
+    for (const QUrl &url : upcoming) {
+        if (url.isLocalFile() && !paths.contains(url.toLocalFile())) {
+            paths.append(url.toLocalFile());
+        }
+    }
+    if (paths.isEmpty()) {
+        return;
+    }
+
+    // Only the latest window matters: anything still queued is skipped. Not
+    // with m_pool.clear(), which would also drop a queued residency check.
+    const int generation = ++m_generation;
+    m_pool.start([this, paths, generation]() { advise(paths, generation); });
+}
+
+void TrackPrefetcher::wake(const QUrl &url)
+{
+    if (url.isLocalFile()) {
+        const QString path = url.toLocalFile();
+        m_pool.start([path]() { touch(path); });
+    }
+}
+
+void TrackPrefetcher::recordOpen(const QUrl &url)
+{
+    if (!url.isLocalFile()) {
+        return;
+    }
+
+    // Not on the calling thread: opening a file on a drive that is asleep
+    // blocks until it spins up
+    const QString path = url.toLocalFile();
+    m_pool.start([this, path]() {
+        if (isHeadResident(path)) {
+            ++m_hits;
+        } else {
+            ++m_coldOpens;
+        }
+        qCDebug(lcPrefetch) << "TrackPrefetcher: hits" << m_hits.load() << "cold opens" << m_coldOpens.load();
+    }, PROBE_PRIORITY);
+}
+
+int TrackPrefetcher::hits() const
+{
+    return m_hits;
+}
+
+int TrackPrefetcher::coldOpens() const
+{
+    return m_coldOpens;
+}
+
+void TrackPrefetcher::advise(const QList<QString> &paths, int generation)
+{
+    qint64 budget = PREFETCH_BUDGET_BYTES;
+    for (const QString &path : paths) {
+        if (budget <= 0 || generation != m_generation) {
+            break;
+        }
+
+        const int fd = openForRead(path);
+        if (fd < 0) {
+            continue;
+        }
+        const qint64 length = qMin(fileSize(fd), budget);
+        // Asynchronous: queues the reads and returns once they are issued
+        if (length > 0 && ::posix_fadvise(fd, 0, length, POSIX_FADV_WILLNEED) == 0) {
+            budget -= length;
+        }
+        ::close(fd);
+    }
+}
+
+void TrackPrefetcher::touch(const QString &path)
+{
+    const int fd = openForRead(path);
+    if (fd < 0) {
+        return;
+    }
+
+    // Re-advise the head in case it was evicted, then read from the first
+    // page that isn't cached so the request really reaches the device.
+    const qint64 size = fileSize(fd);
+    ::posix_fadvise(fd, 0, qMin(size, HEAD_BYTES), POSIX_FADV_WILLNEED);
+    const qint64 offset = firstMissingByte(fd, size);
+    if (offset >= 0) {
+        char byte;
+        if (::pread(fd, &byte, 1, offset) < 0) {
+            qCDebug(lcPrefetch) << "TrackPrefetcher: could not wake device for" << path;
+        }
+    }
+    ::close(fd);
+}
+
+bool TrackPrefetcher::isHeadResident(const QString &path)
+{
+    const int fd = openForRead(path);
+    if (fd < 0) {
+        return false;
+    }
+
+    const qint64 length = qMin(fileSize(fd), HEAD_BYTES);
+    const bool resident = length > 0 && firstMissingByte(fd, length) < 0;
+    ::close(fd);
+    return resident;
+}
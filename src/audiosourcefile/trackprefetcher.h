@@ -0,0 +1,51 @@
+#ifndef TRACKPREFETCHER_H
+#define TRACKPREFETCHER_H
+
+#include <QList>
+#include <QThreadPool>
+#include <QUrl>
+
+#include <atomic>
+
+// Warms the page cache for the next entries of the playqueue so tracks on
+// slow or sleeping media (USB sticks, SD cards) start without stalling.
+//
+// All file access runs on one low priority thread: opening a file on a
+// drive that is spinning up can block for seconds.
+class TrackPrefetcher
+{
+public:
+    static constexpr int TRACKS_AHEAD = 3;
+
+    TrackPrefetcher();
+    ~TrackPrefetcher();
+
+    // Advises the kernel to read the upcoming tracks, nearest first, until
+    // the memory budget is used up.
+    void prefetch(const QList<QUrl> &upcoming);
+
+    // Issues a read the cache can't satisfy so the device holding url is
+    // awake by the time the current track ends.
+    void wake(const QUrl &url);
+
+    // Call right before url is opened for playback: counts a prefetch hit if
+    // its first pages are already resident, a cold open otherwise. The check
+    // runs on the prefetch thread, ahead of any other queued work.
+    void recordOpen(const QUrl &url);
+
+    int hits() const;
+    int coldOpens() const;
+
+private:
+    QThreadPool m_pool;
+    std::atomic<int> m_hits{0};
+    std::atomic<int> m_coldOpens{0};
+    // Bumped by every prefetch(), so an older window still queued is skipped
+    std::atomic<int> m_generation{0};
+
+    void advise(const QList<QString> &paths, int generation);
+    static void touch(const QString &path);
+    static bool isHeadResident(const QString &path);
+};
+
+#endif // TRACKPREFETCHER_H
@@ -0,0 +1,355 @@
+#include "libraryindex.h"
+
+#include <QHash>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr quint32 INDEX_MAGIC = 0x4c4c4958; // "LLIX", also rejects a file of the other byte order
+constexpr quint32 INDEX_VERSION = 1;
+
+// Builds the string block. Offset 0 is the empty string, and each string
+// is stored once however many records use it.
+class StringBlock
+{
+public:
+    StringBlock() { m_data.append(4, '\0'); }
+
+    quint32 add(const QString &string)
+    {
+        if (string.isEmpty()) {
+            return 0;
+        }
+        auto it = m_offsets.constFind(string);
+        if (it != m_offsets.constEnd()) {
+            return it.value();
+        }
+        const quint32 offset = m_data.size();
+        const QByteArray utf8 = string.toUtf8();
+        const quint32 length = utf8.size();
+        m_data.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        m_data.append(utf8);
+        // Keeps the next length aligned
+        m_data.append((4 - m_data.size() % 4) % 4, '\0');
+        m_offsets.insert(string, offset);
+        return offset;
+    }
+
+    const QByteArray &data() const { return m_data; }
+
+private:
+    QByteArray m_data;
+    QHash<QString, quint32> m_offsets;
+};
+} // namespace
+
+struct LibraryIndex::Header {
+    quint32 magic;
+    quint32 version;
+    quint32 trackCount;
+    quint32 albumCount;
+    quint32 artistCount;
+    quint32 stringsSize;
+};
+
+struct LibraryIndex::TrackRecord {
+    quint32 path; // string offsets
+    quint32 title;
+    quint32 genre;
+    quint32 album; // index into the albums, which hold the artist
+    quint32 duration;
+    quint32 bitRate;
+    quint32 sampleRate; // 0 if the file could not be read
+    quint16 trackNumber;
+    quint16 year;
+    qint64 size;
+    qint64 modified;
+};
+
+struct LibraryIndex::AlbumRecord {
+    quint32 title;
+    quint32 artist;
+    quint32 firstTrack; // ranges are written but not read back
+    quint32 trackCount;
+};
+
+struct LibraryIndex::ArtistRecord {
+    quint32 name;
+    quint32 firstAlbum;
+    quint32 albumCount;
+};
+
+LibraryIndex::~LibraryIndex()
+{
+    close();
+}
+
+bool LibraryIndex::open(const QString &path)
+{
+    // Every section then starts aligned for its records, as the mapping is
+    static_assert(sizeof(Header) == 24 && sizeof(TrackRecord) == 48 && sizeof(AlbumRecord) == 16
+                  && sizeof(ArtistRecord) == 12);
+
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() < qint64(sizeof(Header))) {
+        close();
+        return false;
+    }
+    m_data = m_file.map(0, m_file.size());
+    if (m_data == nullptr) {
+        close();
+        return false;
+    }
+
+    const Header *header = reinterpret_cast<const Header *>(m_data);
+    const qint64 expectedSize = qint64(sizeof(Header)) + qint64(header->trackCount) * sizeof(TrackRecord)
+                                + qint64(header->albumCount) * sizeof(AlbumRecord)
+                                + qint64(header->artistCount) * sizeof(ArtistRecord) + header->stringsSize;
+    if (header->magic != INDEX_MAGIC || header->version != INDEX_VERSION || expectedSize != m_file.size()) {
+        close();
+        return false;
+    }
+
+    m_header = header;
+    m_tracks = reinterpret_cast<const TrackRecord *>(m_data + sizeof(Header));
+    m_albums = reinterpret_cast<const AlbumRecord *>(m_tracks + header->trackCount);
+    m_artists = reinterpret_cast<const ArtistRecord *>(m_albums + header->albumCount);
+    m_strings = reinterpret_cast<const uchar *>(m_artists + header->artistCount);
+    return true;
+}
+
+void LibraryIndex::close()
+{
+    if (m_data != nullptr) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+        m_data = nullptr;
+    }
+    m_file.close();
+    m_header = nullptr;
+    m_tracks = nullptr;
+    m_albums = nullptr;
+    m_artists = nullptr;
+    m_strings = nullptr;
+}
+
+bool LibraryIndex::isOpen() const
+{
+    return m_header != nullptr;
+}
+
+bool LibraryIndex::write(const QString &path, QList<Track> tracks)
+{
+    const auto sameArtist = [](const Track &a, const Track &b) {
+        return a.artist.compare(b.artist, Qt::CaseInsensitive) == 0;
+    };
+    const auto sameAlbum = [&sameArtist](const Track &a, const Track &b) {
+        return sameArtist(a, b) && a.album.compare(b.album, Qt::CaseInsensitive) == 0;
+    };
+    std::sort(tracks.begin(), tracks.end(), [](const Track &a, const Track &b) {
+        if (const int order = a.artist.compare(b.artist, Qt::CaseInsensitive)) {
+            return order < 0;
+        }
+        if (const int order = a.album.compare(b.album, Qt::CaseInsensitive)) {
+            return order < 0;
+        }
+        if (a.trackNumber != b.trackNumber) {
+            return a.trackNumber < b.trackNumber;
+        }
+        return a.path < b.path;
+    });
+
+    StringBlock strings;
+    QList<TrackRecord> trackRecords;
+    QList<AlbumRecord> albumRecords;
+    QList<ArtistRecord> artistRecords;
+    trackRecords.reserve(tracks.size());
+
+    for (qsizetype i = 0; i < tracks.size(); ++i) {
+        const Track &track = tracks.at(i);
+        // The first spelling of an artist or album names the whole group
+        if (i == 0 || !sameArtist(track, tracks.at(i - 1))) {
+            artistRecords.append(ArtistRecord{strings.add(track.artist), quint32(albumRecords.size()), 0});
+        }
+        if (i == 0 || !sameAlbum(track, tracks.at(i - 1))) {
+            albumRecords.append(AlbumRecord{strings.add(track.album), quint32(artistRecords.size() - 1),
+                                 quint32(trackRecords.size()), 0});
+            ++artistRecords.last().albumCount;
+        }
+        ++albumRecords.last().trackCount;
+
+        TrackRecord record;
+        record.path = strings.add(track.path);
+        record.title = strings.add(track.title);
+        record.genre = strings.add(track.genre);
+        record.album = albumRecords.size() - 1;
+        record.duration = quint32(qBound(0LL, track.duration, 0xffffffffLL));
+        record.bitRate = quint32(qMax(0, track.bitRate));
+        record.sampleRate = quint32(qMax(0, track.sampleRate));
+        record.trackNumber = quint16(qBound(0, track.trackNumber, 0xffff));
+        record.year = quint16(qBound(0, track.year, 0xffff));
+        record.size = track.size;
+        record.modified = track.modified;
+        trackRecords.append(record);
+    }
+
+    Header header;
+    header.magic = INDEX_MAGIC;
+    header.version = INDEX_VERSION;
+    header.trackCount = trackRecords.size();
+    header.albumCount = albumRecords.size();
+    header.artistCount = artistRecords.size();
+    header.stringsSize = strings.data().size();
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(trackRecords.constData()), trackRecords.size() * sizeof(TrackRecord));
+    file.write(reinterpret_cast<const char *>(albumRecords.constData()), albumRecords.size() * sizeof(AlbumRecord));
+    file.write(reinterpret_cast<const char *>(artistRecords.constData()),
+               artistRecords.size() * sizeof(ArtistRecord));
+    file.write(strings.data());
+    return file.commit();
+}
+
+int LibraryIndex::trackCount() const
+{
+    return m_header ? int(m_header->trackCount) : 0;
+}
+
+QString LibraryIndex::path(TrackId id) const
+{
+    return string(m_tracks[id].path);
+}
+
+QUrl LibraryIndex::url(TrackId id) const
+{
+    return QUrl::fromLocalFile(path(id));
+}
+
+QString LibraryIndex::title(TrackId id) const
+{
+    return string(m_tracks[id].title);
+}
+
+QString LibraryIndex::artist(TrackId id) const
+{
+    const int album = trackAlbum(id);
+    const int artist = album < 0 ? -1 : albumArtist(album);
+    return artist < 0 ? QString() : artistName(artist);
+}
+
+QString LibraryIndex::album(TrackId id) const
+{
+    const int album = trackAlbum(id);
+    return album < 0 ? QString() : albumTitle(album);
+}
+
+QString LibraryIndex::genre(TrackId id) const
+{
+    return string(m_tracks[id].genre);
+}
+
+qint64 LibraryIndex::duration(TrackId id) const
+{
+    return m_tracks[id].duration;
+}
+
+int LibraryIndex::trackNumber(TrackId id) const
+{
+    return m_tracks[id].trackNumber;
+}
+
+int LibraryIndex::year(TrackId id) const
+{
+    return m_tracks[id].year;
+}
+
+qint64 LibraryIndex::fileSize(TrackId id) const
+{
+    return m_tracks[id].size;
+}
+
+qint64 LibraryIndex::modified(TrackId id) const
+{
+    return m_tracks[id].modified;
+}
+
+LibraryIndex::Track LibraryIndex::track(TrackId id) const
+{
+    const TrackRecord &record = m_tracks[id];
+    Track track;
+    track.path = string(record.path);
+    track.title = string(record.title);
+    track.artist = artist(id);
+    track.album = album(id);
+    track.genre = string(record.genre);
+    track.duration = record.duration;
+    track.bitRate = record.bitRate;
+    track.sampleRate = record.sampleRate;
+    track.trackNumber = record.trackNumber;
+    track.year = record.year;
+    track.size = record.size;
+    track.modified = record.modified;
+    return track;
+}
+
+QMediaMetaData LibraryIndex::metaData(TrackId id) const
+{
+    const TrackRecord &record = m_tracks[id];
+    QMediaMetaData metaData;
+    metaData.insert(QMediaMetaData::Url, url(id));
+    metaData.insert(QMediaMetaData::Title, string(record.title));
+    metaData.insert(QMediaMetaData::AlbumTitle, album(id));
+    metaData.insert(QMediaMetaData::AlbumArtist, artist(id));
+    metaData.insert(QMediaMetaData::Genre, string(record.genre));
+    metaData.insert(QMediaMetaData::TrackNumber, qint64(record.trackNumber));
+    metaData.insert(QMediaMetaData::Date, qint64(record.year));
+    // Like a tags-only parse when the audio properties couldn't be read
+    if (record.sampleRate > 0) {
+        metaData.insert(QMediaMetaData::AudioBitRate, qint64(record.bitRate));
+        metaData.insert(QMediaMetaData::Comment, QString::number(record.sampleRate)); // Using Comment as sample rate
+        metaData.insert(QMediaMetaData::Duration, qint64(record.duration));
+    }
+    return metaData;
+}
+
+QString LibraryIndex::albumTitle(int album) const
+{
+    return string(m_albums[album].title);
+}
+
+int LibraryIndex::albumArtist(int album) const
+{
+    return m_albums[album].artist < m_header->artistCount ? int(m_albums[album].artist) : -1;
+}
+
+QString LibraryIndex::artistName(int artist) const
+{
+    return string(m_artists[artist].name);
+}
+
+QString LibraryIndex::string(quint32 offset) const
+{
+    const quint32 size = m_header->stringsSize;
+    if (offset == 0 || size < 4 || offset > size - 4) {
+        return QString();
+    }
+    quint32 length;
+    std::memcpy(&length, m_strings + offset, sizeof(length));
+    if (length > size - 4 - offset) {
+        return QString();
+    }
+    return QString::fromUtf8(reinterpret_cast<const char *>(m_strings + offset + 4), length);
+}
+
+int LibraryIndex::trackAlbum(TrackId id) const
+{
+    const quint32 album = m_tracks[id].album;
+    return album < m_header->albumCount ? int(album) : -1;
+}
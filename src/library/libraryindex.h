@@ -0,0 +1,88 @@
+#ifndef LIBRARYINDEX_H
+#define LIBRARYINDEX_H
+
+#include <QFile>
+#include <QList>
+#include <QMediaMetaData>
+#include <QString>
+#include <QUrl>
+
+// Read-only view of the on-disk music library index.
+//
+// The file is a fixed-size header followed by arrays of fixed-size track,
+// album and artist records and a block of UTF-8 strings they point into.
+// open() maps it and checks the header, and every accessor reads straight
+// from the mapping: nothing is parsed or copied on load, so a library of
+// any size is browsable as soon as it is opened.
+//
+// Tracks are sorted by artist, album, track number and path. Each album and
+// artist name is stored once, in a record its tracks point to. Ids are only
+// valid for the file they were read from: write() renumbers everything.
+class LibraryIndex
+{
+public:
+    using TrackId = quint32;
+
+    // A track as gathered by a scan, to be written to an index
+    struct Track {
+        QString path;
+        QString title;
+        QString artist;
+        QString album;
+        QString genre;
+        qint64 duration = 0; // ms
+        int bitRate = 0;
+        int sampleRate = 0;
+        int trackNumber = 0;
+        int year = 0;
+        qint64 size = 0;
+        qint64 modified = 0; // ns since the epoch
+    };
+
+    ~LibraryIndex();
+
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const;
+
+    // Replaces the index at path, atomically
+    static bool write(const QString &path, QList<Track> tracks);
+
+    int trackCount() const;
+    QString path(TrackId id) const;
+    QUrl url(TrackId id) const;
+    QString title(TrackId id) const;
+    QString artist(TrackId id) const;
+    QString album(TrackId id) const;
+    QString genre(TrackId id) const;
+    qint64 duration(TrackId id) const;
+    int trackNumber(TrackId id) const;
+    int year(TrackId id) const;
+    qint64 fileSize(TrackId id) const;
+    qint64 modified(TrackId id) const;
+    Track track(TrackId id) const;
+    // Metadata in the form parseMetaData() gives, audio properties included
+    QMediaMetaData metaData(TrackId id) const;
+
+private:
+    struct Header;
+    struct TrackRecord;
+    struct AlbumRecord;
+    struct ArtistRecord;
+
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    const Header *m_header = nullptr;
+    const TrackRecord *m_tracks = nullptr;
+    const AlbumRecord *m_albums = nullptr;
+    const ArtistRecord *m_artists = nullptr;
+    const uchar *m_strings = nullptr;
+
+    QString string(quint32 offset) const;
+    int trackAlbum(TrackId id) const;
+    QString albumTitle(int album) const;
+    int albumArtist(int album) const;
+    QString artistName(int artist) const;
+};
+
+#endif // LIBRARYINDEX_H
@@ -0,0 +1,529 @@
+#include "musiclibrary.h"
+#include "util.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QThread>
+#include <QtConcurrent>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+
+namespace {
+// Files parsed between checks for quitting
+constexpr int PARSE_BATCH_SIZE = 256;
+
+// During a long sweep, such as the first one, the index is written and
+// mapped this often so the library fills in as it goes
+constexpr int PUBLISH_INTERVAL_MS = 15000;
+
+// Copying an album in sends a burst of events; sweep once after it
+constexpr int UPDATE_DELAY_MS = 2000;
+
+// The sweep at start waits for the player to be up, and then parses on
+// no more than this many threads, so it stays out of the way of playback
+// and of the GUI
+constexpr int START_SWEEP_DELAY_MS = 10000;
+constexpr int MAX_PARSE_THREADS = 2;
+
+constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                                | IN_ONLYDIR;
+
+struct FoundFile {
+    QString path;
+    qint64 size = 0;
+    qint64 modified = 0;
+};
+
+QString childPath(const QString &directory, const QString &name)
+{
+    // Only the root ends in '/'
+    return directory.endsWith(u'/') ? directory + name : directory + u'/' + name;
+}
+
+bool isWithin(const QString &path, const QString &directory, bool recursive)
+{
+    const qsizetype prefixLength = directory.endsWith(u'/') ? directory.size() : directory.size() + 1;
+    if (path.size() <= prefixLength || !path.startsWith(directory) || path.at(prefixLength - 1) != u'/') {
+        return false;
+    }
+    return recursive || path.indexOf(u'/', prefixLength) < 0;
+}
+
+// Playlists are opened explicitly, they aren't part of the library
+bool isLibraryFile(const QString &name)
+{
+    return isAudioFile(name) && !name.endsWith(QLatin1String(".m3u"), Qt::CaseInsensitive);
+}
+
+qint64 modifiedTime(const struct stat &info)
+{
+    return qint64(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+// Appends the library files in path, with their size and mtime, to files
+// and its subdirectories to subdirectories. Returns false if path can't be
+// read.
+bool listDirectory(const QString &path, QList<FoundFile> *files, QStringList *subdirectories)
+{
+    DIR *dir = ::opendir(QFile::encodeName(path).constData());
+    if (dir == nullptr) {
+        return false;
+    }
+    const int dirFd = ::dirfd(dir);
+
+    while (const dirent *entry = ::readdir(dir)) {
+        const char *name = entry->d_name;
+        // Also skips "." and ".."
+        if (name[0] == '.') {
+            continue;
+        }
+
+        bool isDirectory = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat info;
+            isDirectory = ::fstatat(dirFd, name, &info, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(info.st_mode);
+        }
+        // Links to directories are not followed, so a loop can't make a sweep endless
+        if (isDirectory) {
+            subdirectories->append(childPath(path, QFile::decodeName(name)));
+            continue;
+        }
+
+        const QString fileName = QFile::decodeName(name);
+        struct stat info;
+        if (isLibraryFile(fileName) && ::fstatat(dirFd, name, &info, 0) == 0 && S_ISREG(info.st_mode)) {
+            files->append({childPath(path, fileName), qint64(info.st_size), modifiedTime(info)});
+        }
+    }
+    ::closedir(dir);
+    return true;
+}
+
+LibraryIndex::Track readTrack(const FoundFile &file)
+{
+    const QMediaMetaData metaData = parseMetaData(QUrl::fromLocalFile(file.path));
+
+    LibraryIndex::Track track;
+    track.path = file.path;
+    track.size = file.size;
+    track.modified = file.modified;
+    track.title = metaData.value(QMediaMetaData::Title).toString();
+    if (track.title.isEmpty()) {
+        track.title = file.path.mid(file.path.lastIndexOf(u'/') + 1);
+    }
+    track.artist = metaData.value(QMediaMetaData::AlbumArtist).toString();
+    track.album = metaData.value(QMediaMetaData::AlbumTitle).toString();
+    track.genre = metaData.value(QMediaMetaData::Genre).toString();
+    track.trackNumber = metaData.value(QMediaMetaData::TrackNumber).toInt();
+    track.year = metaData.value(QMediaMetaData::Date).toInt();
+    if (metaData.value(QMediaMetaData::Duration).isValid()) {
+        track.duration = metaData.value(QMediaMetaData::Duration).toLongLong();
+        track.bitRate = metaData.value(QMediaMetaData::AudioBitRate).toInt();
+        // parseMetaData() stores the sample rate in Comment
+        track.sampleRate = metaData.value(QMediaMetaData::Comment).toString().toInt();
+    }
+    return track;
+}
+
+bool writeIndex(const QString &path, const LibraryIndex &previous, const QList<bool> &keep,
+                const QList<LibraryIndex::Track> &parsed)
+{
+    QList<LibraryIndex::Track> tracks;
+    tracks.reserve(keep.size() + parsed.size());
+    for (LibraryIndex::TrackId id = 0; id < LibraryIndex::TrackId(keep.size()); ++id) {
+        if (keep.at(id)) {
+            tracks.append(previous.track(id));
+        }
+    }
+    tracks.append(parsed);
+    if (!LibraryIndex::write(path, tracks)) {
+        qDebug() << "MusicLibrary: could not write" << path;
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+MusicLibrary::MusicLibrary(QObject *parent)
+    : QObject{parent}
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QDir().mkpath(dir);
+    m_indexPath = dir + "/library.index";
+
+    QSettings settings;
+    settings.beginGroup("library");
+    const QStringList defaultFolders{QStandardPaths::standardLocations(QStandardPaths::MusicLocation).first()};
+    for (const QString &folder : settings.value("folders", defaultFolders).toStringList()) {
+        m_folders.append(QDir::cleanPath(folder));
+    }
+    settings.endGroup();
+
+    // One sweep at a time, all below playback
+    m_pool.setMaxThreadCount(1);
+    m_pool.setThreadPriority(QThread::LowPriority);
+    m_parsePool.setMaxThreadCount(qMin(QThread::idealThreadCount(), MAX_PARSE_THREADS));
+    m_parsePool.setThreadPriority(QThread::LowPriority);
+
+    m_updateTimer = new QTimer(this);
+    m_updateTimer->setSingleShot(true);
+    m_updateTimer->setInterval(UPDATE_DELAY_MS);
+    connect(m_updateTimer, &QTimer::timeout, this, &MusicLibrary::updateChanged);
+
+    m_inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0) {
+        qDebug() << "MusicLibrary: inotify unavailable, changes are picked up at the next start";
+        return;
+    }
+    m_notifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &MusicLibrary::readEvents);
+}
+
+MusicLibrary::~MusicLibrary()
+{
+    // A sweep in progress writes what it has parsed so far
+    m_stopping = true;
+    m_pool.waitForDone();
+    m_parsePool.waitForDone();
+    if (m_inotifyFd >= 0) {
+        m_notifier->setEnabled(false);
+        ::close(m_inotifyFd);
+    }
+}
+
+void MusicLibrary::start()
+{
+    if (m_index.open(m_indexPath)) {
+        buildSearch();
+        emit changed();
+    }
+    QTimer::singleShot(START_SWEEP_DELAY_MS, this, &MusicLibrary::sweepFolders);
+}
+
+void MusicLibrary::sweepFolders()
+{
+    QList<Scope> scopes;
+    for (const QString &folder : std::as_const(m_folders)) {
+        scopes.append({folder, true});
+    }
+    sweep(scopes, true);
+}
+
+QStringList MusicLibrary::folders() const
+{
+    return m_folders;
+}
+
+void MusicLibrary::setFolders(const QStringList &folders)
+{
+    m_folders.clear();
+    for (const QString &folder : folders) {
+        m_folders.append(QDir::cleanPath(folder));
+    }
+
+    QSettings settings;
+    settings.beginGroup("library");
+    settings.setValue("folders", m_folders);
+    settings.endGroup();
+
+    for (auto it = m_watches.constBegin(); it != m_watches.constEnd(); ++it) {
+        ::inotify_rm_watch(m_inotifyFd, it.key());
+    }
+    m_watches.clear();
+    m_changedDirectories.clear();
+    m_changedTrees.clear();
+
+    // Also drops the tracks of folders no longer in the list
+    sweepFolders();
+}
+
+const LibraryIndex &MusicLibrary::index() const
+{
+    return m_index;
+}
+
+bool MusicLibrary::isUpdating() const
+{
+    return m_running > 0;
+}
+
+QList<LibraryIndex::TrackId> MusicLibrary::search(const QString &query) const
+{
+    const QBitArray matches = m_search.search(query);
+    QList<LibraryIndex::TrackId> tracks;
+    for (qsizetype id = 0; id < matches.size(); ++id) {
+        if (matches.testBit(id)) {
+            tracks.append(LibraryIndex::TrackId(id));
+        }
+    }
+    return tracks;
+}
+
+void MusicLibrary::sweep(const QList<Scope> &scopes, bool full)
+{
+    if (m_running++ == 0) {
+        emit updatingChanged(true);
+    }
+    m_pool.start([this, scopes, full]() { runSweep(scopes, full); });
+}
+
+// Runs on m_pool. A full sweep covers every track in the index; otherwise
+// only the tracks within scopes are checked, and the rest kept as they are.
+void MusicLibrary::runSweep(const QList<Scope> &scopes, bool full)
+{
+    // Its own mapping: the GUI thread may replace m_index meanwhile
+    LibraryIndex previous;
+    previous.open(m_indexPath);
+    const int trackCount = previous.trackCount();
+
+    // Folders that can't be read now, such as an unplugged drive, keep their tracks
+    QList<Scope> reachable;
+    QStringList unreachable;
+    for (const Scope &scope : scopes) {
+        if (!full || QFileInfo(scope.path).isDir()) {
+            reachable.append(scope);
+        } else {
+            unreachable.append(scope.path);
+        }
+    }
+
+    // keep starts out true for the tracks outside the sweep, and becomes
+    // true for the ones inside it that are found unchanged
+    QHash<QString, LibraryIndex::TrackId> known;
+    known.reserve(trackCount);
+    QList<bool> keep(trackCount, false);
+    for (LibraryIndex::TrackId id = 0; id < LibraryIndex::TrackId(trackCount); ++id) {
+        const QString path = previous.path(id);
+        known.insert(path, id);
+        if (full) {
+            keep[id] = std::any_of(unreachable.cbegin(), unreachable.cend(),
+                                   [&path](const QString &folder) { return isWithin(path, folder, true); });
+        } else {
+            keep[id] = std::none_of(reachable.cbegin(), reachable.cend(), [&path](const Scope &scope) {
+                return isWithin(path, scope.path, scope.recursive);
+            });
+        }
+    }
+
+    QList<FoundFile> toParse;
+    QStringList directories;
+    QSet<QString> listed; // scopes may overlap
+    bool removed = false;
+    for (const Scope &scope : std::as_const(reachable)) {
+        QStringList stack{scope.path};
+        while (!stack.isEmpty()) {
+            if (m_stopping) {
+                // A partial walk would take unvisited tracks for deleted ones
+                return;
+            }
+            const QString path = stack.takeLast();
+            if (listed.contains(path)) {
+                continue;
+            }
+            listed.insert(path);
+
+            QList<FoundFile> files;
+            QStringList subdirectories;
+            if (!listDirectory(path, &files, &subdirectories)) {
+                continue;
+            }
+            directories.append(path);
+            if (scope.recursive) {
+                stack.append(subdirectories);
+            }
+
+            for (const FoundFile &file : std::as_const(files)) {
+                const auto it = known.constFind(file.path);
+                if (it == known.constEnd()) {
+                    toParse.append(file);
+                } else if (previous.fileSize(it.value()) == file.size
+                           && previous.modified(it.value()) == file.modified) {
+                    keep[it.value()] = true;
+                } else {
+                    toParse.append(file);
+                }
+            }
+        }
+    }
+    for (bool kept : std::as_const(keep)) {
+        removed = removed || !kept;
+    }
+
+    bool written = false;
+    if (!toParse.isEmpty() || removed || (!previous.isOpen() && full)) {
+        QList<LibraryIndex::Track> parsed;
+        parsed.reserve(toParse.size());
+        QElapsedTimer sinceWrite;
+        sinceWrite.start();
+        for (qsizetype start = 0; start < toParse.size() && !m_stopping; start += PARSE_BATCH_SIZE) {
+            parsed.append(QtConcurrent::blockingMapped<QList<LibraryIndex::Track>>(
+                    &m_parsePool, toParse.mid(start, PARSE_BATCH_SIZE), readTrack));
+            if (sinceWrite.elapsed() >= PUBLISH_INTERVAL_MS && start + PARSE_BATCH_SIZE < toParse.size()) {
+                if (writeIndex(m_indexPath, previous, keep, parsed)) {
+                    QMetaObject::invokeMethod(this, [this]() { publish(); }, Qt::QueuedConnection);
+                }
+                sinceWrite.restart();
+            }
+        }
+        // Also when quitting: what was parsed isn't parsed again next time
+        written = writeIndex(m_indexPath, previous, keep, parsed);
+    }
+
+    QMetaObject::invokeMethod(this, [this, directories, written]() {
+        finishSweep(directories, written);
+    }, Qt::QueuedConnection);
+}
+
+void MusicLibrary::finishSweep(const QStringList &directories, bool written)
+{
+    watch(directories);
+    if (written) {
+        publish();
+    }
+    if (--m_running == 0) {
+        emit updatingChanged(false);
+    }
+}
+
+void MusicLibrary::publish()
+{
+    if (!m_index.open(m_indexPath)) {
+        qDebug() << "MusicLibrary: could not open" << m_indexPath;
+    }
+    buildSearch();
+    emit changed();
+}
+
+// The search index is built from a mapping of its own on m_parsePool, since
+// m_index may be replaced meanwhile. A build is dropped if another index was
+// mapped since it started, or if it read a different number of tracks: then
+// the file was replaced under it, and the publish() for that is queued.
+void MusicLibrary::buildSearch()
+{
+    const int generation = ++m_searchGeneration;
+    m_search.clear();
+    if (!m_index.isOpen()) {
+        return;
+    }
+
+    m_parsePool.start([this, generation]() {
+        LibraryIndex index;
+        if (!index.open(m_indexPath)) {
+            return;
+        }
+        TrackSearchIndex search;
+        const int trackCount = index.trackCount();
+        for (LibraryIndex::TrackId id = 0; id < LibraryIndex::TrackId(trackCount); ++id) {
+            if (m_stopping) {
+                return;
+            }
+            search.update(id, index.title(id), index.artist(id), index.album(id));
+        }
+        QMetaObject::invokeMethod(this, [this, generation, trackCount, search = std::move(search)]() mutable {
+            if (generation != m_searchGeneration || trackCount != m_index.trackCount()) {
+                return;
+            }
+            m_search = std::move(search);
+            emit searchReady();
+        }, Qt::QueuedConnection);
+    });
+}
+
+void MusicLibrary::watch(const QStringList &directories)
+{
+    if (m_inotifyFd < 0) {
+        return;
+    }
+    for (const QString &directory : directories) {
+        const int wd = ::inotify_add_watch(m_inotifyFd, QFile::encodeName(directory).constData(), WATCH_MASK);
+        if (wd >= 0) {
+            m_watches.insert(wd, directory);
+        } else if (errno == ENOSPC) {
+            qDebug() << "MusicLibrary: out of inotify watches, other changes are picked up at the next start";
+            return;
+        }
+    }
+}
+
+void MusicLibrary::readEvents()
+{
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = ::read(m_inotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (const char *p = buffer; p < buffer + length;) {
+            const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost: only a full sweep can tell what changed
+                m_fullSweepPending = true;
+                continue;
+            }
+            const auto it = m_watches.constFind(event->wd);
+            if (it == m_watches.constEnd()) {
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                // The directory is gone; its parent's event handles the tracks
+                m_watches.erase(it);
+                continue;
+            }
+
+            const QString name = event->len > 0 ? QFile::decodeName(event->name) : QString();
+            if (name.isEmpty() || name.startsWith(u'.')) {
+                continue;
+            }
+            if (event->mask & IN_ISDIR) {
+                const QString path = childPath(it.value(), name);
+                // Swept whole: added, its tracks are indexed, removed, they're dropped
+                m_changedTrees.insert(path);
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    // Now rather than after the sweep, so files copied in meanwhile aren't missed
+                    watch({path});
+                }
+            } else if (!(event->mask & IN_CREATE) && isLibraryFile(name)) {
+                // Created files are picked up by IN_CLOSE_WRITE once complete
+                m_changedDirectories.insert(it.value());
+            }
+        }
+    }
+
+    const bool pending = m_fullSweepPending || !m_changedDirectories.isEmpty() || !m_changedTrees.isEmpty();
+    if (pending && !m_updateTimer->isActive()) {
+        m_updateTimer->start();
+    }
+}
+
+void MusicLibrary::updateChanged()
+{
+    QList<Scope> scopes;
+    if (m_fullSweepPending) {
+        for (const QString &folder : std::as_const(m_folders)) {
+            scopes.append({folder, true});
+        }
+    } else {
+        for (const QString &tree : std::as_const(m_changedTrees)) {
+            scopes.append({tree, true});
+        }
+        for (const QString &directory : std::as_const(m_changedDirectories)) {
+            scopes.append({directory, false});
+        }
+    }
+    const bool full = m_fullSweepPending;
+    m_fullSweepPending = false;
+    m_changedTrees.clear();
+    m_changedDirectories.clear();
+    sweep(scopes, full);
+}
@@ -0,0 +1,94 @@
+#ifndef MUSICLIBRARY_H
+#define MUSICLIBRARY_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QSocketNotifier>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <atomic>
+
+#include "libraryindex.h"
+#include "tracksearchindex.h"
+
+// The tracks under the configured music folders, with their metadata.
+//
+// start() maps the index left by the last run, so the library can be
+// browsed at once, and shortly after sweeps the folders in the background:
+// files whose size and mtime match the index are kept as they are, and only
+// new or changed files are parsed, on a couple of low priority threads.
+// Afterwards inotify reports what changes in the folders, and only the
+// directories involved are swept again. Each sweep that finds a change
+// writes a new index and maps it.
+//
+// Every index mapped also gets a search index over its titles, artists and
+// albums, built in the background.
+class MusicLibrary : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MusicLibrary(QObject *parent = nullptr);
+    ~MusicLibrary() override;
+
+    void start();
+
+    QStringList folders() const;
+    void setFolders(const QStringList &folders);
+
+    // Valid until the next changed()
+    const LibraryIndex &index() const;
+    bool isUpdating() const;
+
+    // Tracks whose title, artist or album match every word of query,
+    // ascending. Empty until searchReady() for the current index.
+    QList<LibraryIndex::TrackId> search(const QString &query) const;
+
+signals:
+    // The index was replaced: track, album and artist ids from before are stale
+    void changed();
+    void updatingChanged(bool updating);
+    void searchReady();
+
+private:
+    // A directory to sweep, with or without its subdirectories
+    struct Scope {
+        QString path;
+        bool recursive = true;
+    };
+
+    QStringList m_folders;
+    QString m_indexPath;
+    LibraryIndex m_index;
+    TrackSearchIndex m_search;
+    int m_searchGeneration = 0;
+
+    // Sweeps, one at a time; parsing fans out to m_parsePool, which also
+    // builds the search indexes
+    QThreadPool m_pool;
+    QThreadPool m_parsePool;
+    std::atomic<bool> m_stopping{false};
+    int m_running = 0;
+
+    int m_inotifyFd = -1;
+    QSocketNotifier *m_notifier = nullptr;
+    QHash<int, QString> m_watches; // watch descriptor -> directory
+    QSet<QString> m_changedDirectories;
+    QSet<QString> m_changedTrees;
+    bool m_fullSweepPending = false;
+    QTimer *m_updateTimer = nullptr;
+
+    void sweepFolders();
+    void sweep(const QList<Scope> &scopes, bool full);
+    void runSweep(const QList<Scope> &scopes, bool full);
+    void finishSweep(const QStringList &directories, bool written);
+    void publish();
+    void buildSearch();
+
+    void watch(const QStringList &directories);
+    void readEvents();
+    void updateChanged();
+};
+
+#endif // MUSICLIBRARY_H
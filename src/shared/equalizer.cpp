@@ -0,0 +1,269 @@
+#include "equalizer.h"
+
+#include <QSettings>
+#include <cmath>
+#include <cstring>
+
+namespace {
+// Bandwidth of each peaking section, roughly one octave
+constexpr float BAND_Q = 1.0f;
+
+// Frames converted to float and filtered per pass. Small enough to stay on
+// the stack and in L1, large enough to amortise the per-band setup.
+constexpr int BLOCK_FRAMES = 256;
+
+// Above this the soft limiter bends the signal towards full scale. It only
+// runs when the settings can boost, cuts pass peaks through unchanged.
+constexpr float LIMITER_THRESHOLD = 0.8f;
+
+
+// Two channels in one vector: NEON on ARM, SSE on x86
+typedef float Frame2 __attribute__((vector_size(8)));
+
+inline float softLimit(float x)
+{
+    const float magnitude = std::fabs(x);
+    if (magnitude <= LIMITER_THRESHOLD) {
+        return x;
+    }
+
+    // Rational tanh approximation on the part above the threshold
+    const float headroom = 1.0f - LIMITER_THRESHOLD;
+    const float over = (magnitude - LIMITER_THRESHOLD) / headroom;
+    const float shaped = over >= 3.0f ? 1.0f : over * (27.0f + over * over) / (27.0f + 9.0f * over * over);
+    return std::copysign(LIMITER_THRESHOLD + headroom * shaped, x);
+}
+
+// Sample conversion to and from [-1, 1] floats
+template<typename T>
+struct SampleTraits;
+
+template<>
+struct SampleTraits<qint16> {
+    static float toFloat(qint16 x) { return x * (1.0f / 32768.0f); }
+    static qint16 fromFloat(float x)
+    {
+        return static_cast<qint16>(std::lrintf(qBound(-32768.0f, x * 32767.0f, 32767.0f)));
+    }
+};
+
+template<>
+struct SampleTraits<qint32> {
+    static float toFloat(qint32 x) { return x * (1.0f / 2147483648.0f); }
+    static qint32 fromFloat(float x)
+    {
+        const double scaled = static_cast<double>(x) * 2147483647.0;
+        return static_cast<qint32>(std::llrint(qBound(-2147483648.0, scaled, 2147483647.0)));
+    }
+};
+
+template<>
+struct SampleTraits<float> {
+    static float toFloat(float x) { return x; }
+    static float fromFloat(float x) { return x; }
+};
+} // namespace
+
+const float Equalizer::BAND_FREQUENCIES[EQ_BAND_COUNT] = {
+    60.0f, 170.0f, 310.0f, 600.0f, 1000.0f, 3000.0f, 6000.0f, 12000.0f, 14000.0f, 16000.0f};
+
+void Equalizer::setParameters(const EqualizerParameters &parameters)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pending = parameters;
+    m_pending.preampDb = qBound(-EQ_MAX_GAIN_DB, m_pending.preampDb, EQ_MAX_GAIN_DB);
+    for (float &gain : m_pending.bandsDb) {
+        gain = qBound(-EQ_MAX_GAIN_DB, gain, EQ_MAX_GAIN_DB);
+    }
+    m_enabled.store(parameters.enabled, std::memory_order_relaxed);
+    m_dirty.store(true, std::memory_order_release);
+}
+
+EqualizerParameters Equalizer::parameters() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pending;
+}
+
+bool Equalizer::isEnabled() const
+{
+    return m_enabled.load(std::memory_order_relaxed);
+}
+
+void Equalizer::reset()
+{
+    m_resetPending.store(true, std::memory_order_release);
+}
+
+void Equalizer::process(qint16 *samples, qint64 frames, int channels, int sampleRate)
+{
+    if (samples != nullptr && frames > 0 && channels > 0 && prepare(sampleRate)) {
+        processFrames(samples, frames, channels);
+    }
+}
+
+void Equalizer::process(qint32 *samples, qint64 frames, int channels, int sampleRate)
+{
+    if (samples != nullptr && frames > 0 && channels > 0 && prepare(sampleRate)) {
+        processFrames(samples, frames, channels);
+    }
+}
+
+void Equalizer::process(float *samples, qint64 frames, int channels, int sampleRate)
+{
+    if (samples != nullptr && frames > 0 && channels > 0 && prepare(sampleRate)) {
+        processFrames(samples, frames, channels);
+    }
+}
+
+bool Equalizer::prepare(int sampleRate)
+{
+    if (sampleRate <= 0) {
+        return false;
+    }
+
+    // Never block the audio thread: if the GUI holds the lock, keep the old
+    // coefficients for one more buffer.
+    if ((m_dirty.load(std::memory_order_acquire) || sampleRate != m_sampleRate) && m_mutex.tryLock()) {
+        m_active = m_pending;
+        m_dirty.store(false, std::memory_order_relaxed);
+        m_mutex.unlock();
+        updateCoefficients(sampleRate);
+    }
+
+    if (m_resetPending.exchange(false, std::memory_order_acq_rel)) {
+        clearState();
+    }
+
+    return m_active.enabled && (m_activeBandCount > 0 || m_preampGain != 1.0f);
+}
+
+template<typename T>
+void Equalizer::processFrames(T *samples, qint64 frames, int channels)
+{
+    const int pairs = qMin((channels + 1) / 2, MAX_CHANNEL_PAIRS);
+    Frame2 block[BLOCK_FRAMES];
+
+    for (qint64 start = 0; start < frames; start += BLOCK_FRAMES) {
+        const int count = static_cast<int>(qMin<qint64>(BLOCK_FRAMES, frames - start));
+        T *blockSamples = samples + start * channels;
+
+        for (int pair = 0; pair < pairs; ++pair) {
+            const int left = pair * 2;
+            const bool hasRight = left + 1 < channels;
+
+            for (int i = 0; i < count; ++i) {
+                const T *frame = blockSamples + i * channels;
+                block[i][0] = SampleTraits<T>::toFloat(frame[left]) * m_preampGain;
+                block[i][1] = hasRight ? SampleTraits<T>::toFloat(frame[left + 1]) * m_preampGain : 0.0f;
+            }
+
+            // Transposed direct form II, band by band so the state stays in registers
+            for (int b = 0; b < m_activeBandCount; ++b) {
+                const int band = m_activeBands[b];
+                const Biquad &q = m_bands[band];
+                float *state = m_state[pair][band];
+                Frame2 z1 = {state[0], state[1]};
+                Frame2 z2 = {state[2], state[3]};
+
+                for (int i = 0; i < count; ++i) {
+                    const Frame2 x = block[i];
+                    const Frame2 y = x * q.b0 + z1;
+                    z1 = x * q.b1 - y * q.a1 + z2;
+                    z2 = x * q.b2 - y * q.a2;
+                    block[i] = y;
+                }
+
+                // Flush denormals left behind by silence
+                for (int c = 0; c < 2; ++c) {
+                    state[c] = std::fabs(z1[c]) < 1e-15f ? 0.0f : z1[c];
+                    state[c + 2] = std::fabs(z2[c]) < 1e-15f ? 0.0f : z2[c];
+                }
+            }
+
+            if (m_limiting) {
+                for (int i = 0; i < count; ++i) {
+                    block[i][0] = softLimit(block[i][0]);
+                    block[i][1] = softLimit(block[i][1]);
+                }
+            }
+            for (int i = 0; i < count; ++i) {
+                T *frame = blockSamples + i * channels;
+                frame[left] = SampleTraits<T>::fromFloat(block[i][0]);
+                if (hasRight) {
+                    frame[left + 1] = SampleTraits<T>::fromFloat(block[i][1]);
+                }
+            }
+        }
+    }
+}
+
+void Equalizer::updateCoefficients(int sampleRate)
+{
+    if (sampleRate != m_sampleRate) {
+        clearState();
+    }
+    m_sampleRate = sampleRate;
+    m_preampGain = std::pow(10.0f, m_active.preampDb / 20.0f);
+
+    // Worst case gain: every boosted band overlapping at one frequency
+    float boostDb = m_active.preampDb;
+    m_activeBandCount = 0;
+    for (int band = 0; band < EQ_BAND_COUNT; ++band) {
+        const float gainDb = m_active.bandsDb[band];
+        const float frequency = BAND_FREQUENCIES[band];
+        // Flat bands and bands too close to Nyquist are skipped entirely
+        if (std::fabs(gainDb) < 0.01f || frequency >= 0.45f * sampleRate) {
+            continue;
+        }
+
+        // RBJ audio EQ cookbook peaking filter
+        const double a = std::pow(10.0, gainDb / 40.0);
+        const double w0 = 2.0 * M_PI * frequency / sampleRate;
+        const double alpha = std::sin(w0) / (2.0 * BAND_Q);
+        const double cosW0 = std::cos(w0);
+        const double a0 = 1.0 + alpha / a;
+
+        Biquad &q = m_bands[band];
+        q.b0 = static_cast<float>((1.0 + alpha * a) / a0);
+        q.b1 = static_cast<float>((-2.0 * cosW0) / a0);
+        q.b2 = static_cast<float>((1.0 - alpha * a) / a0);
+        q.a1 = static_cast<float>((-2.0 * cosW0) / a0);
+        q.a2 = static_cast<float>((1.0 - alpha / a) / a0);
+
+        m_activeBands[m_activeBandCount++] = band;
+        boostDb += qMax(0.0f, gainDb);
+    }
+    m_limiting = boostDb > 0.0f;
+}
+
+void Equalizer::clearState()
+{
+    std::memset(m_state, 0, sizeof(m_state));
+}
+
+EqualizerParameters Equalizer::loadParameters()
+{
+    QSettings settings;
+    EqualizerParameters parameters;
+    settings.beginGroup("equalizer");
+    parameters.enabled = settings.value("enabled", false).toBool();
+    parameters.preampDb = settings.value("preamp", 0.0f).toFloat();
+    for (int band = 0; band < EQ_BAND_COUNT; ++band) {
+        parameters.bandsDb[band] = settings.value(QString("band%1").arg(band), 0.0f).toFloat();
+    }
+    settings.endGroup();
+    return parameters;
+}
+
+void Equalizer::saveParameters(const EqualizerParameters &parameters)
+{
+    QSettings settings;
+    settings.beginGroup("equalizer");
+    settings.setValue("enabled", parameters.enabled);
+    settings.setValue("preamp", parameters.preampDb);
+    for (int band = 0; band < EQ_BAND_COUNT; ++band) {
+        settings.setValue(QString("band%1").arg(band), parameters.bandsDb[band]);
+    }
+    settings.endGroup();
+}
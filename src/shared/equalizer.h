@@ -0,0 +1,81 @@
+#ifndef EQUALIZER_H
+#define EQUALIZER_H
+
+#include <QMutex>
+#include <QtGlobal>
+#include <atomic>
+
+#define EQ_BAND_COUNT 10
+#define EQ_MAX_GAIN_DB 12.0f
+
+struct EqualizerParameters {
+    bool enabled = false;
+    float preampDb = 0.0f;
+    float bandsDb[EQ_BAND_COUNT] = {};
+};
+
+// 10-band graphic equalizer using the classic Winamp band layout.
+//
+// Each band is a peaking biquad; the bank runs in float on channel pairs
+// packed in one SIMD vector, followed by a soft limiter when the settings
+// boost so boosted material doesn't hard clip. Parameters can be changed from any thread; coefficients
+// are recomputed by the audio thread only when they (or the sample rate)
+// change.
+class Equalizer
+{
+public:
+    static const float BAND_FREQUENCIES[EQ_BAND_COUNT];
+
+    Equalizer() = default;
+
+    void setParameters(const EqualizerParameters &parameters);
+    EqualizerParameters parameters() const;
+    bool isEnabled() const;
+
+    // Processes interleaved frames in place
+    void process(qint16 *samples, qint64 frames, int channels, int sampleRate);
+    void process(qint32 *samples, qint64 frames, int channels, int sampleRate);
+    void process(float *samples, qint64 frames, int channels, int sampleRate);
+
+    // Clears filter history, call on discontinuities (seek, new track)
+    void reset();
+
+    // Persisted settings shared by every source
+    static EqualizerParameters loadParameters();
+    static void saveParameters(const EqualizerParameters &parameters);
+
+private:
+    static constexpr int MAX_CHANNEL_PAIRS = 4;
+
+    struct Biquad {
+        float b0 = 1.0f;
+        float b1 = 0.0f;
+        float b2 = 0.0f;
+        float a1 = 0.0f;
+        float a2 = 0.0f;
+    };
+
+    mutable QMutex m_mutex;
+    EqualizerParameters m_pending;
+    std::atomic_bool m_dirty{true};
+    std::atomic_bool m_enabled{false};
+    std::atomic_bool m_resetPending{false};
+
+    // Audio thread state
+    EqualizerParameters m_active;
+    int m_sampleRate = 0;
+    float m_preampGain = 1.0f;
+    bool m_limiting = false;
+    Biquad m_bands[EQ_BAND_COUNT];
+    int m_activeBands[EQ_BAND_COUNT] = {};
+    int m_activeBandCount = 0;
+    float m_state[MAX_CHANNEL_PAIRS][EQ_BAND_COUNT][4] = {};
+
+    bool prepare(int sampleRate);
+    template<typename T>
+    void processFrames(T *samples, qint64 frames, int channels);
+    void updateCoefficients(int sampleRate);
+    void clearState();
+};
+
+#endif // EQUALIZER_H
@@ -0,0 +1,388 @@
+#include "metadatacache.h"
+#include "util.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QCache>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtConcurrent>
+
+#include <atomic>
+
+namespace {
+constexpr quint32 STORE_MAGIC = 0x4c4d4443; // "LMDC"
+constexpr quint32 STORE_VERSION = 1;
+constexpr qint64 STORE_HEADER_SIZE = 8;
+
+// Rewrite the store without superseded records once they make up this
+// fraction of it
+constexpr double STORE_COMPACT_RATIO = 0.5;
+
+// Complete entries kept in memory, least recently used dropped first. The
+// playlist keeps its own copy of everything it shows, so this only has to
+// cover the tracks around the one playing; older ones come back from the
+// persistent store.
+constexpr int CACHE_ENTRIES = 512;
+
+QReadWriteLock cacheLock;
+QCache<QUrl, QMediaMetaData> cache(CACHE_ENTRIES);
+QHash<QUrl, QMediaMetaData> tagsOnlyCache; // waiting for parse()
+
+std::atomic<quint64> hitCount{0};
+std::atomic<quint64> missCount{0};
+
+// Persistent half of the cache. Each record is a length prefix followed by
+// a QDataStream of the canonical path, size, mtime and metadata entries.
+// Records for a path that changed are superseded by later ones.
+class MetaDataStore
+{
+public:
+    MetaDataStore();
+
+    bool lookup(const QFileInfo &info, QMediaMetaData *metaData);
+    void append(const QFileInfo &info, const QMediaMetaData &metaData);
+    int count();
+
+private:
+    struct Entry {
+        qint64 size = 0;
+        qint64 modified = 0;
+        qint64 offset = 0; // of the record payload in the file
+        quint32 length = 0;
+    };
+
+    QMutex m_mutex;
+    QString m_path;
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    qint64 m_mappedSize = 0;
+    QFile m_appendFile;
+    QHash<QString, Entry> m_index;
+
+    bool map();
+    qint64 buildIndex();
+    QByteArray read(const Entry &entry);
+    bool compact();
+    static QByteArray serialize(const QString &path, qint64 size, qint64 modified,
+                                const QMediaMetaData &metaData);
+};
+
+MetaDataStore &store()
+{
+    static MetaDataStore instance;
+    return instance;
+}
+
+MetaDataStore::MetaDataStore()
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QDir().mkpath(dir);
+    m_path = dir + "/metadata.cache";
+
+    if (map()) {
+        const qint64 liveBytes = buildIndex();
+        if (m_mappedSize > STORE_HEADER_SIZE
+            && liveBytes < (m_mappedSize - STORE_HEADER_SIZE) * STORE_COMPACT_RATIO && compact()) {
+            map();
+            buildIndex();
+        }
+    }
+
+    m_appendFile.setFileName(m_path);
+    if (!m_appendFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qDebug() << "MetaDataCache: could not open" << m_path;
+        return;
+    }
+    if (m_appendFile.size() == 0) {
+        QDataStream out(&m_appendFile);
+        out << STORE_MAGIC << STORE_VERSION;
+        m_appendFile.flush();
+    }
+}
+
+bool MetaDataStore::map()
+{
+    if (m_data != nullptr) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+        m_data = nullptr;
+    }
+    m_file.close();
+    m_mappedSize = 0;
+
+    m_file.setFileName(m_path);
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() <= STORE_HEADER_SIZE) {
+        return false;
+    }
+
+    m_data = m_file.map(0, m_file.size());
+    if (m_data == nullptr) {
+        return false;
+    }
+    m_mappedSize = m_file.size();
+
+    QDataStream in(QByteArray::fromRawData(reinterpret_cast<const char *>(m_data), STORE_HEADER_SIZE));
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (magic != STORE_MAGIC || version != STORE_VERSION) {
+        // Unknown layout: start over
+        m_file.unmap(const_cast<uchar *>(m_data));
+        m_data = nullptr;
+        m_mappedSize = 0;
+        m_file.close();
+        QFile::remove(m_path);
+        return false;
+    }
+    return true;
+}
+
+// Indexes every record in the mapping, later records for a path replacing
+// earlier ones. Returns the bytes taken by the live records.
+qint64 MetaDataStore::buildIndex()
+{
+    m_index.clear();
+    qint64 position = STORE_HEADER_SIZE;
+    while (position + 4 <= m_mappedSize) {
+        const uchar *p = m_data + position;
+        const quint32 length = (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | p[3];
+        // A record cut short by a crash ends the usable part of the file
+        if (length == 0 || position + 4 + length > m_mappedSize) {
+            break;
+        }
+
+        QDataStream in(QByteArray::fromRawData(reinterpret_cast<const char *>(p + 4), length));
+        QString path;
+        Entry entry;
+        in >> path >> entry.size >> entry.modified;
+        if (in.status() == QDataStream::Ok) {
+            entry.offset = position + 4;
+            entry.length = length;
+            m_index.insert(path, entry);
+        }
+        position += 4 + length;
+    }
+
+    qint64 liveBytes = 0;
+    for (const Entry &entry : std::as_const(m_index)) {
+        liveBytes += 4 + entry.length;
+    }
+    return liveBytes;
+}
+
+bool MetaDataStore::compact()
+{
+    QSaveFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out << STORE_MAGIC << STORE_VERSION;
+    for (const Entry &entry : std::as_const(m_index)) {
+        out.writeRawData(reinterpret_cast<const char *>(m_data + entry.offset - 4), 4 + entry.length);
+    }
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+bool MetaDataStore::lookup(const QFileInfo &info, QMediaMetaData *metaData)
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_index.constFind(info.canonicalFilePath());
+    if (it == m_index.constEnd() || it->size != info.size()
+        || it->modified != info.lastModified().toMSecsSinceEpoch()) {
+        return false;
+    }
+
+    QDataStream in(read(*it));
+    QString path;
+    qint64 size = 0;
+    qint64 modified = 0;
+    quint16 count = 0;
+    in >> path >> size >> modified >> count;
+
+    QMediaMetaData parsed;
+    for (quint16 i = 0; i < count; ++i) {
+        qint32 key = 0;
+        QVariant value;
+        in >> key >> value;
+        parsed.insert(QMediaMetaData::Key(key), value);
+    }
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    *metaData = parsed;
+    return true;
+}
+
+// Records from the last run are read from the mapping, ones appended since
+// from the file
+QByteArray MetaDataStore::read(const Entry &entry)
+{
+    if (m_data != nullptr && entry.offset + entry.length <= m_mappedSize) {
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(m_data + entry.offset), entry.length);
+    }
+    if (!m_file.isOpen()) {
+        m_file.setFileName(m_path);
+        if (!m_file.open(QIODevice::ReadOnly)) {
+            return QByteArray();
+        }
+    }
+    if (!m_file.seek(entry.offset)) {
+        return QByteArray();
+    }
+    return m_file.read(entry.length);
+}
+
+void MetaDataStore::append(const QFileInfo &info, const QMediaMetaData &metaData)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_appendFile.isOpen()) {
+        return;
+    }
+
+    const QString path = info.canonicalFilePath();
+    Entry entry;
+    entry.size = info.size();
+    entry.modified = info.lastModified().toMSecsSinceEpoch();
+    const QByteArray record = serialize(path, entry.size, entry.modified, metaData);
+
+    entry.offset = m_appendFile.size() + 4;
+    entry.length = record.size();
+    QDataStream out(&m_appendFile);
+    out << quint32(record.size());
+    out.writeRawData(record.constData(), record.size());
+    // Once it drops out of the in-memory cache, lookup() reads it back
+    if (!m_appendFile.flush() || out.status() != QDataStream::Ok) {
+        return;
+    }
+    m_index.insert(path, entry);
+}
+
+int MetaDataStore::count()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.size();
+}
+
+QByteArray MetaDataStore::serialize(const QString &path, qint64 size, qint64 modified,
+                                    const QMediaMetaData &metaData)
+{
+    QByteArray record;
+    QDataStream out(&record, QIODevice::WriteOnly);
+    const QList<QMediaMetaData::Key> keys = metaData.keys();
+    out << path << size << modified << quint16(keys.size());
+    for (QMediaMetaData::Key key : keys) {
+        out << qint32(key) << metaData.value(key);
+    }
+    return record;
+}
+} // namespace
+
+bool MetaDataCache::lookup(const QUrl &url, QMediaMetaData *metaData)
+{
+    // A hit moves the entry to the front of the LRU list, so even lookups write
+    QWriteLocker locker(&cacheLock);
+    const QMediaMetaData *cached = cache.object(url);
+    if (cached == nullptr) {
+        return false;
+    }
+    *metaData = *cached;
+    return true;
+}
+
+void MetaDataCache::insert(const QUrl &url, const QMediaMetaData &metaData)
+{
+    QWriteLocker locker(&cacheLock);
+    cache.insert(url, new QMediaMetaData(metaData));
+    tagsOnlyCache.remove(url);
+}
+
+void MetaDataCache::remove(const QUrl &url)
+{
+    QWriteLocker locker(&cacheLock);
+    cache.remove(url);
+    tagsOnlyCache.remove(url);
+}
+
+QMediaMetaData MetaDataCache::parse(const QUrl &url)
+{
+    QMediaMetaData metaData;
+    if (lookup(url, &metaData)) {
+        ++hitCount;
+        return metaData;
+    }
+
+    const QFileInfo info(url.toLocalFile());
+    const bool persistent = url.isLocalFile() && info.isFile();
+    if (persistent && store().lookup(info, &metaData)) {
+        ++hitCount;
+        // The same file may have been stored under another URL
+        metaData.insert(QMediaMetaData::Url, url);
+        insert(url, metaData);
+        return metaData;
+    }
+
+    ++missCount;
+    metaData = parseMetaData(url);
+    insert(url, metaData);
+    if (persistent && !metaData.isEmpty()) {
+        store().append(info, metaData);
+    }
+    return metaData;
+}
+
+QFuture<QMediaMetaData> MetaDataCache::parseAsync(const QUrl &url)
+{
+    return QtConcurrent::run(&MetaDataCache::parse, url);
+}
+
+QMediaMetaData MetaDataCache::parseTags(const QUrl &url, bool *complete)
+{
+    QMediaMetaData metaData;
+    *complete = true;
+    if (lookup(url, &metaData)) {
+        ++hitCount;
+        return metaData;
+    }
+
+    const QFileInfo info(url.toLocalFile());
+    if (url.isLocalFile() && info.isFile() && store().lookup(info, &metaData)) {
+        ++hitCount;
+        metaData.insert(QMediaMetaData::Url, url);
+        insert(url, metaData);
+        return metaData;
+    }
+
+    *complete = false;
+    {
+        QReadLocker locker(&cacheLock);
+        auto it = tagsOnlyCache.constFind(url);
+        if (it != tagsOnlyCache.constEnd()) {
+            return it.value();
+        }
+    }
+
+    // Not counted as a miss: the parse() that completes it will be
+    metaData = parseMetaData(url, false);
+    QWriteLocker locker(&cacheLock);
+    tagsOnlyCache.insert(url, metaData);
+    return metaData;
+}
+
+MetaDataCache::Statistics MetaDataCache::statistics()
+{
+    Statistics statistics;
+    statistics.hits = hitCount.load(std::memory_order_relaxed);
+    statistics.misses = missCount.load(std::memory_order_relaxed);
+    statistics.stored = store().count();
+    return statistics;
+}
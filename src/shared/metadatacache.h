@@ -0,0 +1,44 @@
+#ifndef METADATACACHE_H
+#define METADATACACHE_H
+
+#include <QFuture>
+#include <QMediaMetaData>
+#include <QUrl>
+
+// Process-wide cache of metadata parsed with TagLib, shared by the playlist
+// and the file player so each file is parsed at most once. Thread-safe. The
+// in-memory part is a bounded LRU of the most recently used entries.
+//
+// Behind the in-memory cache sits a persistent store: an append-only file in
+// the cache directory, memory-mapped at startup and indexed by canonical
+// path. An entry is only used while the file's size and mtime still match,
+// so edited files are re-parsed automatically.
+//
+// Parsing can be split in two: parseTags() reads only the tags, which is
+// enough to show a row, and parse() later adds the audio properties. Only
+// complete entries are returned by lookup() or persisted.
+class MetaDataCache
+{
+public:
+    struct Statistics {
+        quint64 hits = 0;   // served from memory or the persistent store
+        quint64 misses = 0; // parsed with TagLib
+        int stored = 0;     // entries in the persistent store
+    };
+
+    static bool lookup(const QUrl &url, QMediaMetaData *metaData);
+    static void insert(const QUrl &url, const QMediaMetaData &metaData);
+    static void remove(const QUrl &url);
+
+    // Cached metadata for url, parsing (and caching) it if needed
+    static QMediaMetaData parse(const QUrl &url);
+    static QFuture<QMediaMetaData> parseAsync(const QUrl &url);
+
+    // Cached metadata for url if any, otherwise only its tags. complete is
+    // set to whether the result includes the audio properties.
+    static QMediaMetaData parseTags(const QUrl &url, bool *complete);
+
+    static Statistics statistics();
+};
+
+#endif // METADATACACHE_H
@@ -0,0 +1,57 @@
+#include "playbackclock.h"
+
+#include <chrono>
+
+namespace {
+// Never extrapolate further than this past the last publication. If the
+// engine stops publishing (stall, underrun) the display freezes instead of
+// running ahead of the audio.
+constexpr qint64 MAX_EXTRAPOLATION_US = 250000;
+}
+
+void PlaybackClock::publish(qint64 positionUs, bool running, qint64 originUs)
+{
+    m_sequence.fetch_add(1, std::memory_order_acq_rel);
+    m_positionUs.store(positionUs, std::memory_order_relaxed);
+    m_originUs.store(originUs, std::memory_order_relaxed);
+    m_publishedUs.store(monotonicUs(), std::memory_order_relaxed);
+    m_running.store(running, std::memory_order_relaxed);
+    m_sequence.fetch_add(1, std::memory_order_release);
+}
+
+qint64 PlaybackClock::positionMs() const
+{
+    qint64 positionUs = 0;
+    qint64 originUs = 0;
+    qint64 publishedUs = 0;
+    bool running = false;
+
+    quint32 before = 0;
+    quint32 after = 0;
+    do {
+        before = m_sequence.load(std::memory_order_acquire);
+        positionUs = m_positionUs.load(std::memory_order_relaxed);
+        originUs = m_originUs.load(std::memory_order_relaxed);
+        publishedUs = m_publishedUs.load(std::memory_order_relaxed);
+        running = m_running.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = m_sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+
+    if (running) {
+        positionUs += qBound<qint64>(0, monotonicUs() - publishedUs, MAX_EXTRAPOLATION_US);
+    }
+
+    return qMax<qint64>(0, positionUs - originUs) / 1000;
+}
+
+bool PlaybackClock::isRunning() const
+{
+    return m_running.load(std::memory_order_relaxed);
+}
+
+qint64 PlaybackClock::monotonicUs()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
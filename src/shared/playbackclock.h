@@ -0,0 +1,36 @@
+#ifndef PLAYBACKCLOCK_H
+#define PLAYBACKCLOCK_H
+
+#include <QtGlobal>
+#include <atomic>
+
+// Playback position published by an engine and read by the UI.
+//
+// The engine publishes the position of the frame currently audible (frames
+// consumed by the sink minus what is still queued in the device) every time
+// it touches the sink. Readers interpolate from the last publication with a
+// monotonic clock, so the UI can query it at its own frame rate without any
+// signal traffic. Reads and writes are lock-free (single writer, seqlock).
+class PlaybackClock
+{
+public:
+    PlaybackClock() = default;
+
+    // positionUs is the absolute engine position, originUs is subtracted
+    // before returning to readers (e.g. track start on a CD).
+    void publish(qint64 positionUs, bool running, qint64 originUs = 0);
+
+    qint64 positionMs() const;
+    bool isRunning() const;
+
+private:
+    std::atomic<quint32> m_sequence{0};
+    std::atomic<qint64> m_positionUs{0};
+    std::atomic<qint64> m_originUs{0};
+    std::atomic<qint64> m_publishedUs{0};
+    std::atomic_bool m_running{false};
+
+    static qint64 monotonicUs();
+};
+
+#endif // PLAYBACKCLOCK_H
@@ -0,0 +1,344 @@
+#include "resampler.h"
+
+#include <QSettings>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLER_NEON
+#elif defined(__SSE__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define RESAMPLER_SSE
+#endif
+
+namespace {
+// Input frames converted and filtered per pass
+constexpr int BLOCK_FRAMES = 1024;
+
+// Upper bound for the phase table (floats). Ratios that would need more
+// phases than this are left to the decoder's converter.
+constexpr qint64 MAX_TABLE_FLOATS = 1 << 20;
+
+struct QualitySpec {
+    int taps;
+    double beta;    // Kaiser window shape
+    double rolloff; // Passband edge relative to the lower Nyquist frequency
+};
+
+constexpr QualitySpec QUALITY_SPECS[] = {
+    {16, 6.0, 0.85},
+    {32, 8.0, 0.91},
+    {64, 10.0, 0.95},
+};
+
+double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    const double halfX = x / 2.0;
+    for (int k = 1; k < 50 && term > 1e-12 * sum; ++k) {
+        term *= (halfX / k) * (halfX / k);
+        sum += term;
+    }
+    return sum;
+}
+
+double sinc(double x)
+{
+    if (std::fabs(x) < 1e-9) {
+        return 1.0;
+    }
+    return std::sin(M_PI * x) / (M_PI * x);
+}
+
+void toFloat(const void *input, QAudioFormat::SampleFormat format, qint64 offset, int count, float *output)
+{
+    switch (format) {
+    case QAudioFormat::UInt8: {
+        const quint8 *in = static_cast<const quint8 *>(input) + offset;
+        for (int i = 0; i < count; ++i) {
+            output[i] = (in[i] - 128) * (1.0f / 128.0f);
+        }
+        break;
+    }
+    case QAudioFormat::Int16: {
+        const qint16 *in = static_cast<const qint16 *>(input) + offset;
+        for (int i = 0; i < count; ++i) {
+            output[i] = in[i] * (1.0f / 32768.0f);
+        }
+        break;
+    }
+    case QAudioFormat::Int32: {
+        const qint32 *in = static_cast<const qint32 *>(input) + offset;
+        for (int i = 0; i < count; ++i) {
+            output[i] = in[i] * (1.0f / 2147483648.0f);
+        }
+        break;
+    }
+    case QAudioFormat::Float:
+        std::memcpy(output, static_cast<const float *>(input) + offset, count * sizeof(float));
+        break;
+    default:
+        std::memset(output, 0, count * sizeof(float));
+        break;
+    }
+}
+
+void fromFloat(const float *input, int count, void *output, QAudioFormat::SampleFormat format, qint64 offset)
+{
+    switch (format) {
+    case QAudioFormat::UInt8: {
+        quint8 *out = static_cast<quint8 *>(output) + offset;
+        for (int i = 0; i < count; ++i) {
+            out[i] = static_cast<quint8>(std::lrintf(qBound(-1.0f, input[i], 1.0f) * 127.0f) + 128);
+        }
+        break;
+    }
+    case QAudioFormat::Int16: {
+        qint16 *out = static_cast<qint16 *>(output) + offset;
+        for (int i = 0; i < count; ++i) {
+            out[i] = static_cast<qint16>(std::lrintf(qBound(-1.0f, input[i], 1.0f) * 32767.0f));
+        }
+        break;
+    }
+    case QAudioFormat::Int32: {
+        qint32 *out = static_cast<qint32 *>(output) + offset;
+        for (int i = 0; i < count; ++i) {
+            out[i] = static_cast<qint32>(std::llrint(qBound(-1.0, double(input[i]), 1.0) * 2147483647.0));
+        }
+        break;
+    }
+    case QAudioFormat::Float:
+        std::memcpy(static_cast<float *>(output) + offset, input, count * sizeof(float));
+        break;
+    default:
+        break;
+    }
+}
+
+// Dot product of 2 * taps interleaved stereo samples with duplicated
+// coefficients. taps is a multiple of 4.
+inline void dotStereo(const float *x, const float *c, int taps, float *out)
+{
+    const int count = taps * 2;
+#if defined(RESAMPLER_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (int i = 0; i < count; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(x + i), vld1q_f32(c + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(x + i + 4), vld1q_f32(c + i + 4));
+    }
+    const float32x4_t acc = vaddq_f32(acc0, acc1);
+    const float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    out[0] = vget_lane_f32(sum, 0);
+    out[1] = vget_lane_f32(sum, 1);
+#elif defined(RESAMPLER_SSE)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int i = 0; i < count; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(c + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(c + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    out[0] = lanes[0] + lanes[2];
+    out[1] = lanes[1] + lanes[3];
+#else
+    float left = 0.0f;
+    float right = 0.0f;
+    for (int i = 0; i < count; i += 2) {
+        left += x[i] * c[i];
+        right += x[i + 1] * c[i + 1];
+    }
+    out[0] = left;
+    out[1] = right;
+#endif
+}
+
+inline float dotMono(const float *x, const float *c, int taps)
+{
+#if defined(RESAMPLER_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (int i = 0; i < taps; i += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(x + i), vld1q_f32(c + i));
+    }
+    const float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#elif defined(RESAMPLER_SSE)
+    __m128 acc = _mm_setzero_ps();
+    for (int i = 0; i < taps; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(c + i)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+    float sum = 0.0f;
+    for (int i = 0; i < taps; ++i) {
+        sum += x[i] * c[i];
+    }
+    return sum;
+#endif
+}
+} // namespace
+
+bool Resampler::configure(int inputRate, int outputRate, int channels, Quality quality)
+{
+    m_channels = 0;
+    if (inputRate <= 0 || outputRate <= 0 || channels <= 0) {
+        return false;
+    }
+
+    const int divisor = std::gcd(inputRate, outputRate);
+    const int interpolation = outputRate / divisor;
+    const int decimation = inputRate / divisor;
+    const int taps = QUALITY_SPECS[quality].taps;
+    const int stride = taps * (channels == 2 ? 2 : 1);
+    if (qint64(interpolation) * stride > MAX_TABLE_FLOATS) {
+        return false;
+    }
+
+    m_channels = channels;
+    m_taps = taps;
+    m_interpolation = interpolation;
+    m_decimation = decimation;
+    m_phaseStride = stride;
+    buildTable(quality);
+
+    m_history.resize((m_taps + BLOCK_FRAMES) * m_channels);
+    m_outputBlock.resize(((qint64(m_taps + BLOCK_FRAMES) * m_interpolation) / m_decimation + 2) * m_channels);
+    reset();
+    return true;
+}
+
+bool Resampler::isConfigured() const
+{
+    return m_channels > 0;
+}
+
+void Resampler::reset()
+{
+    // Half a filter of silence before the first real frame, so output frame 0
+    // lines up with input frame 0.
+    std::fill(m_history.begin(), m_history.end(), 0.0f);
+    m_historyFrames = m_taps / 2 - 1;
+    m_position = m_historyFrames;
+    m_phase = 0;
+}
+
+qint64 Resampler::maxOutputFrames(qint64 inputFrames) const
+{
+    return ((inputFrames + m_taps) * m_interpolation) / m_decimation + 2;
+}
+
+qint64 Resampler::process(const void *input, QAudioFormat::SampleFormat inputFormat, qint64 frames,
+                          void *output, QAudioFormat::SampleFormat outputFormat)
+{
+    if (!isConfigured() || input == nullptr || output == nullptr || frames <= 0) {
+        return 0;
+    }
+
+    qint64 consumed = 0;
+    qint64 written = 0;
+    while (consumed < frames) {
+        const int count = static_cast<int>(qMin<qint64>(BLOCK_FRAMES, frames - consumed));
+        toFloat(input, inputFormat, consumed * m_channels, count * m_channels, historyFrame(m_historyFrames));
+        m_historyFrames += count;
+        consumed += count;
+
+        const int produced = resampleBlock(m_outputBlock.data());
+        fromFloat(m_outputBlock.constData(), produced * m_channels, output, outputFormat, written * m_channels);
+        written += produced;
+
+        // Keep only the context the next output frame still needs
+        const int keepFrom = qMin(m_position - m_taps / 2 + 1, m_historyFrames);
+        if (keepFrom > 0) {
+            std::memmove(historyFrame(0), historyFrame(keepFrom),
+                         (m_historyFrames - keepFrom) * m_channels * sizeof(float));
+            m_historyFrames -= keepFrom;
+            m_position -= keepFrom;
+        }
+    }
+    return written;
+}
+
+Resampler::Quality Resampler::defaultQuality()
+{
+    QSettings settings;
+    const int quality = settings.value("resampler/quality", MediumQuality).toInt();
+    return static_cast<Quality>(qBound<int>(FastQuality, quality, HighQuality));
+}
+
+void Resampler::buildTable(Quality quality)
+{
+    const QualitySpec &spec = QUALITY_SPECS[quality];
+    const int duplicate = m_channels == 2 ? 2 : 1;
+    const double halfLength = m_taps / 2.0;
+    // Cutoff relative to the input Nyquist frequency: when downsampling it
+    // has to drop to the output Nyquist frequency.
+    const double cutoff = spec.rolloff * qMin(1.0, double(m_interpolation) / m_decimation);
+    const double windowScale = 1.0 / besselI0(spec.beta);
+
+    m_coefficients.resize(qint64(m_interpolation) * m_phaseStride);
+    QList<double> phase(m_taps);
+
+    for (int p = 0; p < m_interpolation; ++p) {
+        const double fraction = double(p) / m_interpolation;
+        double sum = 0.0;
+        for (int j = 0; j < m_taps; ++j) {
+            const double distance = j - (m_taps / 2 - 1) - fraction;
+            const double u = distance / halfLength;
+            const double window = std::fabs(u) <= 1.0 ? besselI0(spec.beta * std::sqrt(1.0 - u * u)) * windowScale : 0.0;
+            phase[j] = cutoff * sinc(cutoff * distance) * window;
+            sum += phase[j];
+        }
+
+        // Unity DC gain for every phase, so the phase table adds no ripple
+        float *coefficients = m_coefficients.data() + qint64(p) * m_phaseStride;
+        for (int j = 0; j < m_taps; ++j) {
+            const float value = static_cast<float>(phase[j] / sum);
+            for (int d = 0; d < duplicate; ++d) {
+                coefficients[j * duplicate + d] = value;
+            }
+        }
+    }
+}
+
+int Resampler::resampleBlock(float *output)
+{
+    const int halfTaps = m_taps / 2;
+    int produced = 0;
+
+    while (m_position + halfTaps < m_historyFrames) {
+        const float *coefficients = m_coefficients.constData() + qint64(m_phase) * m_phaseStride;
+        const float *x = historyFrame(m_position - halfTaps + 1);
+        float *out = output + produced * m_channels;
+
+        if (m_channels == 2) {
+            dotStereo(x, coefficients, m_taps, out);
+        } else if (m_channels == 1) {
+            out[0] = dotMono(x, coefficients, m_taps);
+        } else {
+            for (int c = 0; c < m_channels; ++c) {
+                float sum = 0.0f;
+                for (int j = 0; j < m_taps; ++j) {
+                    sum += x[j * m_channels + c] * coefficients[j];
+                }
+                out[c] = sum;
+            }
+        }
+        ++produced;
+
+        m_phase += m_decimation;
+        m_position += m_phase / m_interpolation;
+        m_phase %= m_interpolation;
+    }
+    return produced;
+}
+
+float *Resampler::historyFrame(int frame)
+{
+    return m_history.data() + qint64(frame) * m_channels;
+}
@@ -0,0 +1,71 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <QAudioFormat>
+#include <QList>
+#include <QtGlobal>
+
+// Streaming windowed-sinc polyphase sample rate converter.
+//
+// The rate ratio is reduced to L/M and one Kaiser-windowed sinc phase is
+// precomputed per output position modulo L, so every output frame is a
+// single dot product over the taps (vectorised with NEON or SSE). All
+// buffers are sized in configure(); process() never allocates.
+//
+// Output frame n corresponds exactly to input time n * M / L: the filter is
+// centred, so the only latency is the half filter length that has to be
+// buffered before an output frame can be produced.
+class Resampler
+{
+public:
+    enum Quality {
+        FastQuality,    // 16 taps, ~70 dB stopband
+        MediumQuality,  // 32 taps, ~90 dB stopband
+        HighQuality     // 64 taps, ~110 dB stopband
+    };
+
+    Resampler() = default;
+
+    // Returns false if the ratio can't be represented with a reasonably
+    // sized phase table; the caller should fall back to another converter.
+    bool configure(int inputRate, int outputRate, int channels, Quality quality);
+    bool isConfigured() const;
+
+    // Clears the filter history, call on discontinuities (seek)
+    void reset();
+
+    qint64 maxOutputFrames(qint64 inputFrames) const;
+
+    // Converts input to float, resamples and converts to outputFormat.
+    // output must hold maxOutputFrames(frames) frames. Returns frames written.
+    qint64 process(const void *input, QAudioFormat::SampleFormat inputFormat, qint64 frames,
+                   void *output, QAudioFormat::SampleFormat outputFormat);
+
+    static Quality defaultQuality();
+
+private:
+    int m_channels = 0;
+    int m_taps = 0;
+    int m_interpolation = 1; // L
+    int m_decimation = 1;    // M
+    int m_phase = 0;
+
+    // Phase coefficient table. For stereo each coefficient is stored twice
+    // so a vector of two interleaved frames multiplies in one go.
+    QList<float> m_coefficients;
+    int m_phaseStride = 0;
+
+    // Interleaved float input history: m_taps frames of context plus one
+    // block of new input.
+    QList<float> m_history;
+    int m_historyFrames = 0;
+    int m_position = 0;
+
+    QList<float> m_outputBlock;
+
+    void buildTable(Quality quality);
+    int resampleBlock(float *output);
+    float *historyFrame(int frame);
+};
+
+#endif // RESAMPLER_H
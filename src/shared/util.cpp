@@ -2,15 +2,19 @@
 #include "qdatetime.h"
 #include "qfileinfo.h"
 
-#include <QRegularExpression>
+#include <QSet>
 #include <taglib/fileref.h>
 #include <taglib/tag.h>
 #include <taglib/tpropertymap.h>
 
-QMediaMetaData parseMetaData(const QUrl &url)
+Q_LOGGING_CATEGORY(lcAudioOutput, "linamp.audio.output", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcPrefetch, "linamp.prefetch", QtInfoMsg)
+
+QMediaMetaData parseMetaData(const QUrl &url, bool readProperties)
 {
     QMediaMetaData metadata;
-    TagLib::FileRef f(url.toLocalFile().toLocal8Bit().data());
+    TagLib::FileRef f(url.toLocalFile().toLocal8Bit().data(), readProperties,
+                      readProperties ? TagLib::AudioProperties::Accurate : TagLib::AudioProperties::Fast);
 
     if(!f.isNull() && f.tag()) {
         TagLib::Tag *tag = f.tag();
@@ -77,25 +81,25 @@ QStringList audioFileFilters()
 
 bool isAudioFile(QString path)
 {
-    QStringList filters = audioFileFilters();
-
-    for(const QString &filter : filters) {
-        QRegularExpression rx = QRegularExpression::fromWildcard(filter,
-                                                                 Qt::CaseInsensitive,
-                                                                 QRegularExpression::UnanchoredWildcardConversion);
-        if(rx.match(path).hasMatch()) {
-            return true;
+    // Built once: a suffix lookup instead of a wildcard regex per filter per call
+    static const QSet<QString> suffixes = [] {
+        QSet<QString> set;
+        for(const QString &filter : audioFileFilters()) {
+            set.insert(filter.mid(2)); // "*.mp3" -> "mp3"
         }
-    }
+        return set;
+    }();
 
-    return false;
+    const qsizetype dot = path.lastIndexOf(u'.');
+    return dot >= 0 && suffixes.contains(path.mid(dot + 1).toLower());
 }
 
 bool isPlaylist(const QUrl &url)
 {
     if (!url.isLocalFile())
         return false;
+    // Suffix first: it rules out most urls without touching the disk
     const QFileInfo fileInfo(url.toLocalFile());
-    return fileInfo.exists()
-           && !fileInfo.suffix().compare(QLatin1String("m3u"), Qt::CaseInsensitive);
+    return !fileInfo.suffix().compare(QLatin1String("m3u"), Qt::CaseInsensitive)
+           && fileInfo.exists();
 }
@@ -1,13 +1,23 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <QLoggingCategory>
 #include <QMediaMetaData>
 #include <QUrl>
 
 #define DEFAULT_SAMPLE_RATE 44100
 #define MAX_AUDIO_STREAM_SAMPLE_SIZE 4096
 
-QMediaMetaData parseMetaData(const QUrl &url);
+// Output format and conversion path chosen by the file and CD engines. Off
+// by default, enable with QT_LOGGING_RULES="linamp.audio.output.debug=true".
+Q_DECLARE_LOGGING_CATEGORY(lcAudioOutput)
+// Prefetch hits, cold opens and failed wake-ups, enabled the same way with
+// "linamp.prefetch.debug=true".
+Q_DECLARE_LOGGING_CATEGORY(lcPrefetch)
+
+// With readProperties false only the tags are read: no duration, bitrate or
+// sample rate, but no need to scan the audio stream either.
+QMediaMetaData parseMetaData(const QUrl &url, bool readProperties = true);
 
 QString formatDuration(qint64 ms);
 
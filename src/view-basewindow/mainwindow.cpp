@@ -69,6 +69,7 @@ MainWindow::MainWindow(QWidget *parent)
     connect(playlist, &PlaylistView::showPlayerClicked, this, &MainWindow::showPlayer);
     connect(playlist, &PlaylistView::songSelected, fileSource, &AudioSourceFile::jump);
     connect(playlist, &PlaylistView::addSelectedFilesClicked, fileSource, &AudioSourceFile::addToPlaylist);
+    playlist->setLibrary(fileSource->library());
 
     connect(controlButtons, &ControlButtonsWidget::logoClicked, this, &MainWindow::showMenu);
 
@@ -115,11 +116,19 @@ MainWindow::MainWindow(QWidget *parent)
     connect(menu, &MainMenuView::backClicked, this, &MainWindow::showPlayer);
     connect(menu, &MainMenuView::sourceSelected, coordinator, &AudioSourceCoordinator::setSource);
 
+    // Prepare equalizer view
+    equalizer = new EqualizerView(this);
+    connect(equalizer, &EqualizerView::backClicked, this, &MainWindow::showPlayer);
+    connect(equalizer, &EqualizerView::parametersChanged, coordinator,
+            &AudioSourceCoordinator::setEqualizerParameters);
+    connect(coordinator, &AudioSourceCoordinator::showEqualizerRequested, this, &MainWindow::showEqualizer);
+
     // Prepare navigation stack
     viewStack = new QStackedLayout;
     viewStack->addWidget(playerWindow);
     viewStack->addWidget(playlistWindow);
     viewStack->addWidget(menu);
+    viewStack->addWidget(equalizer);
 
     // Final UI setup and show
     QVBoxLayout *centralLayout = new QVBoxLayout;
@@ -163,6 +172,12 @@ void MainWindow::showMenu()
     viewStack->setCurrentIndex(2);
 }
 
+void MainWindow::showEqualizer()
+{
+    equalizer->reload();
+    viewStack->setCurrentIndex(3);
+}
+
 void MainWindow::showShutdownModal()
 {
     QMessageBox msgBox;
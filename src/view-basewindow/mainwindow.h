@@ -9,6 +9,7 @@
 #include "audiosourcefile.h"
 #include "audiosourcepython.h"
 #include "controlbuttonswidget.h"
+#include "equalizerview.h"
 #include "mainmenuview.h"
 #include "playerview.h"
 #include "playlistview.h"
@@ -28,6 +29,7 @@ public:
     ControlButtonsWidget *controlButtons;
     PlaylistView *playlist;
     MainMenuView *menu;
+    EqualizerView *equalizer;
     AudioSourceCoordinator *coordinator;
     AudioSourceFile *fileSource;
     AudioSourcePython *btSource;
@@ -38,6 +40,7 @@ public slots:
     void showPlayer();
     void showPlaylist();
     void showMenu();
+    void showEqualizer();
     void showShutdownModal();
     void open();
 
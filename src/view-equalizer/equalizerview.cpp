@@ -0,0 +1,160 @@
+#include "equalizerview.h"
+
+#include <QLabel>
+#include <QVBoxLayout>
+
+namespace {
+// Slider steps per dB
+constexpr int SLIDER_STEPS_PER_DB = 2;
+
+// Edits not ended by letting go of a slider, such as keyboard steps, are
+// saved once they stop for this long
+constexpr int SAVE_DELAY_MS = 1000;
+
+const QString VIEW_STYLESHEET = QStringLiteral(
+    "#EqualizerView { background-color: #333350; }"
+    "QLabel, QCheckBox, QPushButton { color: #D6DEFF; font-family: \"DejaVu Sans Mono\"; font-size: 22px; }"
+    "QPushButton, QCheckBox { background-color: #3F3F60; border: 0px; padding: 8px 20px; }"
+    "QPushButton:pressed { background-color: #4A4A71; }"
+    "QCheckBox::indicator { width: 0px; height: 0px; }"
+    "QCheckBox:checked { background-color: #5A5A90; }"
+    "QSlider::groove:vertical { background: #1E1E30; width: 12px; }"
+    "QSlider::sub-page:vertical { background: #1E1E30; }"
+    "QSlider::add-page:vertical { background: #7A7AB0; }"
+    "QSlider::handle:vertical { background: #D6DEFF; height: 24px; margin: 0 -14px; }");
+
+QString bandLabel(float frequency)
+{
+    if (frequency >= 1000.0f) {
+        return QString::number(frequency / 1000.0f) + "K";
+    }
+    return QString::number(frequency);
+}
+} // namespace
+
+EqualizerView::EqualizerView(QWidget *parent)
+    : QWidget(parent)
+{
+    setObjectName("EqualizerView");
+    setAttribute(Qt::WA_StyledBackground, true);
+    setStyleSheet(VIEW_STYLESHEET);
+
+    auto *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(36, 24, 36, 24);
+    layout->setSpacing(16);
+
+    auto *header = new QHBoxLayout;
+    header->setSpacing(8);
+    auto *backButton = new QPushButton(this);
+    backButton->setIcon(QIcon(":/assets/menu-icon-x.png"));
+    backButton->setIconSize(QSize(56, 56));
+    backButton->setStyleSheet("QPushButton { background-color: transparent; border-radius: 28px; padding: 0px; }"
+                              "QPushButton:pressed { background-color: #4A4A71; }");
+    header->addWidget(backButton);
+    header->addWidget(new QLabel(tr("Equalizer"), this));
+    header->addStretch();
+    m_enabledButton = new QCheckBox(tr("ON"), this);
+    header->addWidget(m_enabledButton);
+    m_resetButton = new QPushButton(tr("RESET"), this);
+    header->addWidget(m_resetButton);
+    layout->addLayout(header);
+
+    auto *sliders = new QHBoxLayout;
+    sliders->setSpacing(0);
+    m_preampSlider = addSlider(sliders, tr("PRE"));
+    sliders->addSpacing(48);
+    for (int band = 0; band < EQ_BAND_COUNT; ++band) {
+        m_bandSliders[band] = addSlider(sliders, bandLabel(Equalizer::BAND_FREQUENCIES[band]));
+    }
+    layout->addLayout(sliders, 1);
+
+    m_saveTimer = new QTimer(this);
+    m_saveTimer->setSingleShot(true);
+    m_saveTimer->setInterval(SAVE_DELAY_MS);
+    connect(m_saveTimer, &QTimer::timeout, this, &EqualizerView::saveParameters);
+
+    connect(backButton, &QPushButton::clicked, this, &EqualizerView::backClicked);
+    connect(m_enabledButton, &QCheckBox::toggled, this, &EqualizerView::emitParameters);
+    connect(m_resetButton, &QPushButton::clicked, this, &EqualizerView::resetBands);
+
+    reload();
+}
+
+QSlider *EqualizerView::addSlider(QHBoxLayout *layout, const QString &label)
+{
+    auto *column = new QVBoxLayout;
+    column->setSpacing(8);
+
+    auto *slider = new QSlider(Qt::Vertical, this);
+    slider->setRange(int(-EQ_MAX_GAIN_DB) * SLIDER_STEPS_PER_DB, int(EQ_MAX_GAIN_DB) * SLIDER_STEPS_PER_DB);
+    slider->setPageStep(SLIDER_STEPS_PER_DB * 3);
+    column->addWidget(slider, 1, Qt::AlignHCenter);
+
+    auto *text = new QLabel(label, this);
+    text->setAlignment(Qt::AlignHCenter);
+    column->addWidget(text);
+    layout->addLayout(column, 1);
+
+    connect(slider, &QSlider::valueChanged, this, &EqualizerView::emitParameters);
+    connect(slider, &QSlider::sliderReleased, this, &EqualizerView::saveParameters);
+    return slider;
+}
+
+void EqualizerView::reload()
+{
+    const EqualizerParameters parameters = Equalizer::loadParameters();
+
+    m_saveTimer->stop();
+    m_savePending = false;
+    m_loading = true;
+    m_enabledButton->setChecked(parameters.enabled);
+    m_preampSlider->setValue(qRound(parameters.preampDb * SLIDER_STEPS_PER_DB));
+    for (int band = 0; band < EQ_BAND_COUNT; ++band) {
+        m_bandSliders[band]->setValue(qRound(parameters.bandsDb[band] * SLIDER_STEPS_PER_DB));
+    }
+    m_loading = false;
+}
+
+void EqualizerView::resetBands()
+{
+    m_loading = true;
+    m_preampSlider->setValue(0);
+    for (QSlider *slider : m_bandSliders) {
+        slider->setValue(0);
+    }
+    m_loading = false;
+    emitParameters();
+}
+
+EqualizerParameters EqualizerView::parameters() const
+{
+    EqualizerParameters parameters;
+    parameters.enabled = m_enabledButton->isChecked();
+    parameters.preampDb = float(m_preampSlider->value()) / SLIDER_STEPS_PER_DB;
+    for (int band = 0; band < EQ_BAND_COUNT; ++band) {
+        parameters.bandsDb[band] = float(m_bandSliders[band]->value()) / SLIDER_STEPS_PER_DB;
+    }
+    return parameters;
+}
+
+void EqualizerView::emitParameters()
+{
+    if (m_loading) {
+        return;
+    }
+
+    emit parametersChanged(parameters());
+    m_savePending = true;
+    m_saveTimer->start();
+}
+
+void EqualizerView::saveParameters()
+{
+    // Also reached by letting go of a slider that didn't move
+    if (!m_savePending) {
+        return;
+    }
+    m_savePending = false;
+    m_saveTimer->stop();
+    Equalizer::saveParameters(parameters());
+}
@@ -0,0 +1,47 @@
+#ifndef EQUALIZERVIEW_H
+#define EQUALIZERVIEW_H
+
+#include <QCheckBox>
+#include <QHBoxLayout>
+#include <QPushButton>
+#include <QSlider>
+#include <QTimer>
+#include <QWidget>
+
+#include "equalizer.h"
+
+// Editor for the shared equalizer settings: on/off, preamp and the ten band
+// gains. Edits are emitted as they happen, for the active source to apply
+// them. They are persisted here, when a slider is let go or once edits
+// stop for SAVE_DELAY_MS, not on every step of a drag.
+class EqualizerView : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit EqualizerView(QWidget *parent = nullptr);
+
+public slots:
+    // Shows the persisted settings, call before the view is brought up
+    void reload();
+
+signals:
+    void parametersChanged(const EqualizerParameters &parameters);
+    void backClicked();
+
+private:
+    QCheckBox *m_enabledButton = nullptr;
+    QPushButton *m_resetButton = nullptr;
+    QSlider *m_preampSlider = nullptr;
+    QSlider *m_bandSliders[EQ_BAND_COUNT] = {};
+    QTimer *m_saveTimer = nullptr;
+    bool m_savePending = false;
+    bool m_loading = false;
+
+    QSlider *addSlider(QHBoxLayout *layout, const QString &label);
+    EqualizerParameters parameters() const;
+    void resetBands();
+    void emitParameters();
+    void saveParameters();
+};
+
+#endif // EQUALIZERVIEW_H
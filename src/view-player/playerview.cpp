@@ -16,6 +16,23 @@
 #include <QStandardPaths>
 #include <QFontDatabase>
 
+namespace {
+// The kHz field and its caption have room for two digits
+constexpr int MAX_DISPLAYED_KHZ = 99;
+
+// A sample rate as shown on the player: whole kHz, rounded down as other
+// players do (44100 is 44), empty if unknown. Rates of 100 kHz and above
+// don't fit and show as "HI".
+QString kHzText(int sampleRate)
+{
+    const int khz = sampleRate / 1000;
+    if (khz <= 0) {
+        return QString();
+    }
+    return khz > MAX_DISPLAYED_KHZ ? QStringLiteral("HI") : QString::number(khz);
+}
+} // namespace
+
 PlayerView::PlayerView(QWidget *parent, ControlButtonsWidget *ctlBtns) :
     QWidget(parent),
     ui(new Ui::PlayerView)
@@ -116,10 +133,16 @@ PlayerView::PlayerView(QWidget *parent, ControlButtonsWidget *ctlBtns) :
     // Reset time counter
     ui->progressTimeLabel->setText("");
 
+    // Poll the source playback clock at frame rate while playing
+    clockTimer = new QTimer(this);
+    clockTimer->setInterval(33); // around 30 fps
+    connect(clockTimer, &QTimer::timeout, this, &PlayerView::handleClockTick);
+
     // Set play status icon
     setPlaybackState(MediaPlayer::StoppedState);
 
     connect(ui->playlistButton, &QCheckBox::clicked, this, &PlayerView::plClicked);
+    connect(ui->eqButton, &QCheckBox::clicked, this, &PlayerView::eqClicked);
 
     // Setup spectrum widget
     QVBoxLayout *spectrumLayout = new QVBoxLayout;
@@ -237,8 +260,34 @@ void PlayerView::setDeferredSeekEnabled(bool enabled)
     }
 }
 
+void PlayerView::setPlaybackClock(const PlaybackClock *clock)
+{
+    m_clock = clock;
+    updateClockTimer();
+}
+
+void PlayerView::updateClockTimer()
+{
+    if (m_clock != nullptr && m_playbackState == MediaPlayer::PlayingState) {
+        clockTimer->start();
+    } else {
+        clockTimer->stop();
+    }
+}
+
+void PlayerView::handleClockTick()
+{
+    if (m_clock == nullptr) {
+        return;
+    }
+    setPosition(m_clock->positionMs());
+}
+
 void PlayerView::setPlaybackState(MediaPlayer::PlaybackState state)
 {
+    m_playbackState = state;
+    updateClockTimer();
+
     QString imageSrc;
     switch(state) {
     case MediaPlayer::StoppedState:
@@ -330,8 +379,7 @@ void PlayerView::setMetadata(QMediaMetaData metadata)
 
 
     // Set kHz
-    int khz = metadata.value(QMediaMetaData::Comment).toString().toInt()/1000;
-    ui->khzValueLabel->setText(khz > 0 ? QString::number(khz) : "");
+    ui->khzValueLabel->setText(kHzText(metadata.value(QMediaMetaData::Comment).toString().toInt()));
 }
 
 void PlayerView::setDuration(qint64 duration)
@@ -354,6 +402,18 @@ void PlayerView::setBalance(int balance)
     }
 }
 
+void PlayerView::setOutputFormat(int sampleRate, bool resampled)
+{
+    // Native path shows the usual "kHz" caption, a resampled path shows the
+    // rate the device actually runs at instead, as ">48".
+    const QString outputKHz = resampled ? kHzText(sampleRate) : QString();
+    if (!outputKHz.isEmpty()) {
+        ui->kHzLabel->setText(QLatin1Char('>') + outputKHz);
+    } else {
+        ui->kHzLabel->setText("kHz");
+    }
+}
+
 void PlayerView::setEqEnabled(bool enabled)
 {
     eqEnabled = enabled;
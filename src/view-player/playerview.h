@@ -3,6 +3,7 @@
 
 #include "controlbuttonswidget.h"
 #include "mediaplayer.h"
+#include "playbackclock.h"
 #include "spectrumwidget.h"
 
 #include <QMediaMetaData>
@@ -36,6 +37,7 @@ public:
 
 public slots:
     void setDeferredSeekEnabled(bool enabled);
+    void setPlaybackClock(const PlaybackClock *clock);
     void setPlaybackState(MediaPlayer::PlaybackState state);
     void setPosition(qint64 progress);
     void setSpectrumData(const QByteArray& data, QAudioFormat format);
@@ -44,6 +46,7 @@ public slots:
     void setVolume(int volume);
     void setBalance(int balance);
     void setEqEnabled(bool enabled);
+    void setOutputFormat(int sampleRate, bool resampled);
     void setPlEnabled(bool enabled);
     void setShuffleEnabled(bool enabled);
     void setRepeatEnabled(bool enabled);
@@ -76,6 +79,9 @@ private:
     void scale();
     SpectrumWidget *spectrum = nullptr;
     QTimer *messageTimer = nullptr;
+    QTimer *clockTimer = nullptr;
+    const PlaybackClock *m_clock = nullptr;
+    MediaPlayer::PlaybackState m_playbackState = MediaPlayer::StoppedState;
     ControlButtonsWidget *controlButtons = nullptr;
 
     QString m_trackInfo;
@@ -91,9 +97,11 @@ private:
 
     void updateDurationInfo(qint64 currentInfo);
     void setTrackInfo(const QString &info);
+    void updateClockTimer();
 
 private slots:
     void handleBalanceChanged();
+    void handleClockTick();
 
 };
 
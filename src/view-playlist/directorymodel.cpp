@@ -0,0 +1,227 @@
+#include "directorymodel.h"
+#include "util.h"
+
+#include <QDir>
+#include <QFile>
+#include <QThread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+namespace {
+constexpr int LISTING_CACHE_SIZE = 64;
+
+// Subfolders of the shown directory listed ahead of a tap on them
+constexpr int PREFETCH_LIMIT = 16;
+
+// Copying files in sends a burst of change events; re-read once after it
+constexpr int REFRESH_DELAY_MS = 250;
+} // namespace
+
+DirectoryModel::DirectoryModel(QObject *parent)
+    : QAbstractListModel{parent}
+    , m_cache(LISTING_CACHE_SIZE)
+{
+    m_pool.setMaxThreadCount(1);
+    m_pool.setThreadPriority(QThread::LowPriority);
+
+    m_folderIcon = QIcon(":/assets/fb_folderIcon.png");
+    m_folderIcon.addFile(":/assets/fb_folderIcon_selected.png", QSize(), QIcon::Selected);
+    m_musicIcon = QIcon(":/assets/fb_musicIcon.png");
+    m_musicIcon.addFile(":/assets/fb_musicIcon_selected.png", QSize(), QIcon::Selected);
+
+    m_refreshTimer = new QTimer(this);
+    m_refreshTimer->setSingleShot(true);
+    m_refreshTimer->setInterval(REFRESH_DELAY_MS);
+    connect(m_refreshTimer, &QTimer::timeout, this, &DirectoryModel::refresh);
+
+    m_watcher = new QFileSystemWatcher(this);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, m_refreshTimer,
+            qOverload<>(&QTimer::start));
+}
+
+DirectoryModel::~DirectoryModel()
+{
+    ++m_generation;
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void DirectoryModel::setDirectory(const QString &path)
+{
+    const QString directory = QDir::cleanPath(path);
+
+    beginResetModel();
+    if (!m_directory.isEmpty()) {
+        m_watcher->removePath(m_directory);
+    }
+    m_directory = directory;
+    const Listing *cached = m_cache.object(directory);
+    if (cached != nullptr && cached->modified == modifiedTime(directory)) {
+        m_listing = *cached;
+    } else {
+        m_listing = readListing(directory);
+        m_cache.insert(directory, new Listing(m_listing));
+    }
+    endResetModel();
+
+    m_refreshTimer->stop();
+    m_watcher->addPath(directory);
+    prefetchSubdirectories();
+}
+
+QString DirectoryModel::directory() const
+{
+    return m_directory;
+}
+
+bool DirectoryModel::isDir(const QModelIndex &index) const
+{
+    return index.isValid() && m_listing.entries.at(index.row()).isDir;
+}
+
+QString DirectoryModel::filePath(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return m_directory;
+    }
+    return childPath(m_directory, m_listing.entries.at(index.row()).name);
+}
+
+int DirectoryModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_listing.entries.size();
+}
+
+QVariant DirectoryModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_listing.entries.size()) {
+        return QVariant();
+    }
+    const Entry &entry = m_listing.entries.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+        return entry.name;
+    case Qt::DecorationRole:
+        return entry.isDir ? m_folderIcon : m_musicIcon;
+    default:
+        return QVariant();
+    }
+}
+
+// Runs on the GUI thread and the prefetch thread
+DirectoryModel::Listing DirectoryModel::readListing(const QString &path)
+{
+    Listing listing;
+    // Taken first, so a change made while reading shows up as a newer mtime
+    listing.modified = modifiedTime(path);
+
+    DIR *dir = ::opendir(QFile::encodeName(path).constData());
+    if (dir == nullptr) {
+        return listing;
+    }
+    const int dirFd = ::dirfd(dir);
+
+    QList<Entry> folders;
+    QList<Entry> files;
+    while (const dirent *entry = ::readdir(dir)) {
+        // Hidden entries, "." and ".."
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        bool isDir = entry->d_type == DT_DIR;
+        bool isFile = entry->d_type == DT_REG;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            // The only entries that cost a stat(); links show as their target
+            struct stat info;
+            if (::fstatat(dirFd, entry->d_name, &info, 0) != 0) {
+                continue;
+            }
+            isDir = S_ISDIR(info.st_mode);
+            isFile = S_ISREG(info.st_mode);
+        }
+
+        const QString name = QFile::decodeName(entry->d_name);
+        if (isDir) {
+            folders.append({name, true});
+        } else if (isFile && isAudioFile(name)) {
+            files.append({name, false});
+        }
+    }
+    ::closedir(dir);
+
+    const auto byName = [](const Entry &a, const Entry &b) {
+        return a.name.compare(b.name, Qt::CaseInsensitive) < 0;
+    };
+    std::sort(folders.begin(), folders.end(), byName);
+    std::sort(files.begin(), files.end(), byName);
+
+    listing.entries = folders + files;
+    return listing;
+}
+
+qint64 DirectoryModel::modifiedTime(const QString &path)
+{
+    struct stat info;
+    if (::stat(QFile::encodeName(path).constData(), &info) != 0) {
+        return -1;
+    }
+    return qint64(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+QString DirectoryModel::childPath(const QString &directory, const QString &name)
+{
+    // Only the root ends in '/'
+    return directory.endsWith(u'/') ? directory + name : directory + u'/' + name;
+}
+
+void DirectoryModel::refresh()
+{
+    if (m_directory.isEmpty()) {
+        return;
+    }
+    beginResetModel();
+    m_listing = readListing(m_directory);
+    m_cache.insert(m_directory, new Listing(m_listing));
+    endResetModel();
+}
+
+void DirectoryModel::prefetchSubdirectories()
+{
+    // Only the folder on screen matters: drop what was queued for the last one
+    m_pool.clear();
+    const int generation = ++m_generation;
+
+    QStringList paths;
+    for (const Entry &entry : std::as_const(m_listing.entries)) {
+        // Folders come first
+        if (!entry.isDir || paths.size() == PREFETCH_LIMIT) {
+            break;
+        }
+        const QString path = childPath(m_directory, entry.name);
+        if (!m_cache.contains(path)) {
+            paths.append(path);
+        }
+    }
+    if (paths.isEmpty()) {
+        return;
+    }
+
+    m_pool.start([this, paths, generation]() {
+        for (const QString &path : paths) {
+            if (m_generation.load() != generation) {
+                return;
+            }
+            const Listing listing = readListing(path);
+            QMetaObject::invokeMethod(this, [this, path, listing]() {
+                if (!m_cache.contains(path)) {
+                    m_cache.insert(path, new Listing(listing));
+                }
+            }, Qt::QueuedConnection);
+        }
+    });
+}
@@ -0,0 +1,66 @@
+#ifndef DIRECTORYMODEL_H
+#define DIRECTORYMODEL_H
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QFileSystemWatcher>
+#include <QIcon>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <atomic>
+
+// Read-only list of the folders and audio files in one directory, for the
+// file browser.
+//
+// Listings come from readdir() without a stat() per entry. Recent ones are
+// kept in a small LRU cache and reused as long as the directory's mtime is
+// unchanged, so going back to a folder costs a single stat(). While a
+// directory is shown its subfolders are listed in the background, and it is
+// the only directory watched for changes.
+class DirectoryModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    explicit DirectoryModel(QObject *parent = nullptr);
+    ~DirectoryModel() override;
+
+    void setDirectory(const QString &path);
+    QString directory() const;
+
+    bool isDir(const QModelIndex &index) const;
+    QString filePath(const QModelIndex &index) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+private:
+    struct Entry {
+        QString name;
+        bool isDir = false;
+    };
+    struct Listing {
+        QList<Entry> entries; // folders first, each sorted by name
+        qint64 modified = -1; // of the directory, ns since the epoch
+    };
+
+    QString m_directory;
+    Listing m_listing;
+    QCache<QString, Listing> m_cache;
+    QFileSystemWatcher *m_watcher = nullptr;
+    QTimer *m_refreshTimer = nullptr;
+    QThreadPool m_pool;
+    std::atomic<int> m_generation{0};
+
+    // Shared by every row
+    QIcon m_folderIcon;
+    QIcon m_musicIcon;
+
+    static Listing readListing(const QString &path);
+    static qint64 modifiedTime(const QString &path);
+    static QString childPath(const QString &directory, const QString &name);
+    void refresh();
+    void prefetchSubdirectories();
+};
+
+#endif // DIRECTORYMODEL_H
@@ -0,0 +1,182 @@
+#include "folderscanner.h"
+#include "util.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QThread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Files handed to the playlist at once, unless FLUSH_INTERVAL_MS passes first
+constexpr int BATCH_SIZE = 256;
+constexpr int FLUSH_INTERVAL_MS = 250;
+
+// Longest suffix worth looking up
+constexpr int MAX_SUFFIX_LENGTH = 8;
+
+bool lessByName(const QString &a, const QString &b)
+{
+    return a.compare(b, Qt::CaseInsensitive) < 0;
+}
+} // namespace
+
+FolderScanner::FolderScanner(QObject *parent)
+    : QObject{parent}
+{
+    // One thread: the scan is bound by the storage, not the CPU
+    m_pool.setMaxThreadCount(1);
+    m_pool.setThreadPriority(QThread::LowPriority);
+
+    for (const QString &filter : audioFileFilters()) {
+        const QByteArray suffix = filter.mid(2).toLatin1(); // "*.mp3" -> "mp3"
+        // Playlists are opened explicitly, not swept up with a folder
+        if (suffix != "m3u") {
+            m_suffixes.insert(suffix);
+        }
+    }
+}
+
+FolderScanner::~FolderScanner()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void FolderScanner::scan(const QStringList &directories)
+{
+    if (directories.isEmpty()) {
+        return;
+    }
+    ++m_running;
+    const int generation = m_generation.load();
+    m_pool.start([this, directories, generation]() {
+        run(directories, generation);
+        QMetaObject::invokeMethod(this, [this]() {
+            if (--m_running == 0) {
+                emit finished();
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void FolderScanner::cancel()
+{
+    // Queued scans still start, but return at once
+    ++m_generation;
+}
+
+bool FolderScanner::isScanning() const
+{
+    return m_running > 0;
+}
+
+void FolderScanner::run(const QStringList &directories, int generation)
+{
+    QList<QUrl> batch;
+    QElapsedTimer sinceFlush;
+    sinceFlush.start();
+
+    // Depth first with an explicit stack, subfolders pushed in reverse so
+    // they come off it in order
+    QStringList stack(directories.crbegin(), directories.crend());
+    while (!stack.isEmpty()) {
+        if (m_generation.load() != generation) {
+            return;
+        }
+
+        QStringList subdirectories = listDirectory(stack.takeLast(), &batch);
+        for (auto it = subdirectories.crbegin(); it != subdirectories.crend(); ++it) {
+            stack.append(*it);
+        }
+
+        if (batch.size() >= BATCH_SIZE || (!batch.isEmpty() && sinceFlush.elapsed() >= FLUSH_INTERVAL_MS)) {
+            deliver(batch, generation);
+            batch.clear();
+            sinceFlush.restart();
+        }
+    }
+    if (!batch.isEmpty()) {
+        deliver(batch, generation);
+    }
+}
+
+// Appends the wanted files of path to files, sorted by name, and returns
+// its subdirectories, also sorted.
+QStringList FolderScanner::listDirectory(const QString &path, QList<QUrl> *files) const
+{
+    QStringList subdirectories;
+    DIR *dir = ::opendir(QFile::encodeName(path).constData());
+    if (dir == nullptr) {
+        return subdirectories;
+    }
+    const int dirFd = ::dirfd(dir);
+    // A trailing '/' would give "//" for the root, which a file URL reads as a host
+    const QString prefix = path.endsWith(u'/') ? path : path + u'/';
+
+    QStringList names;
+    while (const dirent *entry = ::readdir(dir)) {
+        const char *name = entry->d_name;
+        // Also skips "." and ".."
+        if (name[0] == '.') {
+            continue;
+        }
+
+        bool isDirectory = entry->d_type == DT_DIR;
+        bool isFile = entry->d_type == DT_REG;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            // The only entries that cost a stat(). Links to directories are
+            // not followed, so a link loop can't make the scan endless.
+            struct stat info;
+            if (::fstatat(dirFd, name, &info, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            isDirectory = S_ISDIR(info.st_mode);
+            isFile = S_ISREG(info.st_mode)
+                     || (S_ISLNK(info.st_mode) && isWanted(name) && ::fstatat(dirFd, name, &info, 0) == 0
+                         && S_ISREG(info.st_mode));
+        }
+
+        if (isDirectory) {
+            subdirectories.append(prefix + QFile::decodeName(name));
+        } else if (isFile && isWanted(name)) {
+            names.append(QFile::decodeName(name));
+        }
+    }
+    ::closedir(dir);
+
+    std::sort(names.begin(), names.end(), lessByName);
+    std::sort(subdirectories.begin(), subdirectories.end(), lessByName);
+    for (const QString &name : std::as_const(names)) {
+        files->append(QUrl::fromLocalFile(prefix + name));
+    }
+    return subdirectories;
+}
+
+bool FolderScanner::isWanted(const char *name) const
+{
+    const char *dot = std::strrchr(name, '.');
+    if (dot == nullptr) {
+        return false;
+    }
+    const qsizetype length = qsizetype(std::strlen(dot + 1));
+    if (length == 0 || length > MAX_SUFFIX_LENGTH) {
+        return false;
+    }
+    return m_suffixes.contains(QByteArray(dot + 1, length).toLower());
+}
+
+void FolderScanner::deliver(const QList<QUrl> &urls, int generation)
+{
+    // Checked again on the GUI thread: a batch queued before cancel() must not land after it
+    QMetaObject::invokeMethod(this, [this, urls, generation]() {
+        if (m_generation.load() == generation) {
+            emit filesFound(urls);
+        }
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,51 @@
+#ifndef FOLDERSCANNER_H
+#define FOLDERSCANNER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
+#include <QUrl>
+
+#include <atomic>
+
+// Finds the audio files under a set of folders on a background thread and
+// hands them over in batches, in the order of a sorted recursive listing:
+// a folder's files first, then its subfolders.
+//
+// Directories are read with readdir(), which fetches entries from the
+// kernel in large getdents64() batches, and the entry type it returns
+// saves a stat() per file on most filesystems. Files are matched by
+// suffix against a set built once, not by wildcard patterns.
+class FolderScanner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FolderScanner(QObject *parent = nullptr);
+    ~FolderScanner() override;
+
+    void scan(const QStringList &directories);
+    // Stops every scan, queued or running. Batches already delivered stay.
+    void cancel();
+    bool isScanning() const;
+
+signals:
+    void filesFound(const QList<QUrl> &urls);
+    // No scan is left running
+    void finished();
+
+private:
+    QThreadPool m_pool;
+    QSet<QByteArray> m_suffixes;
+    std::atomic<int> m_generation{0};
+    int m_running = 0; // GUI thread only
+
+    void run(const QStringList &directories, int generation);
+    QStringList listDirectory(const QString &path, QList<QUrl> *files) const;
+    bool isWanted(const char *name) const;
+    void deliver(const QList<QUrl> &urls, int generation);
+};
+
+#endif // FOLDERSCANNER_H
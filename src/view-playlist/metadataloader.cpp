@@ -0,0 +1,185 @@
+#include "metadataloader.h"
+#include "metadatacache.h"
+
+#include <QFileInfo>
+#include <QThread>
+
+namespace {
+constexpr int FLUSH_INTERVAL_MS = 100;
+
+// TagLib parsing is mostly I/O bound on SD cards; more threads than this
+// only make the reads seek against each other.
+constexpr int MAX_WORKERS = 4;
+} // namespace
+
+MetaDataLoader::MetaDataLoader(QObject *parent)
+    : QObject{parent}
+{
+    m_maxWorkers = qBound(1, QThread::idealThreadCount(), MAX_WORKERS);
+    m_pool.setMaxThreadCount(m_maxWorkers);
+    m_pool.setThreadPriority(QThread::LowPriority);
+
+    m_flushTimer = new QTimer(this);
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(FLUSH_INTERVAL_MS);
+    connect(m_flushTimer, &QTimer::timeout, this, &MetaDataLoader::flush);
+}
+
+MetaDataLoader::~MetaDataLoader()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_queue.clear();
+        m_propertiesQueue.clear();
+        m_wanted.clear();
+    }
+    m_pool.waitForDone();
+}
+
+void MetaDataLoader::request(const QList<QUrl> &urls)
+{
+    QMutexLocker locker(&m_mutex);
+    for (const QUrl &url : urls) {
+        if (!m_wanted.contains(url)) {
+            m_wanted.insert(url);
+            m_queue.append(url);
+        }
+    }
+    startWorkers();
+}
+
+void MetaDataLoader::refine(const QList<QUrl> &urls)
+{
+    QMutexLocker locker(&m_mutex);
+    for (const QUrl &url : urls) {
+        if (!m_wanted.contains(url)) {
+            m_wanted.insert(url);
+            m_propertiesQueue.append(url);
+        }
+    }
+    startWorkers();
+}
+
+void MetaDataLoader::prioritize(const QList<QUrl> &urls)
+{
+    QMutexLocker locker(&m_mutex);
+    // Walk backwards so the urls end up at the front in the given order
+    for (auto it = urls.crbegin(); it != urls.crend(); ++it) {
+        if (m_queue.removeOne(*it)) {
+            m_queue.prepend(*it);
+        } else if (m_propertiesQueue.removeOne(*it)) {
+            m_propertiesQueue.prepend(*it);
+        }
+    }
+}
+
+void MetaDataLoader::cancel(const QList<QUrl> &urls)
+{
+    QSet<QUrl> cancelled;
+    QMutexLocker locker(&m_mutex);
+    for (const QUrl &url : urls) {
+        if (m_wanted.remove(url)) {
+            cancelled.insert(url);
+        }
+        m_results.remove(url);
+    }
+    // One pass over each queue, however many urls are cancelled
+    if (!cancelled.isEmpty()) {
+        const auto isCancelled = [&cancelled](const QUrl &url) { return cancelled.contains(url); };
+        m_queue.removeIf(isCancelled);
+        m_propertiesQueue.removeIf(isCancelled);
+    }
+}
+
+void MetaDataLoader::startWorkers()
+{
+    int wanted = m_queue.size();
+    if (!m_propertiesQueue.isEmpty() && !m_propertiesWorker) {
+        ++wanted;
+    }
+    while (!m_stopping && m_workers < m_maxWorkers && m_workers < wanted) {
+        ++m_workers;
+        m_pool.start([this]() { runWorker(); });
+    }
+}
+
+// Called with m_mutex held. The properties pass waits for the tags pass and
+// never runs on more than one thread: it is the one that reads whole files.
+bool MetaDataLoader::takeNext(QUrl *url, bool *properties)
+{
+    if (m_stopping) {
+        return false;
+    }
+    if (!m_queue.isEmpty()) {
+        *url = m_queue.takeFirst();
+        *properties = false;
+        return true;
+    }
+    if (!m_propertiesQueue.isEmpty() && !m_propertiesWorker) {
+        *url = m_propertiesQueue.takeFirst();
+        *properties = true;
+        m_propertiesWorker = true;
+        return true;
+    }
+    return false;
+}
+
+void MetaDataLoader::runWorker()
+{
+    while (true) {
+        QUrl url;
+        bool properties = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!takeNext(&url, &properties)) {
+                --m_workers;
+                return;
+            }
+        }
+
+        Result result;
+        result.url = url;
+        result.complete = true;
+        result.metaData = properties ? MetaDataCache::parse(url) : MetaDataCache::parseTags(url, &result.complete);
+        if (url.isLocalFile()) {
+            // The file was just opened, so this doesn't touch the disk
+            result.fileSize = QFileInfo(url.toLocalFile()).size();
+        }
+
+        QMutexLocker locker(&m_mutex);
+        if (properties) {
+            m_propertiesWorker = false;
+        }
+        // Removed from the playlist while it was being parsed
+        if (!m_wanted.contains(url)) {
+            continue;
+        }
+        if (result.complete) {
+            m_wanted.remove(url);
+        } else {
+            m_propertiesQueue.append(url);
+        }
+        const bool firstResult = m_results.isEmpty();
+        m_results.insert(url, result);
+        if (firstResult) {
+            QMetaObject::invokeMethod(this, [this]() {
+                if (!m_flushTimer->isActive()) {
+                    m_flushTimer->start();
+                }
+            }, Qt::QueuedConnection);
+        }
+    }
+}
+
+void MetaDataLoader::flush()
+{
+    QHash<QUrl, Result> results;
+    {
+        QMutexLocker locker(&m_mutex);
+        results.swap(m_results);
+    }
+    if (!results.isEmpty()) {
+        emit metaDataReady(results.values());
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef METADATALOADER_H
+#define METADATALOADER_H
+
+#include <QHash>
+#include <QMediaMetaData>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+#include <QUrl>
+
+// Parses playlist metadata on a small pool of low priority threads.
+//
+// Parsing is done in two passes. The first reads only tags so every row has
+// a title quickly; once it has drained, a single worker reads the audio
+// properties (duration, bitrate), which may mean scanning the whole file.
+//
+// Requests are served in queue order; prioritize() moves urls (the rows on
+// screen) to the front. Results are collected and delivered on the GUI
+// thread in batches, at most one every FLUSH_INTERVAL_MS, so a large import
+// turns into a handful of model updates instead of one per file.
+class MetaDataLoader : public QObject
+{
+    Q_OBJECT
+public:
+    struct Result {
+        QUrl url;
+        QMediaMetaData metaData;
+        qint64 fileSize = 0;
+        bool complete = false; // audio properties known, else delivered again
+    };
+
+    explicit MetaDataLoader(QObject *parent = nullptr);
+    ~MetaDataLoader() override;
+
+    void request(const QList<QUrl> &urls);
+    // For tracks that already have usable metadata: skips the tags pass and
+    // goes straight to the audio properties pass
+    void refine(const QList<QUrl> &urls);
+    void prioritize(const QList<QUrl> &urls);
+
+    // Drops queued requests; results of parses already running are discarded
+    void cancel(const QList<QUrl> &urls);
+
+signals:
+    void metaDataReady(const QList<MetaDataLoader::Result> &batch);
+
+private:
+    QThreadPool m_pool;
+    int m_maxWorkers = 1;
+    QTimer *m_flushTimer = nullptr;
+
+    QMutex m_mutex;
+    QList<QUrl> m_queue;           // tags pass
+    QList<QUrl> m_propertiesQueue; // audio properties pass
+    QSet<QUrl> m_wanted;           // queued or being parsed, either pass
+    QHash<QUrl, Result> m_results; // a later pass replaces an earlier one
+    int m_workers = 0;
+    bool m_propertiesWorker = false;
+    bool m_stopping = false;
+
+    void startWorkers();
+    bool takeNext(QUrl *url, bool *properties);
+    void runWorker();
+    void flush();
+};
+
+#endif // METADATALOADER_H
@@ -0,0 +1,255 @@
+#include "playlistfiltermodel.h"
+#include "qmediaplaylist.h"
+
+#include <algorithm>
+
+namespace {
+// Metadata arrives in bursts; look the query up again once they settle
+constexpr int REFRESH_DELAY_MS = 300;
+} // namespace
+
+PlaylistFilterModel::PlaylistFilterModel(PlaylistModel *source, QObject *parent)
+    : QAbstractProxyModel{parent}
+    , m_source(source)
+{
+    m_refreshTimer = new QTimer(this);
+    m_refreshTimer->setSingleShot(true);
+    m_refreshTimer->setInterval(REFRESH_DELAY_MS);
+    connect(m_refreshTimer, &QTimer::timeout, this, &PlaylistFilterModel::refresh);
+
+    setSourceModel(source);
+    connect(source, &QAbstractItemModel::rowsAboutToBeInserted, this,
+            &PlaylistFilterModel::sourceRowsAboutToBeInserted);
+    connect(source, &QAbstractItemModel::rowsInserted, this, &PlaylistFilterModel::sourceRowsInserted);
+    connect(source, &QAbstractItemModel::rowsAboutToBeRemoved, this,
+            &PlaylistFilterModel::sourceRowsAboutToBeRemoved);
+    connect(source, &QAbstractItemModel::rowsRemoved, this, &PlaylistFilterModel::sourceRowsRemoved);
+    connect(source, &QAbstractItemModel::dataChanged, this, &PlaylistFilterModel::sourceDataChanged);
+    connect(source, &QAbstractItemModel::modelAboutToBeReset, this, &PlaylistFilterModel::beginResetModel);
+    connect(source, &QAbstractItemModel::modelReset, this, &PlaylistFilterModel::sourceModelReset);
+
+    // Metadata that arrived may make rows match, or stop matching
+    connect(source->playlist(), &QMediaPlaylist::mediaChanged, this, [this]() {
+        if (isFiltering() && !m_refreshTimer->isActive()) {
+            m_refreshTimer->start();
+        }
+    });
+}
+
+void PlaylistFilterModel::setQuery(const QString &query)
+{
+    const QString trimmed = query.trimmed();
+    if (trimmed == m_query) {
+        return;
+    }
+    m_refreshTimer->stop();
+    beginResetModel();
+    m_query = trimmed;
+    m_rows = isFiltering() ? m_source->playlist()->search(m_query) : QList<int>();
+    endResetModel();
+}
+
+QString PlaylistFilterModel::query() const
+{
+    return m_query;
+}
+
+bool PlaylistFilterModel::isFiltering() const
+{
+    return !m_query.isEmpty();
+}
+
+QModelIndex PlaylistFilterModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if (!proxyIndex.isValid()) {
+        return QModelIndex();
+    }
+    const int row = isFiltering() ? m_rows.value(proxyIndex.row(), -1) : proxyIndex.row();
+    return m_source->index(row, proxyIndex.column());
+}
+
+QModelIndex PlaylistFilterModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if (!sourceIndex.isValid()) {
+        return QModelIndex();
+    }
+    return index(proxyRow(sourceIndex.row()), sourceIndex.column());
+}
+
+QModelIndex PlaylistFilterModel::index(int row, int column, const QModelIndex &parent) const
+{
+    return !parent.isValid() && row >= 0 && row < rowCount() && column >= 0 && column < columnCount()
+                   ? createIndex(row, column)
+                   : QModelIndex();
+}
+
+QModelIndex PlaylistFilterModel::parent(const QModelIndex &child) const
+{
+    Q_UNUSED(child);
+    return QModelIndex();
+}
+
+int PlaylistFilterModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return isFiltering() ? int(m_rows.size()) : m_source->rowCount();
+}
+
+int PlaylistFilterModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_source->columnCount();
+}
+
+// Row showing sourceRow, or -1 if it doesn't match
+int PlaylistFilterModel::proxyRow(int sourceRow) const
+{
+    if (!isFiltering()) {
+        return sourceRow;
+    }
+    const auto it = std::lower_bound(m_rows.cbegin(), m_rows.cend(), sourceRow);
+    return it != m_rows.cend() && *it == sourceRow ? int(it - m_rows.cbegin()) : -1;
+}
+
+void PlaylistFilterModel::refresh()
+{
+    if (isFiltering()) {
+        applyRows(m_source->playlist()->search(m_query));
+    }
+}
+
+// Moves m_rows to rows, both ascending, with as few signals as contiguous
+// runs allow, so the selection and scroll position survive
+void PlaylistFilterModel::applyRows(const QList<int> &rows)
+{
+    // Removals first, the last run first so earlier rows keep their place
+    QList<bool> keep(m_rows.size(), false);
+    for (qsizetype i = 0, j = 0; i < m_rows.size(); ++i) {
+        while (j < rows.size() && rows.at(j) < m_rows.at(i)) {
+            ++j;
+        }
+        keep[i] = j < rows.size() && rows.at(j) == m_rows.at(i);
+    }
+    for (qsizetype last = m_rows.size() - 1; last >= 0; --last) {
+        if (keep.at(last)) {
+            continue;
+        }
+        qsizetype first = last;
+        while (first > 0 && !keep.at(first - 1)) {
+            --first;
+        }
+        beginRemoveRows(QModelIndex(), first, last);
+        m_rows.remove(first, last - first + 1);
+        endRemoveRows();
+        last = first;
+    }
+
+    // Then insertions: m_rows is now a subsequence of rows
+    for (qsizetype i = 0; i < rows.size();) {
+        if (i < m_rows.size() && m_rows.at(i) == rows.at(i)) {
+            ++i;
+            continue;
+        }
+        qsizetype end = i;
+        while (end < rows.size() && (i >= m_rows.size() || rows.at(end) != m_rows.at(i))) {
+            ++end;
+        }
+        beginInsertRows(QModelIndex(), i, end - 1);
+        m_rows.insert(i, end - i, 0);
+        std::copy(rows.cbegin() + i, rows.cbegin() + end, m_rows.begin() + i);
+        endInsertRows();
+        i = end;
+    }
+}
+
+void PlaylistFilterModel::sourceRowsAboutToBeInserted(const QModelIndex &parent, int first, int last)
+{
+    if (!isFiltering()) {
+        beginInsertRows(parent, first, last);
+    }
+}
+
+void PlaylistFilterModel::sourceRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent);
+    if (!isFiltering()) {
+        endInsertRows();
+        return;
+    }
+    // The rows shown keep their place; new matches come with the refresh
+    const int count = last - first + 1;
+    for (int &row : m_rows) {
+        if (row >= first) {
+            row += count;
+        }
+    }
+    if (!m_refreshTimer->isActive()) {
+        m_refreshTimer->start();
+    }
+}
+
+void PlaylistFilterModel::sourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (!isFiltering()) {
+        beginRemoveRows(parent, first, last);
+        m_removing = true;
+        return;
+    }
+
+    // Only announced here: m_rows must keep mapping to the source rows
+    // until the source has removed them
+    const auto begin = std::lower_bound(m_rows.cbegin(), m_rows.cend(), first);
+    const auto end = std::upper_bound(begin, m_rows.cend(), last);
+    if (begin != end) {
+        beginRemoveRows(QModelIndex(), begin - m_rows.cbegin(), end - m_rows.cbegin() - 1);
+        m_removing = true;
+    }
+}
+
+void PlaylistFilterModel::sourceRowsRemoved(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent);
+    if (!isFiltering()) {
+        if (m_removing) {
+            m_removing = false;
+            endRemoveRows();
+        }
+        return;
+    }
+
+    const auto begin = std::lower_bound(m_rows.begin(), m_rows.end(), first);
+    const auto end = std::upper_bound(begin, m_rows.end(), last);
+    const int count = last - first + 1;
+    for (auto it = end; it != m_rows.end(); ++it) {
+        *it -= count;
+    }
+    m_rows.erase(begin, end);
+    if (m_removing) {
+        m_removing = false;
+        endRemoveRows();
+    }
+}
+
+void PlaylistFilterModel::sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight,
+                                            const QList<int> &roles)
+{
+    if (!isFiltering()) {
+        emit dataChanged(index(topLeft.row(), topLeft.column()), index(bottomRight.row(), bottomRight.column()),
+                         roles);
+        return;
+    }
+    const auto begin = std::lower_bound(m_rows.cbegin(), m_rows.cend(), topLeft.row());
+    const auto end = std::upper_bound(begin, m_rows.cend(), bottomRight.row());
+    if (begin != end) {
+        emit dataChanged(index(begin - m_rows.cbegin(), topLeft.column()),
+                         index(end - m_rows.cbegin() - 1, bottomRight.column()), roles);
+    }
+}
+
+void PlaylistFilterModel::sourceModelReset()
+{
+    m_refreshTimer->stop();
+    m_rows = isFiltering() ? m_source->playlist()->search(m_query) : QList<int>();
+    endResetModel();
+}
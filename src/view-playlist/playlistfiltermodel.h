@@ -0,0 +1,55 @@
+#ifndef PLAYLISTFILTERMODEL_H
+#define PLAYLISTFILTERMODEL_H
+
+#include <QAbstractProxyModel>
+#include <QTimer>
+
+#include "playlistmodel.h"
+
+// The rows of a PlaylistModel that match a search query.
+//
+// Only the source row numbers of the matches are kept, and everything else
+// is read through the source model. Without a query it passes every row
+// through, so it can stay on the view. The matches come from the playlist's
+// search index; as metadata arrives and rows are added they are looked up
+// again, after a short delay, and only the rows that differ are inserted or
+// removed.
+class PlaylistFilterModel : public QAbstractProxyModel
+{
+    Q_OBJECT
+public:
+    explicit PlaylistFilterModel(PlaylistModel *source, QObject *parent = nullptr);
+
+    void setQuery(const QString &query);
+    QString query() const;
+    bool isFiltering() const;
+
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const override;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const override;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+
+private:
+    PlaylistModel *m_source = nullptr;
+    QString m_query;
+    QList<int> m_rows; // source rows shown, ascending; only used with a query
+    QTimer *m_refreshTimer = nullptr;
+    bool m_removing = false;
+
+    int proxyRow(int sourceRow) const;
+    void refresh();
+    void applyRows(const QList<int> &rows);
+
+    void sourceRowsAboutToBeInserted(const QModelIndex &parent, int first, int last);
+    void sourceRowsInserted(const QModelIndex &parent, int first, int last);
+    void sourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    void sourceRowsRemoved(const QModelIndex &parent, int first, int last);
+    void sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight,
+                           const QList<int> &roles);
+    void sourceModelReset();
+};
+
+#endif // PLAYLISTFILTERMODEL_H
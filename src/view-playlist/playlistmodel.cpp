@@ -10,8 +10,6 @@
 #include <QUrl>
 #include <QMimeData>
 
-#include <utility>
-
 PlaylistModel::PlaylistModel(QObject *parent) : QAbstractItemModel(parent)
 {
     m_playlist.reset(new QMediaPlaylist);
@@ -23,13 +21,20 @@ PlaylistModel::PlaylistModel(QObject *parent) : QAbstractItemModel(parent)
             &PlaylistModel::beginRemoveItems);
     connect(m_playlist.data(), &QMediaPlaylist::mediaRemoved, this, &PlaylistModel::endRemoveItems);
     connect(m_playlist.data(), &QMediaPlaylist::mediaChanged, this, &PlaylistModel::changeItems);
+    // Moves update the current index without currentIndexChanged()
+    connect(m_playlist.data(), &QMediaPlaylist::orderChanged, this,
+            [this]() { m_currentRow = m_playlist->currentIndex(); });
+    connect(m_playlist.data(), &QMediaPlaylist::currentIndexChanged, this,
+            &PlaylistModel::handleCurrentIndexChanged);
 }
 
 PlaylistModel::~PlaylistModel() = default;
 
 int PlaylistModel::rowCount(const QModelIndex &parent) const
 {
-    return m_playlist && !parent.isValid() ? m_playlist->mediaCount() : 0;
+    // The rows the view was told about, which may trail the playlist while
+    // it reports a removal
+    return m_playlist && !parent.isValid() ? int(m_rows.size()) : 0;
 }
 
 int PlaylistModel::columnCount(const QModelIndex &parent) const
@@ -42,16 +47,12 @@ bool PlaylistModel::removeRows(int row, int count, const QModelIndex &parent)
     if (parent.isValid())
         return false;
 
-    int endRow = row + (count - 1);
-    for(int i = row; i <= endRow; i++) {
-        m_playlist->removeMedia(i);
-    }
-    return true;
+    return m_playlist->removeMedia(row, row + count - 1);
 }
 
 QModelIndex PlaylistModel::index(int row, int column, const QModelIndex &parent) const
 {
-    return m_playlist && !parent.isValid() && row >= 0 && row < m_playlist->mediaCount()
+    return m_playlist && !parent.isValid() && row >= 0 && row < m_rows.size()
                     && column >= 0 && column < ColumnCount
             ? createIndex(row, column)
             : QModelIndex();
@@ -107,31 +108,50 @@ QVariant PlaylistModel::headerData(int section, Qt::Orientation orientation, int
 QVariant PlaylistModel::data(const QModelIndex &index, int role) const
 {
     if (index.isValid() && role == Qt::DisplayRole) {
-        QMediaMetaData meta = m_playlist->mediaMetadata(index.row());
-
-        // If the current track is playing, add play icon
-        QString playIcon = "   ";
-        int currentIndex = m_playlist->currentIndex();
-        if(currentIndex == index.row()) {
-            playIcon = " ▶ ";
-        }
+        const RowCache &row = rowCache(index.row());
 
         switch(index.column()) {
         case Track:
-            return playIcon + meta.value(QMediaMetaData::TrackNumber).toString();
+            // If the current track is playing, add play icon
+            if(m_playlist->currentIndex() == index.row()) {
+                return " ▶ " + row.track;
+            }
+            return "   " + row.track;
         case Title:
-            return meta.value(QMediaMetaData::Title);
+            return row.title;
         case Artist:
-            return meta.value(QMediaMetaData::AlbumArtist);
+            return row.artist;
         case Album:
-            return meta.value(QMediaMetaData::AlbumTitle);
+            return row.album;
         case Duration:
-            return formatDuration(meta.value(QMediaMetaData::Duration).toLongLong());
+            return row.duration;
         }
     }
     return QVariant();
 }
 
+const PlaylistModel::RowCache &PlaylistModel::rowCache(int row) const
+{
+    if(m_rows.size() != m_playlist->mediaCount()) {
+        // Out of step with the playlist, start over
+        m_rows = QList<RowCache>(m_playlist->mediaCount());
+    }
+
+    RowCache &cache = m_rows[row];
+    if(!cache.valid) {
+        const TrackStore &tracks = m_playlist->tracks();
+        const TrackStore::TrackId id = m_playlist->mediaTrack(row);
+        const int trackNumber = tracks.trackNumber(id);
+        cache.track = trackNumber ? QString::number(trackNumber) : QString();
+        cache.title = tracks.title(id);
+        cache.artist = tracks.artist(id);
+        cache.album = tracks.album(id);
+        cache.duration = formatDuration(tracks.duration(id));
+        cache.valid = true;
+    }
+    return cache;
+}
+
 QMediaPlaylist *PlaylistModel::playlist() const
 {
     return m_playlist.data();
@@ -148,6 +168,10 @@ bool PlaylistModel::setData(const QModelIndex &index, const QVariant &value, int
 void PlaylistModel::beginInsertItems(int start, int end)
 {
     beginInsertRows(QModelIndex(), start, end);
+    m_rows.insert(start, end - start + 1, RowCache());
+    if(m_currentRow >= start) {
+        m_currentRow += end - start + 1;
+    }
 }
 
 void PlaylistModel::endInsertItems()
@@ -158,17 +182,43 @@ void PlaylistModel::endInsertItems()
 void PlaylistModel::beginRemoveItems(int start, int end)
 {
     beginRemoveRows(QModelIndex(), start, end);
+    m_rows.remove(start, end - start + 1);
+    // The playlist changes its current index itself, without a signal
+    if(m_currentRow > end) {
+        m_currentRow -= end - start + 1;
+    } else if(m_currentRow >= start) {
+        m_currentRow = -1;
+    }
 }
 
 void PlaylistModel::endRemoveItems()
 {
     endRemoveRows();
-    emit dataChanged(index(0, 0), index(m_playlist->mediaCount(), ColumnCount));
 }
 
 void PlaylistModel::changeItems(int start, int end)
 {
-    emit dataChanged(index(start, 0), index(end, ColumnCount));
+    end = qMin(end, int(m_rows.size()) - 1);
+    if(start > end) {
+        return;
+    }
+    for(int i = start; i <= end; i++) {
+        m_rows[i].valid = false;
+    }
+    emit dataChanged(index(start, 0), index(end, ColumnCount - 1));
+}
+
+void PlaylistModel::handleCurrentIndexChanged(int index)
+{
+    // Only the play icon moves: repaint the track cell of both rows
+    const int previous = m_currentRow;
+    m_currentRow = index;
+    for(int row : { previous, index }) {
+        if(row >= 0 && row < rowCount()) {
+            const QModelIndex cell = this->index(row, Track);
+            emit dataChanged(cell, cell);
+        }
+    }
 }
 
 Qt::ItemFlags PlaylistModel::flags(const QModelIndex &index) const
@@ -242,33 +292,16 @@ bool PlaylistModel::dropMimeData(const QMimeData *data, Qt::DropAction action, i
 
     QByteArray encodedData = data->data(PlaylistModel::MimeType);
     QDataStream stream(&encodedData, QIODevice::ReadOnly);
-    QStringList newItems;
-    int rows = 0;
+    QList<int> rows;
 
     while (!stream.atEnd()) {
         QString text;
         stream >> text;
-        newItems << text;
-        ++rows;
+        rows << text.toInt();
     }
 
-    insertRows(row, rows, QModelIndex());
-    for (const QString &originalIdx : std::as_const(newItems))
-    {
-        int newIndex = row;
-
-        // Special case when moving to the bottom of the list
-        int mediaCount = m_playlist->mediaCount();
-        int maxIndex = mediaCount - 1;
-        if(newIndex > maxIndex) {
-            newIndex = maxIndex;
-        }
-
-        m_playlist->moveMedia(originalIdx.toInt(), newIndex);
-        //m_playlist->setCurrentIndex(newIndex); // TODO set selection instead of currentIndex
-
-        row++;
-    }
+    // All dragged items move as one block, in a single playlist change
+    m_playlist->moveMedia(rows, row);
 
     return true;
 }
@@ -57,9 +57,24 @@ private slots:
     void beginRemoveItems(int start, int end);
     void endRemoveItems();
     void changeItems(int start, int end);
+    void handleCurrentIndexChanged(int index);
 
 private:
     QScopedPointer<QMediaPlaylist> m_playlist;
+
+    // Display strings of a row, built on its first paint and dropped when
+    // the playlist reports the row changed
+    struct RowCache {
+        QString track;
+        QString title;
+        QString artist;
+        QString album;
+        QString duration;
+        bool valid = false;
+    };
+    mutable QList<RowCache> m_rows;
+    int m_currentRow = -1; // row showing the play icon
+    const RowCache &rowCache(int row) const;
 };
 
 #endif // PLAYLISTMODEL_H
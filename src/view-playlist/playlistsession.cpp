@@ -0,0 +1,151 @@
+#include "playlistsession.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+
+namespace {
+constexpr int SAVE_DELAY_MS = 10000;
+
+const char *const PLAYLIST_FILE = "/session.m3u";
+const char *const SNAPSHOT_FILE = "/session.snapshot";
+} // namespace
+
+PlaylistSession::PlaylistSession(QMediaPlaylist *playlist, QObject *parent)
+    : QObject{parent}
+    , m_playlist(playlist)
+{
+    m_directory = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+
+    m_saveTimer = new QTimer(this);
+    m_saveTimer->setSingleShot(true);
+    m_saveTimer->setInterval(SAVE_DELAY_MS);
+    connect(m_saveTimer, &QTimer::timeout, this, &PlaylistSession::save);
+
+    connect(m_playlist, &QMediaPlaylist::mediaInserted, this, &PlaylistSession::markPlaylistDirty);
+    connect(m_playlist, &QMediaPlaylist::mediaRemoved, this, &PlaylistSession::markPlaylistDirty);
+    connect(m_playlist, &QMediaPlaylist::orderChanged, this, &PlaylistSession::markPlaylistDirty);
+    // Metadata is only worth a rewrite at quit, to spare the next start parsing again
+    connect(m_playlist, &QMediaPlaylist::mediaChanged, this, [this]() { m_metaDataDirty = true; });
+    connect(m_playlist, &QMediaPlaylist::currentIndexChanged, this, &PlaylistSession::markPositionDirty);
+
+    // Not from the destructor: by then the playlist may be gone
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &PlaylistSession::saveOnQuit);
+}
+
+qint64 PlaylistSession::restore()
+{
+    QFile file(m_directory + SNAPSHOT_FILE);
+    bool restored = false;
+    if (file.open(QIODevice::ReadOnly) && file.size() > 0) {
+        const uchar *data = file.map(0, file.size());
+        if (data != nullptr) {
+            // Read in place: the snapshot is never copied into memory
+            restored = m_playlist->restoreSnapshot(
+                    QByteArray::fromRawData(reinterpret_cast<const char *>(data), file.size()));
+            file.unmap(const_cast<uchar *>(data));
+        }
+    }
+    file.close();
+
+    if (!restored) {
+        // No usable snapshot: the M3U still has the tracks, if not their order
+        const QString playlistPath = m_directory + PLAYLIST_FILE;
+        if (!QFile::exists(playlistPath)) {
+            return -1;
+        }
+        m_playlist->load(QUrl::fromLocalFile(playlistPath));
+    }
+
+    QSettings settings;
+    settings.beginGroup("session");
+    const QUrl url = settings.value("url").toUrl();
+    const int queueIndex = settings.value("queueIndex", -1).toInt();
+    const qint64 position = settings.value("position", 0).toLongLong();
+    settings.endGroup();
+
+    // The snapshot's current track is as of its last save; the settings
+    // have the one played last
+    if (restored && queueIndex >= 0 && queueIndex < m_playlist->mediaCount()
+        && queueIndex != m_playlist->currentQueueIndex()) {
+        m_playlist->setCurrentQueueIndex(queueIndex);
+    }
+
+    // Restoring isn't a change worth saving
+    m_saveTimer->stop();
+    m_playlistDirty = false;
+    m_metaDataDirty = false;
+    m_positionDirty = false;
+
+    if (!restored || url.isEmpty() || url != m_playlist->currentQueueMedia()) {
+        return -1;
+    }
+    return position;
+}
+
+void PlaylistSession::setPlaybackClock(const PlaybackClock *clock)
+{
+    m_clock = clock;
+}
+
+void PlaylistSession::markPositionDirty()
+{
+    m_positionDirty = true;
+    scheduleSave();
+}
+
+void PlaylistSession::save()
+{
+    m_saveTimer->stop();
+
+    if (m_playlistDirty) {
+        m_playlistDirty = false;
+        m_metaDataDirty = false;
+        QDir().mkpath(m_directory);
+
+        if (!m_playlist->save(QUrl::fromLocalFile(m_directory + PLAYLIST_FILE))) {
+            qDebug() << "PlaylistSession: could not save playlist:" << m_playlist->errorString();
+        }
+
+        QSaveFile file(m_directory + SNAPSHOT_FILE);
+        if (!file.open(QIODevice::WriteOnly) || !m_playlist->saveSnapshot(&file) || !file.commit()) {
+            qDebug() << "PlaylistSession: could not save snapshot to" << file.fileName();
+        }
+    }
+
+    if (m_positionDirty) {
+        m_positionDirty = false;
+        QSettings settings;
+        settings.beginGroup("session");
+        settings.setValue("url", m_playlist->currentQueueMedia());
+        settings.setValue("queueIndex", m_playlist->currentQueueIndex());
+        settings.setValue("position", m_clock ? m_clock->positionMs() : 0);
+        settings.endGroup();
+    }
+}
+
+void PlaylistSession::markPlaylistDirty()
+{
+    m_playlistDirty = true;
+    // The current track may have moved in the playqueue
+    m_positionDirty = true;
+    scheduleSave();
+}
+
+void PlaylistSession::saveOnQuit()
+{
+    m_playlistDirty = m_playlistDirty || m_metaDataDirty;
+    save();
+}
+
+void PlaylistSession::scheduleSave()
+{
+    // Not restarted on every change, so steady playback still gets saved
+    if (!m_saveTimer->isActive()) {
+        m_saveTimer->start();
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef PLAYLISTSESSION_H
+#define PLAYLISTSESSION_H
+
+#include <QObject>
+#include <QTimer>
+
+#include "playbackclock.h"
+#include "qmediaplaylist.h"
+
+// Keeps the playlist, its play order, the current track and the playback
+// position across restarts.
+//
+// The playlist is saved twice, both through QSaveFile: as extended M3U for
+// people and other players, and as a binary snapshot with the metadata of
+// every track, which restore() maps and loads without parsing any file.
+// Tracks being added, removed, moved or shuffled are saved together at most
+// once every SAVE_DELAY_MS, and when the application quits. Metadata
+// arriving for tracks already there only rewrites the files at quit.
+//
+// The current track and position go to the settings instead, so playback
+// and skipping between tracks don't rewrite the playlist. The position is
+// read from the player's clock when saving, so it is where playback
+// actually was.
+class PlaylistSession : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PlaylistSession(QMediaPlaylist *playlist, QObject *parent = nullptr);
+
+    // Loads the last session into the playlist, which must be empty.
+    // Returns the position to resume the current track from, in ms, or -1.
+    qint64 restore();
+
+    // Clock the saved position is read from
+    void setPlaybackClock(const PlaybackClock *clock);
+    // Schedules saving the position, which has moved since the last save
+    void markPositionDirty();
+    void save();
+
+private:
+    QMediaPlaylist *m_playlist = nullptr;
+    const PlaybackClock *m_clock = nullptr;
+    QTimer *m_saveTimer = nullptr;
+    QString m_directory;
+    bool m_playlistDirty = false;
+    bool m_metaDataDirty = false;
+    bool m_positionDirty = false;
+
+    void markPlaylistDirty();
+    void saveOnQuit();
+    void scheduleSave();
+};
+
+#endif // PLAYLISTSESSION_H
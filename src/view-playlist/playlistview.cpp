@@ -1,8 +1,8 @@
 #include "playlistview.h"
 #include "ui_playlistview.h"
-#include "filebrowsericonprovider.h"
 #include "util.h"
-#include <QFileIconProvider>
+#include <QDir>
+#include <QScrollBar>
 #include <QStandardPaths>
 
 const QString HOME_PATH = QStandardPaths::standardLocations(QStandardPaths::MusicLocation).first();
@@ -31,11 +31,13 @@ PlaylistView::PlaylistView(QWidget *parent, PlaylistModel *playlistModel) :
     connect(ui->fbSelectButton, &QPushButton::clicked, this, &PlaylistView::fbToggleSelect);
     connect(ui->fbAddButton, &QPushButton::clicked, this, &PlaylistView::fbAdd);
     connect(ui->fileBrowserListView, &QAbstractItemView::clicked, this, &PlaylistView::fbItemClicked);
+    connect(ui->fbScanButton, &QPushButton::clicked, this, &PlaylistView::fbCancelScan);
 
-    connect(m_playlist, &QMediaPlaylist::mediaChanged, this, &PlaylistView::updateTotalDuration);
-    connect(m_playlist, &QMediaPlaylist::mediaInserted, this, &PlaylistView::updateTotalDuration);
-    connect(m_playlist, &QMediaPlaylist::mediaRemoved, this, &PlaylistView::updateTotalDuration);
+    connect(m_playlist, &QMediaPlaylist::totalsChanged, this, &PlaylistView::updateTotalDuration);
     connect(m_playlist, &QMediaPlaylist::currentSelectionChanged, this, &PlaylistView::handleSelectionChanged);
+    connect(m_playlist, &QMediaPlaylist::mediaInserted, this, &PlaylistView::prioritizeVisibleRows);
+    connect(ui->playList->verticalScrollBar(), &QScrollBar::valueChanged, this,
+            &PlaylistView::prioritizeVisibleRows);
 
     connect(ui->editButton, &QPushButton::clicked, this, &PlaylistView::toggleEditMode);
 
@@ -50,7 +52,7 @@ PlaylistView::~PlaylistView()
 void PlaylistView::playlistPositionChanged(int currentItem)
 {
     if (ui->playList) {
-        ui->playList->setCurrentIndex(m_playlistModel->index(currentItem, 0));
+        ui->playList->setCurrentIndex(m_filterModel->mapFromSource(m_playlistModel->index(currentItem, 0)));
         ui->playList->update(); // Force refresh for making sure play icon is updated correctly
     }
 }
@@ -62,8 +64,15 @@ void PlaylistView::clearPlaylist()
 
 void PlaylistView::removeItem()
 {
-    QModelIndex selection = ui->playList->selectionModel()->currentIndex();
-    m_playlistModel->removeRow(selection.row());
+    // Every selected row at once, falling back to the current one
+    QList<int> rows;
+    for (const QModelIndex &index : ui->playList->selectionModel()->selectedRows()) {
+        rows.append(m_filterModel->mapToSource(index).row());
+    }
+    if (rows.isEmpty()) {
+        rows.append(m_filterModel->mapToSource(ui->playList->selectionModel()->currentIndex()).row());
+    }
+    m_playlist->removeMedia(rows);
 }
 
 
@@ -86,8 +95,27 @@ void PlaylistView::setupPlayListUi()
     m_playlistViewScroller->grabGesture(ui->playList, QScroller::LeftMouseButtonGesture);
     m_playlistViewScroller->setScrollerProperties(sp);
 
-    ui->playList->setModel(m_playlistModel);
-    ui->playList->setCurrentIndex(m_playlistModel->index(m_playlist->currentIndex(), 0));
+    // Rows are shown through the search filter, which passes all of them
+    // while the search field is empty
+    m_filterModel = new PlaylistFilterModel(m_playlistModel, this);
+    ui->playList->setModel(m_filterModel);
+    ui->playList->setCurrentIndex(
+            m_filterModel->mapFromSource(m_playlistModel->index(m_playlist->currentIndex(), 0)));
+    connect(ui->searchField, &QLineEdit::textChanged, this, &PlaylistView::search);
+
+    // Offers the library tracks matching the search that aren't in the playlist
+    m_libraryButton = new QPushButton(this);
+    m_libraryButton->setMinimumHeight(40);
+    m_libraryButton->setFont(ui->searchField->font());
+    m_libraryButton->setStyleSheet("QPushButton { color: #00e800; background-color: #000000; border: 0px;"
+                                   " border-left: 3px solid #26253c; border-right: 3px solid #6d6d7f;"
+                                   " padding-left: 8px; text-align: left; }"
+                                   "QPushButton:pressed { background-color: #26253c; }");
+    m_libraryButton->hide();
+    ui->verticalLayout_4->insertWidget(ui->verticalLayout_4->indexOf(ui->searchField) + 1, m_libraryButton);
+    connect(m_libraryButton, &QPushButton::clicked, this, &PlaylistView::addLibraryMatches);
+    connect(m_playlist, &QMediaPlaylist::mediaInserted, this, &PlaylistView::updateLibraryMatches);
+    connect(m_playlist, &QMediaPlaylist::mediaRemoved, this, &PlaylistView::updateLibraryMatches);
 
     ui->playList->setSortingEnabled(false);
     ui->playList->setIndentation(0);
@@ -111,20 +139,17 @@ void PlaylistView::setupPlayListUi()
 
 void PlaylistView::setupFileBrowserUi()
 {
-    m_fileSystemModel = new QFileSystemModel(this);
-    // filter only folders and audio files
-    QStringList filters = audioFileFilters();
-    m_fileSystemModel->setNameFilters(filters);
-    m_fileSystemModel->setNameFilterDisables(false); // Hide filtered files
-
-    FileBrowserIconProvider *iconProvider = new FileBrowserIconProvider();
-    iconProvider->setOptions(QFileIconProvider::DontUseCustomDirectoryIcons);
-    m_fileSystemModel->setIconProvider(iconProvider);
-
-    ui->fileBrowserListView->setModel(m_fileSystemModel);
+    // Lists only folders and audio files
+    m_directoryModel = new DirectoryModel(this);
+    ui->fileBrowserListView->setModel(m_directoryModel);
     ui->fileBrowserListView->setSelectionMode(QAbstractItemView::MultiSelection);
     ui->fileBrowserListView->setFocusPolicy(Qt::FocusPolicy::NoFocus);
 
+    m_folderScanner = new FolderScanner(this);
+    connect(m_folderScanner, &FolderScanner::filesFound, this, &PlaylistView::fbFilesScanned);
+    connect(m_folderScanner, &FolderScanner::finished, this, &PlaylistView::fbScanFinished);
+    ui->fbScanButton->hide();
+
     fbCd(HOME_PATH);
 
     // Add touch scroll to playList
@@ -149,8 +174,7 @@ void PlaylistView::setupFileBrowserUi()
 void PlaylistView::fbCd(QString path)
 {
     ui->fileBrowserListView->clearSelection();
-    m_fileSystemModel->setRootPath(path);
-    ui->fileBrowserListView->setRootIndex(m_fileSystemModel->index(path));
+    m_directoryModel->setDirectory(path);
 }
 
 void PlaylistView::fbGoHome()
@@ -160,7 +184,7 @@ void PlaylistView::fbGoHome()
 
 void PlaylistView::fbGoUp()
 {
-    QDir dir = QDir(m_fileSystemModel->rootDirectory());
+    QDir dir = QDir(m_directoryModel->directory());
     dir.cdUp();
     fbCd(dir.absolutePath());
 }
@@ -168,11 +192,16 @@ void PlaylistView::fbGoUp()
 void PlaylistView::fbAdd()
 {
     QList<QUrl> files;
+    QStringList folders;
 
     QModelIndexList selIndexes = ui->fileBrowserListView->selectionModel()->selectedIndexes();
 
     for(QModelIndex index : selIndexes) {
-        QUrl url = QUrl::fromLocalFile(m_fileSystemModel->filePath(index));
+        if(m_directoryModel->isDir(index)) {
+            folders.append(m_directoryModel->filePath(index));
+            continue;
+        }
+        QUrl url = QUrl::fromLocalFile(m_directoryModel->filePath(index));
         // Filter only allowed audio files by extension
         if(isAudioFile(url.fileName())) {
             files.append(url);
@@ -183,20 +212,27 @@ void PlaylistView::fbAdd()
     ui->fileBrowserListView->clearSelection();
 
     emit addSelectedFilesClicked(files);
+
+    // Folders are scanned in the background and their files added as found
+    if(!folders.isEmpty()) {
+        if(!m_folderScanner->isScanning()) {
+            m_scannedFiles = 0;
+        }
+        m_folderScanner->scan(folders);
+        ui->fbScanButton->setText(tr("CANCEL %1").arg(m_scannedFiles));
+        ui->fbScanButton->show();
+    }
 }
 
 void PlaylistView::fbToggleSelect()
 {
     qsizetype nSelected = ui->fileBrowserListView->selectionModel()->selectedIndexes().length();
-    qsizetype total = m_fileSystemModel->rowCount(m_fileSystemModel->index(m_fileSystemModel->rootPath()));
+    qsizetype total = m_directoryModel->rowCount();
     if(nSelected == total) {
         ui->fileBrowserListView->clearSelection();
     } else {
-        QModelIndex currentIndex = m_fileSystemModel->index(m_fileSystemModel->rootPath());
-        int numRows = m_fileSystemModel->rowCount(currentIndex);
-
-        for (int row = 0; row < numRows; ++row) {
-            QModelIndex childIndex = m_fileSystemModel->index(row, 0, currentIndex);
+        for (int row = 0; row < total; ++row) {
+            QModelIndex childIndex = m_directoryModel->index(row, 0);
             ui->fileBrowserListView->selectionModel()->select(childIndex, QItemSelectionModel::Select);
         }
     }
@@ -204,22 +240,108 @@ void PlaylistView::fbToggleSelect()
 
 void PlaylistView::fbItemClicked(const QModelIndex &index)
 {
-    if(m_fileSystemModel->isDir(index)) {
-        fbCd(m_fileSystemModel->filePath(index));
+    if(m_directoryModel->isDir(index)) {
+        fbCd(m_directoryModel->filePath(index));
     }
 }
 
+void PlaylistView::fbFilesScanned(const QList<QUrl> &urls)
+{
+    m_scannedFiles += urls.size();
+    ui->fbScanButton->setText(tr("CANCEL %1").arg(m_scannedFiles));
+    emit addSelectedFilesClicked(urls);
+}
+
+void PlaylistView::fbScanFinished()
+{
+    ui->fbScanButton->hide();
+}
+
+void PlaylistView::fbCancelScan()
+{
+    m_folderScanner->cancel();
+    ui->fbScanButton->hide();
+}
+
 void PlaylistView::updateTotalDuration()
 {
     qint64 total = m_playlist->totalDuration();
-    ui->plDuration->setText(formatDuration(total));
+    // Some durations are still being read
+    const QString prefix = m_playlist->isTotalDurationExact() ? QString() : QStringLiteral("\u2248");
+    ui->plDuration->setText(prefix + formatDuration(total));
+}
+
+void PlaylistView::prioritizeVisibleRows()
+{
+    // Rows on screen get their metadata parsed first
+    const QModelIndex first = ui->playList->indexAt(QPoint(0, 0));
+    if (!first.isValid()) {
+        return;
+    }
+    const QModelIndex last = ui->playList->indexAt(QPoint(0, ui->playList->viewport()->height() - 1));
+    if (m_filterModel->isFiltering()) {
+        // Matches are scattered over the playlist: one at a time
+        const int lastRow = last.isValid() ? last.row() : m_filterModel->rowCount() - 1;
+        for (int row = first.row(); row <= lastRow; ++row) {
+            const int sourceRow = m_filterModel->mapToSource(m_filterModel->index(row, 0)).row();
+            m_playlist->prioritizeMetadata(sourceRow, sourceRow);
+        }
+        return;
+    }
+    m_playlist->prioritizeMetadata(first.row(), last.isValid() ? last.row() : m_playlist->mediaCount() - 1);
+}
+
+void PlaylistView::setLibrary(MusicLibrary *library)
+{
+    m_library = library;
+    // A new index renumbers its tracks
+    connect(m_library, &MusicLibrary::changed, this, &PlaylistView::updateLibraryMatches);
+    connect(m_library, &MusicLibrary::searchReady, this, &PlaylistView::updateLibraryMatches);
+    updateLibraryMatches();
+}
+
+void PlaylistView::search(const QString &query)
+{
+    m_filterModel->setQuery(query);
+    updateLibraryMatches();
+    // Reordering only makes sense over the whole playlist
+    if (m_filterModel->isFiltering() && ui->editButton->isChecked()) {
+        ui->editButton->setChecked(false);
+        toggleEditMode();
+    }
+    ui->editButton->setEnabled(!m_filterModel->isFiltering());
+    prioritizeVisibleRows();
+}
+
+void PlaylistView::updateLibraryMatches()
+{
+    m_libraryMatches.clear();
+    if (m_library && m_filterModel->isFiltering()) {
+        const LibraryIndex &index = m_library->index();
+        const TrackStore &tracks = m_playlist->tracks();
+        for (LibraryIndex::TrackId id : m_library->search(m_filterModel->query())) {
+            if (tracks.find(index.url(id)) == TrackStore::INVALID_TRACK) {
+                m_libraryMatches.append(id);
+            }
+        }
+    }
+
+    m_libraryButton->setText(tr("+ %1 FROM LIBRARY").arg(m_libraryMatches.size()));
+    m_libraryButton->setVisible(!m_libraryMatches.isEmpty());
+}
+
+void PlaylistView::addLibraryMatches()
+{
+    if (m_library && !m_libraryMatches.isEmpty()) {
+        m_playlist->addMedia(m_library->index(), m_libraryMatches);
+    }
 }
 
 void PlaylistView::handleSongSelected(const QModelIndex &index)
 {
     bool inEditMode = ui->editButton->isChecked();
     if(!inEditMode) {
-        emit songSelected(index);
+        emit songSelected(m_filterModel->mapToSource(index));
     }
 }
 
@@ -242,7 +364,7 @@ void PlaylistView::handleSelectionChanged(int index)
 {
     if(index < 0)
         return;
-    auto idx = m_playlistModel->index(index, 0);
+    auto idx = m_filterModel->mapFromSource(m_playlistModel->index(index, 0));
     ui->playList->selectionModel()->setCurrentIndex(idx,
                                                     QItemSelectionModel::SelectionFlag::Rows |
                                                     QItemSelectionModel::SelectionFlag::SelectCurrent);
@@ -2,11 +2,15 @@
 #define PLAYLISTVIEW_H
 
 #include <QWidget>
+#include <QPushButton>
 #include <QUrl>
-#include <QFileSystemModel>
 #include <QScroller>
+#include "musiclibrary.h"
 #include "qmediaplaylist.h"
 #include "playlistmodel.h"
+#include "playlistfiltermodel.h"
+#include "folderscanner.h"
+#include "directorymodel.h"
 
 namespace Ui {
 class PlaylistView;
@@ -20,12 +24,21 @@ public:
     explicit PlaylistView(QWidget *parent = nullptr, PlaylistModel *playlistModel = nullptr);
     ~PlaylistView();
 
+    // Library searched along with the playlist
+    void setLibrary(MusicLibrary *library);
+
 private:
     Ui::PlaylistView *ui;
     QMediaPlaylist *m_playlist = nullptr;
     PlaylistModel *m_playlistModel = nullptr;
-    QFileSystemModel *m_fileSystemModel = nullptr;
+    PlaylistFilterModel *m_filterModel = nullptr; // what the playlist view shows
+    DirectoryModel *m_directoryModel = nullptr;
     QScroller *m_playlistViewScroller = nullptr;
+    FolderScanner *m_folderScanner = nullptr;
+    int m_scannedFiles = 0;
+    MusicLibrary *m_library = nullptr;
+    QPushButton *m_libraryButton = nullptr;
+    QList<LibraryIndex::TrackId> m_libraryMatches; // not in the playlist yet
 
     void setupPlayListUi();
     void setupFileBrowserUi();
@@ -48,7 +61,15 @@ private slots:
 
     void fbItemClicked(const QModelIndex &index);
 
+    void fbFilesScanned(const QList<QUrl> &urls);
+    void fbScanFinished();
+    void fbCancelScan();
+
     void updateTotalDuration();
+    void prioritizeVisibleRows();
+    void search(const QString &query);
+    void updateLibraryMatches();
+    void addLibraryMatches();
 
     void toggleEditMode();
 
@@ -4,14 +4,19 @@
 #include "qmediaplaylist.h"
 #include "qmediaplaylist_p.h"
 #include "qplaylistfileparser.h"
+#include "metadatacache.h"
+#include "metadataloader.h"
 #include "util.h"
 
 #include <QCoreApplication>
 #include <QFile>
 #include <QList>
-#include <QRandomGenerator>
+#include <QSaveFile>
 #include <QUrl>
 
+#include <algorithm>
+#include <numeric>
+
 // Useful for debugging:
 /*
 void printList(QList<QUrl> list)
@@ -25,23 +30,50 @@ void printList(QList<QUrl> list)
 
 QT_BEGIN_NAMESPACE
 
+namespace {
+constexpr quint32 SNAPSHOT_MAGIC = 0x4c504c53; // "LPLS"
+constexpr quint32 SNAPSHOT_VERSION = 2;
+} // namespace
+
+// Writes extended M3U. Lines end in a plain "\n" rather than Qt::endl,
+// which would flush the stream on every entry.
 class QM3uPlaylistWriter
 {
 public:
     QM3uPlaylistWriter(QIODevice *device)
         : m_device(device), m_textStream(new QTextStream(m_device))
     {
+        *m_textStream << "#EXTM3U\n";
     }
 
     ~QM3uPlaylistWriter() { delete m_textStream; }
 
-    bool writeItem(const QUrl &item)
+    // duration in ms, 0 if unknown
+    bool writeItem(const QUrl &item, qint64 duration, const QString &artist, const QString &title)
     {
-        *m_textStream << item.toString() << Qt::endl;
+        *m_textStream << "#EXTINF:" << (duration > 0 ? qRound64(duration / 1000.0) : -1) << ',';
+        if (!artist.isEmpty())
+            *m_textStream << singleLine(artist) << " - ";
+        *m_textStream << singleLine(title) << '\n' << item.toString() << '\n';
         return true;
     }
 
+    bool finish()
+    {
+        m_textStream->flush();
+        return m_textStream->status() == QTextStream::Ok;
+    }
+
 private:
+    // Text is written as is, for other players to show; only line breaks,
+    // which would end the entry, are replaced
+    static QString singleLine(QString text)
+    {
+        text.replace(u'\r', u' ');
+        text.replace(u'\n', u' ');
+        return text;
+    }
+
     QIODevice *m_device;
     QTextStream *m_textStream;
 };
@@ -205,6 +237,9 @@ QMediaPlaylist::QMediaPlaylist(QObject *parent) : QObject(parent), d_ptr(new QMe
     Q_D(QMediaPlaylist);
 
     d->q_ptr = this;
+
+    m_metaDataLoader = new MetaDataLoader(this);
+    connect(m_metaDataLoader, &MetaDataLoader::metaDataReady, this, &QMediaPlaylist::applyMetadata);
 }
 
 /*!
@@ -251,6 +286,11 @@ void QMediaPlaylist::setShuffle(bool shuffle)
     }
 }
 
+bool QMediaPlaylist::isShuffled() const
+{
+    return shuffleEnabled;
+}
+
 
 /*!
   Returns position of the current media content in the playlist.
@@ -277,7 +317,7 @@ QUrl QMediaPlaylist::currentMedia() const
     Q_D(const QMediaPlaylist);
     if (d->currentPos() < 0 || d->currentPos() >= d->playlist.size())
         return QUrl();
-    return d_func()->playlist.at(d_func()->currentPos());
+    return m_tracks.url(d->playlist.at(d->currentPos()));
 }
 
 /*!
@@ -289,7 +329,7 @@ QUrl QMediaPlaylist::currentQueueMedia() const
     Q_D(const QMediaPlaylist);
     if (d->currentQueuePos() < 0 || d->currentQueuePos() >= d->playqueue.size())
         return QUrl();
-    return d_func()->playqueue.at(d_func()->currentQueuePos());
+    return m_tracks.url(d->playlist.at(d->playqueue.at(d->currentQueuePos())));
 }
 
 /*!
@@ -365,19 +405,36 @@ bool QMediaPlaylist::isEmpty() const
 }
 
 /*!
-  Returns the total duration of the playlist, by summing all track durations.
+  Returns the total duration of the playlist, the sum of all known track durations.
  */
 qint64 QMediaPlaylist::totalDuration() const
 {
-    qint64 total = 0;
-    for(int i = 0; i < mediaCount(); i++) {
-        QUrl url = media(i);
-        if(m_mediaMetadata.contains(url)) {
-            QMediaMetaData meta = m_mediaMetadata.value(media(i));
-            total += meta.value(QMediaMetaData::Duration).toLongLong();
-        }
-    }
-    return total;
+    return m_totalDuration;
+}
+
+/*!
+  Returns false while some durations are missing from totalDuration(),
+  usually because they are still being read.
+ */
+bool QMediaPlaylist::isTotalDurationExact() const
+{
+    return m_unknownDurations == 0;
+}
+
+/*!
+  Returns the number of playlist entries whose duration is not known.
+ */
+int QMediaPlaylist::unknownDurationCount() const
+{
+    return m_unknownDurations;
+}
+
+/*!
+  Returns the total size in bytes of the files in the playlist, as far as known.
+ */
+qint64 QMediaPlaylist::totalSize() const
+{
+    return m_totalSize;
 }
 
 
@@ -390,7 +447,7 @@ QUrl QMediaPlaylist::media(int index) const
     Q_D(const QMediaPlaylist);
     if (index < 0 || index >= d->playlist.size())
         return QUrl();
-    return d->playlist.at(index);
+    return m_tracks.url(d->playlist.at(index));
 }
 
 /*!
@@ -402,25 +459,42 @@ QUrl QMediaPlaylist::queueMedia(int index) const
     Q_D(const QMediaPlaylist);
     if (index < 0 || index >= d->playqueue.size())
         return QUrl();
-    return d->playqueue.at(index);
+    return m_tracks.url(d->playlist.at(d->playqueue.at(index)));
 }
 
 QMediaMetaData QMediaPlaylist::mediaMetadata(int index) const
 {
-    QUrl url = media(index);
-    if(!m_mediaMetadata.contains(url)) {
+    Q_D(const QMediaPlaylist);
+    if (index < 0 || index >= d->playlist.size())
         return QMediaMetaData{};
-    }
-    return m_mediaMetadata.value(url);
+    return m_tracks.metaData(d->playlist.at(index));
 }
 
 QMediaMetaData QMediaPlaylist::queueMediaMetadata(int index) const
 {
-    QUrl url = queueMedia(index);
-    if(!m_mediaMetadata.contains(url)) {
+    Q_D(const QMediaPlaylist);
+    if (index < 0 || index >= d->playqueue.size())
         return QMediaMetaData{};
-    }
-    return m_mediaMetadata.value(url);
+    return m_tracks.metaData(d->playlist.at(d->playqueue.at(index)));
+}
+
+/*!
+  Returns the table holding the metadata of the tracks in the playlist.
+*/
+const TrackStore &QMediaPlaylist::tracks() const
+{
+    return m_tracks;
+}
+
+/*!
+  Returns the id in tracks() of the item at \a index in the playlist.
+*/
+TrackStore::TrackId QMediaPlaylist::mediaTrack(int index) const
+{
+    Q_D(const QMediaPlaylist);
+    if (index < 0 || index >= d->playlist.size())
+        return TrackStore::INVALID_TRACK;
+    return d->playlist.at(index);
 }
 
 /*!
@@ -434,14 +508,9 @@ void QMediaPlaylist::addMedia(const QUrl &content)
     int pos = d->playlist.size();
     emit mediaAboutToBeInserted(pos, pos);
 
-    loadMetadata(content);
-
-    d->playlist.append(content);
+    d->playlist.append(loadMetadata({ content }));
     // Do also playqueue
-    d_func()->playqueue = d_func()->playlist;
-    if(shuffleEnabled) {
-        this->shuffle();
-    }
+    d->queueInserted(pos, 1, shuffleEnabled);
     emit mediaInserted(pos, pos);
 }
 
@@ -460,16 +529,83 @@ void QMediaPlaylist::addMedia(const QList<QUrl> &items)
     int last = first + items.size() - 1;
     emit mediaAboutToBeInserted(first, last);
 
-    for(const QUrl &item : items) {
-        loadMetadata(item);
-    }
+    d->playlist.append(loadMetadata(items));
+    // Do also playqueue
+    d->queueInserted(first, items.size(), shuffleEnabled);
+    emit mediaInserted(first, last);
+}
+
+/*!
+  Append the media in \a items, each given by its Url, to the playlist.
+
+  Whatever else the items carry, such as the title and duration from an
+  extended M3U playlist, is shown until the files have been parsed.
+  */
+void QMediaPlaylist::addMedia(const QList<QMediaMetaData> &items)
+{
+    if (!items.size())
+        return;
+
+    QList<QUrl> urls;
+    urls.reserve(items.size());
+    for (const QMediaMetaData &item : items)
+        urls.append(item.value(QMediaMetaData::Url).toUrl());
+
+    Q_D(QMediaPlaylist);
+    int first = d->playlist.size();
+    int last = first + items.size() - 1;
+    emit mediaAboutToBeInserted(first, last);
 
-    d_func()->playlist.append(items);
+    d->playlist.append(loadMetadata(urls, items));
     // Do also playqueue
-    d_func()->playqueue = QList(d_func()->playlist);
-    if(shuffleEnabled) {
-        this->shuffle();
+    d->queueInserted(first, items.size(), shuffleEnabled);
+    emit mediaInserted(first, last);
+}
+
+/*!
+  Append \a tracks of the music \a library to the playlist.
+
+  The library already holds their metadata, so unlike files added by url
+  they are shown complete at once and nothing is parsed, except for files
+  the library could not read.
+  */
+void QMediaPlaylist::addMedia(const LibraryIndex &library, const QList<LibraryIndex::TrackId> &tracks)
+{
+    if (!tracks.size())
+        return;
+
+    Q_D(QMediaPlaylist);
+    int first = d->playlist.size();
+    int last = first + tracks.size() - 1;
+    emit mediaAboutToBeInserted(first, last);
+
+    QList<QUrl> pending;
+    d->playlist.reserve(d->playlist.size() + tracks.size());
+    for(LibraryIndex::TrackId track : tracks) {
+        const QUrl url = library.url(track);
+        bool added = false;
+        const TrackStore::TrackId id = m_tracks.intern(url, &added);
+        m_tracks.retain(id);
+        // A track already in the playlist has its metadata, or is being loaded
+        if(added) {
+            // Without audio properties when the library could only read the tags
+            const QMediaMetaData metaData = library.metaData(track);
+            m_tracks.setMetaData(id, metaData, metaData.value(QMediaMetaData::Duration).isValid());
+            m_tracks.setFileSize(id, library.fileSize(track));
+            if(!m_tracks.hasDuration(id)) {
+                pending.append(url);
+            }
+        }
+        addToTotals(id, 1);
+        d->playlist.append(id);
+    }
+    if(!pending.isEmpty()) {
+        m_metaDataLoader->request(pending);
     }
+    emit totalsChanged();
+
+    // Do also playqueue
+    d->queueInserted(first, tracks.size(), shuffleEnabled);
     emit mediaInserted(first, last);
 }
 
@@ -484,13 +620,10 @@ bool QMediaPlaylist::insertMedia(int pos, const QUrl &content)
     Q_D(QMediaPlaylist);
     pos = qBound(0, pos, d->playlist.size());
     emit mediaAboutToBeInserted(pos, pos);
-    d->playlist.insert(pos, content);
+    d->playlist.insert(pos, loadMetadata({ content }).first());
 
     // Do also playqueue
-    d->playqueue = QList(d->playlist);
-    if(shuffleEnabled) {
-        this->shuffle();
-    }
+    d->queueInserted(pos, 1, shuffleEnabled);
 
     emit mediaInserted(pos, pos);
     return true;
@@ -512,15 +645,12 @@ bool QMediaPlaylist::insertMedia(int pos, const QList<QUrl> &items)
     int last = pos + items.size() - 1;
     emit mediaAboutToBeInserted(pos, last);
     auto newList = d->playlist.mid(0, pos);
-    newList += items;
+    newList += loadMetadata(items);
     newList += d->playlist.mid(pos);
     d->playlist = newList;
 
     // Do also playqueue
-    d->playqueue = QList(newList);
-    if(shuffleEnabled) {
-        this->shuffle();
-    }
+    d->queueInserted(pos, items.size(), shuffleEnabled);
 
     emit mediaInserted(pos, last);
     return true;
@@ -566,19 +696,98 @@ bool QMediaPlaylist::moveMedia(int from, int to)
     d->playlist.move(from, to);
 
     // Do also playqueue
-    d->playqueue = QList(d->playlist);
-    if(shuffleEnabled) {
-        this->shuffle();
-    }
+    d->queueMoved(from, to, shuffleEnabled);
 
     // Set new position
     d->setCurrentPos(newPlayingPos);
 
-    emit mediaChanged(0, d->playlist.count());
+    // Only the rows between both positions changed
+    emit mediaChanged(qMin(from, to), qMax(from, to));
+    emit orderChanged();
     emit currentSelectionChanged(to); // highlight destination
     return true;
 }
 
+/*!
+  Move the items at the playlist positions in \a rows to position \a to,
+  as a block keeping their relative order. \a to is a position in the
+  playlist before the move; the block is placed in front of the item
+  there, or of the next item not being moved.
+
+  The change is reported with a single mediaChanged() for the rows affected.
+
+  Returns true if the operation is successful, otherwise false.
+*/
+bool QMediaPlaylist::moveMedia(const QList<int> &rows, int to)
+{
+    Q_D(QMediaPlaylist);
+    const int count = d->playlist.size();
+    to = qBound(0, to, count);
+
+    QList<bool> moving(count, false);
+    int movingCount = 0;
+    for(int row : rows) {
+        if(row >= 0 && row < count && !moving.at(row)) {
+            moving[row] = true;
+            movingCount++;
+        }
+    }
+    if(movingCount == 0)
+        return false;
+
+    // Where the block lands once the moved items are taken out
+    int blockStart = 0;
+    for(int i = 0; i < to; i++) {
+        if(!moving.at(i)) {
+            blockStart++;
+        }
+    }
+
+    // New position of every item, in one pass
+    QList<int> newRows(count);
+    int nextKept = 0;
+    int nextMoved = blockStart;
+    for(int i = 0; i < count; i++) {
+        if(moving.at(i)) {
+            newRows[i] = nextMoved++;
+        } else {
+            if(nextKept == blockStart) {
+                nextKept += movingCount;
+            }
+            newRows[i] = nextKept++;
+        }
+    }
+
+    QList<TrackStore::TrackId> playlist(count);
+    int first = count;
+    int last = -1;
+    for(int i = 0; i < count; i++) {
+        playlist[newRows.at(i)] = d->playlist.at(i);
+        if(newRows.at(i) != i) {
+            first = qMin(first, qMin(i, newRows.at(i)));
+            last = qMax(last, qMax(i, newRows.at(i)));
+        }
+    }
+    if(last < 0)
+        return false; // Nothing to do here
+
+    const int currentPlayingPos = d->currentPos();
+    d->playlist = playlist;
+
+    // Do also playqueue
+    d->queueRemapped(newRows, shuffleEnabled);
+
+    // Set new position
+    if(currentPlayingPos >= 0 && currentPlayingPos < count) {
+        d->setCurrentPos(newRows.at(currentPlayingPos));
+    }
+
+    emit mediaChanged(first, last);
+    emit orderChanged();
+    emit currentSelectionChanged(blockStart); // highlight destination
+    return true;
+}
+
 /*!
   Remove the item from the playlist at position \a pos.
 
@@ -602,34 +811,84 @@ bool QMediaPlaylist::removeMedia(int start, int end)
     start = qBound(0, start, d->playlist.size() - 1);
     end = qBound(0, end, d->playlist.size() - 1);
 
-    // Get the current playing media position and update after change
-    int currentPlayingPos = d->currentPos();
-    int newPlayingPos = currentPlayingPos;
-    // If currently playing position is between or at start or end, set at the begining
-    if(currentPlayingPos >= start && currentPlayingPos <= end) {
-        newPlayingPos = -1;
+    QList<int> rows(end - start + 1);
+    std::iota(rows.begin(), rows.end(), start);
+    return removeMedia(rows);
+}
+
+/*!
+  Remove the items at the playlist positions in \a rows, in any order.
+
+  The playlist, playqueue and metadata are compacted in a single pass and
+  totalsChanged() is emitted once. Each contiguous run of rows is then
+  reported with one mediaAboutToBeRemoved() and mediaRemoved() pair, the
+  last run first, for views to keep their rows in step. The playlist is
+  already in its final state when they are emitted; currentIndex() still
+  gives the row played before the removal and only changes after the last
+  mediaRemoved().
+
+  Returns true if the operation is successful, otherwise return false.
+  */
+bool QMediaPlaylist::removeMedia(const QList<int> &rows)
+{
+    Q_D(QMediaPlaylist);
+
+    QList<int> sorted;
+    sorted.reserve(rows.size());
+    for(int row : rows) {
+        if(row >= 0 && row < d->playlist.size()) {
+            sorted.append(row);
+        }
     }
-    // If current playing position is after end, it will move up
-    if(currentPlayingPos > end) {
-        newPlayingPos = currentPlayingPos - (end - start) - 1;
+    if(sorted.isEmpty())
+        return false;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    // Compact the playlist in one pass, keeping the removed tracks
+    QList<TrackStore::TrackId> removed;
+    removed.reserve(sorted.size());
+    int next = 0;
+    int kept = 0;
+    for(int row = 0; row < d->playlist.size(); ++row) {
+        if(next < sorted.size() && sorted.at(next) == row) {
+            removed.append(d->playlist.at(row));
+            ++next;
+        } else {
+            d->playlist[kept++] = d->playlist.at(row);
+        }
     }
+    d->playlist.resize(kept);
 
-    emit mediaAboutToBeRemoved(start, end);
-    d->playlist.remove(start, end - start + 1);
+    // Do also playqueue
+    d->queueRemoved(sorted);
 
-    // Refill playqueue
-    d->playqueue = QList(d->playlist);
-    if(shuffleEnabled) {
-        this->shuffle();
+    releaseMetadata(removed);
+
+    // Current playing media position after the change, -1 if it was removed
+    const int currentPlayingPos = d->currentPos();
+    int newPlayingPos = currentPlayingPos;
+    if(currentPlayingPos >= 0) {
+        const auto it = std::lower_bound(sorted.cbegin(), sorted.cend(), currentPlayingPos);
+        newPlayingPos = it != sorted.cend() && *it == currentPlayingPos
+                ? -1
+                : currentPlayingPos - int(it - sorted.cbegin());
     }
 
-    vacuumMetadata();
+    // Report the runs from the last one, so the rows of the others don't shift
+    int runEnd = sorted.size() - 1;
+    while(runEnd >= 0) {
+        int runStart = runEnd;
+        while(runStart > 0 && sorted.at(runStart - 1) == sorted.at(runStart) - 1) {
+            runStart--;
+        }
+        emit mediaAboutToBeRemoved(sorted.at(runStart), sorted.at(runEnd));
+        emit mediaRemoved(sorted.at(runStart), sorted.at(runEnd));
+        runEnd = runStart - 1;
+    }
 
-    // Set new position
+    // Its place in the playqueue may have moved even if the row didn't
     d->setCurrentPos(newPlayingPos);
-
-    emit mediaRemoved(start, end);
-    emit mediaChanged(0, d->playlist.count());
     return true;
 }
 
@@ -643,9 +902,10 @@ void QMediaPlaylist::clear()
     Q_D(QMediaPlaylist);
     int size = d->playlist.size();
     emit mediaAboutToBeRemoved(0, size - 1);
+    const QList<TrackStore::TrackId> removed = d->playlist;
     d->playlist.clear();
     d->playqueue.clear();
-    vacuumMetadata();
+    releaseMetadata(removed);
     emit mediaRemoved(0, size - 1);
 }
 
@@ -706,15 +966,26 @@ bool QMediaPlaylist::save(const QUrl &location, const char *format) const
     if (!d->checkFormat(format))
         return false;
 
-    QFile file(location.toLocalFile());
+    // Written next to the target and renamed over it on commit, so an
+    // interrupted save leaves the previous file intact
+    QSaveFile file(location.toLocalFile());
 
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    if (!file.open(QIODevice::WriteOnly)) {
         d->error = AccessDeniedError;
         d->errorString = tr("The file could not be accessed.");
         return false;
     }
 
-    return save(&file, format);
+    if (!save(&file, format)) {
+        file.cancelWriting();
+        return false;
+    }
+    if (!file.commit()) {
+        d->error = AccessDeniedError;
+        d->errorString = tr("The file could not be written.");
+        return false;
+    }
+    return true;
 }
 
 /*!
@@ -734,7 +1005,156 @@ bool QMediaPlaylist::save(QIODevice *device, const char *format) const
 
     QM3uPlaylistWriter writer(device);
     for (const auto &entry : d->playlist)
-        writer.writeItem(entry);
+        writer.writeItem(m_tracks.url(entry), m_tracks.duration(entry), m_tracks.artist(entry),
+                         m_tracks.title(entry));
+    if (!writer.finish()) {
+        d->error = AccessDeniedError;
+        d->errorString = tr("The file could not be written.");
+        return false;
+    }
+    return true;
+}
+
+/*!
+  Write a binary snapshot of the playlist to \a device: every track with its
+  metadata, the playqueue order, the shuffle state and the current item.
+
+  Returns true if the snapshot was written successfully.
+
+  \sa restoreSnapshot()
+*/
+bool QMediaPlaylist::saveSnapshot(QIODevice *device) const
+{
+    Q_D(const QMediaPlaylist);
+
+    // Each track is written once; entries refer to it by its place in the table
+    QHash<TrackStore::TrackId, quint32> index;
+    QList<TrackStore::TrackId> table;
+    for (TrackStore::TrackId id : d->playlist) {
+        if (!index.contains(id)) {
+            index.insert(id, table.size());
+            table.append(id);
+        }
+    }
+
+    QDataStream out(device);
+    out << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << quint32(table.size());
+    for (TrackStore::TrackId id : table)
+        m_tracks.writeTrack(out, id);
+    out << quint32(d->playlist.size());
+    for (TrackStore::TrackId id : d->playlist)
+        out << index.value(id);
+    for (int row : d->playqueue)
+        out << qint32(row);
+    out << shuffleEnabled << qint32(d->currentQueuePos());
+    return out.status() == QDataStream::Ok;
+}
+
+/*!
+  Fill the playlist from a snapshot \a data written by saveSnapshot(). The
+  playlist must be empty.
+
+  No file is parsed for tracks the snapshot has complete metadata for;
+  the rest are queued for the loader as if they had just been added. The
+  current item is set last, so currentIndexChanged() is emitted for it.
+
+  Returns true if the playlist was restored.
+*/
+bool QMediaPlaylist::restoreSnapshot(const QByteArray &data)
+{
+    Q_D(QMediaPlaylist);
+
+    if (!d->playlist.isEmpty())
+        return false;
+
+    QDataStream in(data);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 trackCount = 0;
+    in >> magic >> version >> trackCount;
+    if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION)
+        return false;
+
+    QList<TrackStore::TrackId> table;
+    for (quint32 i = 0; i < trackCount && in.status() == QDataStream::Ok; i++)
+        table.append(m_tracks.readTrack(in));
+
+    quint32 entryCount = 0;
+    in >> entryCount;
+    QList<TrackStore::TrackId> entries;
+    for (quint32 i = 0; i < entryCount && in.status() == QDataStream::Ok; i++) {
+        quint32 track = 0;
+        in >> track;
+        if (track < quint32(table.size()) && table.at(track) != TrackStore::INVALID_TRACK)
+            entries.append(table.at(track));
+        else
+            in.setStatus(QDataStream::ReadCorruptData);
+    }
+
+    // The queue must be a permutation of the rows, or it is rebuilt
+    QList<int> queue;
+    QList<bool> queued(entries.size(), false);
+    for (quint32 i = 0; i < entryCount && in.status() == QDataStream::Ok; i++) {
+        qint32 row = -1;
+        in >> row;
+        if (row >= 0 && row < entries.size() && !queued.at(row)) {
+            queued[row] = true;
+            queue.append(row);
+        }
+    }
+
+    bool shuffled = false;
+    qint32 current = -1;
+    in >> shuffled >> current;
+
+    if (in.status() != QDataStream::Ok || entries.isEmpty()) {
+        // Nothing holds a reference yet, so this drops every track read
+        for (TrackStore::TrackId id : table)
+            m_tracks.release(id);
+        return false;
+    }
+
+    const int last = entries.size() - 1;
+    emit mediaAboutToBeInserted(0, last);
+    d->playlist = entries;
+    for (TrackStore::TrackId id : entries) {
+        m_tracks.retain(id);
+        addToTotals(id, 1);
+    }
+    shuffleEnabled = shuffled;
+    if (queue.size() == entries.size())
+        d->playqueue = queue;
+    else
+        d->resetQueue();
+    emit mediaInserted(0, last);
+    emit totalsChanged();
+
+    // Anything not complete was still a placeholder, provisional or
+    // tags-only when the snapshot was taken
+    QList<QUrl> pending;
+    QList<QUrl> deferred;
+    for (TrackStore::TrackId id : table) {
+        if (id == TrackStore::INVALID_TRACK)
+            continue;
+        if (m_tracks.refCount(id) == 0) {
+            // In the table but not in the playlist
+            m_tracks.release(id);
+            continue;
+        }
+        if (m_tracks.isComplete(id))
+            continue;
+        if (m_tracks.hasDuration(id))
+            deferred.append(m_tracks.url(id));
+        else
+            pending.append(m_tracks.url(id));
+    }
+    if (!pending.isEmpty())
+        m_metaDataLoader->request(pending);
+    if (!deferred.isEmpty())
+        m_metaDataLoader->refine(deferred);
+
+    if (current >= 0 && current < d->playqueue.size())
+        setCurrentQueueIndex(current);
     return true;
 }
 
@@ -764,21 +1184,10 @@ void QMediaPlaylist::shuffle()
     if(d->playqueue.empty())
         return;
 
-    QList<QUrl> playqueue;
-
     // keep the current item when shuffling
-    QUrl current;
-    if (d->currentQueuePos() != -1)
-        current = d->playqueue.takeAt(d->currentQueuePos());
-
-    while (!d->playqueue.isEmpty())
-        playqueue.append(
-                d->playqueue.takeAt(QRandomGenerator::global()->bounded(int(d->playqueue.size()))));
-
-    if (d->currentQueuePos() != -1)
-        playqueue.insert(d->currentQueuePos(), current);
-    d->playqueue = playqueue;
-    emit mediaChanged(0, d->playqueue.count());
+    d->shuffleQueue();
+    emit mediaChanged(0, d->playqueue.count() - 1);
+    emit orderChanged();
 }
 
 /*!
@@ -792,19 +1201,10 @@ void QMediaPlaylist::unshuffle()
         return;
 
     // keep the current item when unshuffling
-    QUrl current;
-    if (d->currentQueuePos() != -1)
-        current = d->playqueue.takeAt(d->currentQueuePos());
-
-    QList<QUrl> playqueue(d->playlist);
-
-    d->playqueue = playqueue;
-
-    int newPlayPos = d->playqueue.indexOf(current);
+    d->resetQueue();
 
-    d->setCurrentQueuePos(newPlayPos);
-
-    emit mediaChanged(0, d->playqueue.count());
+    emit mediaChanged(0, d->playqueue.count() - 1);
+    emit orderChanged();
 }
 
 
@@ -865,32 +1265,217 @@ void QMediaPlaylist::setCurrentQueueIndex(int playlistPosition)
 }
 
 /*!
-    Loads media metadata
+    Adds the tracks for \a urls to the track store, taking a reference for
+    each, and returns their ids. New tracks get a placeholder showing the
+    file name and are parsed in the background; mediaChanged() is emitted
+    as results arrive.
+
+    An entry in \a provisional, such as one read from a playlist file,
+    stands in for the placeholder. If it has a duration the file skips the
+    tags pass: it is only parsed, in full, once the tags of the other new
+    tracks have been read.
  */
-void QMediaPlaylist::loadMetadata(const QUrl &url)
+QList<TrackStore::TrackId> QMediaPlaylist::loadMetadata(const QList<QUrl> &urls,
+                                                        const QList<QMediaMetaData> &provisional)
 {
-    if(m_mediaMetadata.contains(url)) {
+    QList<TrackStore::TrackId> ids;
+    ids.reserve(urls.size());
+    QList<QUrl> pending;
+    QList<QUrl> deferred;
+    for(int i = 0; i < urls.size(); i++) {
+        const QUrl &url = urls.at(i);
+        bool added = false;
+        const TrackStore::TrackId id = m_tracks.intern(url, &added);
+        m_tracks.retain(id);
+        ids.append(id);
+        if(added) {
+            QMediaMetaData meta;
+            if(i < provisional.size()) {
+                meta = provisional.at(i);
+            }
+            if(meta.value(QMediaMetaData::Title).toString().isEmpty()) {
+                meta.insert(QMediaMetaData::Title, url.fileName());
+            }
+            m_tracks.setMetaData(id, meta, false);
+            // Also when cached: the loader finds it at once and gets the file size
+            if(m_tracks.hasDuration(id)) {
+                deferred.append(url);
+            } else {
+                pending.append(url);
+            }
+        }
+        addToTotals(id, 1);
+    }
+
+    if(!pending.isEmpty()) {
+        m_metaDataLoader->request(pending);
+    }
+    if(!deferred.isEmpty()) {
+        m_metaDataLoader->refine(deferred);
+    }
+    emit totalsChanged();
+    return ids;
+}
+
+/*!
+    Replaces placeholders with parsed metadata and notifies the rows that changed
+ */
+void QMediaPlaylist::applyMetadata(const QList<MetaDataLoader::Result> &batch)
+{
+    Q_D(const QMediaPlaylist);
+
+    QList<int> rows;
+    QSet<TrackStore::TrackId> repeated;
+    for(const MetaDataLoader::Result &result : batch) {
+        // Results for removed items were cancelled, but don't resurrect them
+        const TrackStore::TrackId id = m_tracks.find(result.url);
+        if(id != TrackStore::INVALID_TRACK) {
+            const int entries = m_tracks.refCount(id);
+            addToTotals(id, -entries);
+            // A file that can't be read keeps its placeholder or provisional metadata
+            if(!result.metaData.isEmpty()) {
+                m_tracks.setMetaData(id, result.metaData, result.complete);
+            }
+            m_tracks.setFileSize(id, result.fileSize);
+            addToTotals(id, entries);
+            if(entries == 1) {
+                const int row = trackRow(id);
+                if(row >= 0) {
+                    rows.append(row);
+                }
+            } else if(entries > 1) {
+                repeated.insert(id);
+            }
+        }
+    }
+    if(rows.isEmpty() && repeated.isEmpty()) {
         return;
     }
+    emit totalsChanged();
+
+    // Files listed more than once are rare enough to look for the slow way
+    if(!repeated.isEmpty()) {
+        for(int i = 0; i < d->playlist.size(); i++) {
+            if(repeated.contains(d->playlist.at(i))) {
+                rows.append(i);
+            }
+        }
+    }
 
-    QMediaMetaData meta = parseMetaData(url);
+    // One notification per run of adjacent rows, so views only repaint those
+    std::sort(rows.begin(), rows.end());
+    int first = rows.first();
+    for(int i = 1; i <= rows.size(); i++) {
+        if(i == rows.size() || rows.at(i) > rows.at(i - 1) + 1) {
+            emit mediaChanged(first, rows.at(i - 1));
+            if(i < rows.size()) {
+                first = rows.at(i);
+            }
+        }
+    }
+}
 
-    m_mediaMetadata.insert(url, meta);
+/*!
+    Returns the row of track \a id, which must appear once in the playlist,
+    or -1 if it isn't in the playlist
+ */
+int QMediaPlaylist::trackRow(TrackStore::TrackId id) const
+{
+    Q_D(const QMediaPlaylist);
+
+    if(id < TrackStore::TrackId(m_trackRows.size())) {
+        const int row = m_trackRows.at(id);
+        if(row >= 0 && row < d->playlist.size() && d->playlist.at(row) == id) {
+            return row;
+        }
+    }
+
+    // Rows moved since the table was built
+    m_trackRows.fill(-1);
+    for(int i = 0; i < d->playlist.size(); i++) {
+        const TrackStore::TrackId entry = d->playlist.at(i);
+        if(entry >= TrackStore::TrackId(m_trackRows.size())) {
+            m_trackRows.resize(entry + 1, -1);
+        }
+        m_trackRows[entry] = i;
+    }
+    return id < TrackStore::TrackId(m_trackRows.size()) ? m_trackRows.at(id) : -1;
 }
 
 /*!
-    Cleans unused metadata (for example, after removing media from the playlist)
+    Moves the metadata of rows \a start to \a end to the front of the parse queue
  */
-void QMediaPlaylist::vacuumMetadata()
+void QMediaPlaylist::prioritizeMetadata(int start, int end)
 {
     Q_D(const QMediaPlaylist);
 
-    for(const QUrl &key : m_mediaMetadata.keys()) {
-        if(!d->playlist.contains(key)) {
+    start = qMax(0, start);
+    end = qMin(end, d->playlist.size() - 1);
+    if(start > end) {
+        return;
+    }
+    QList<QUrl> urls;
+    urls.reserve(end - start + 1);
+    for(int i = start; i <= end; i++) {
+        urls.append(m_tracks.url(d->playlist.at(i)));
+    }
+    m_metaDataLoader->prioritize(urls);
+}
+
+/*!
+    Returns the rows whose title, artist or album contain every word of
+    \a query, in playlist order. Tracks are looked up in the search index of
+    the track table; only the match of each row's track is checked here.
+ */
+QList<int> QMediaPlaylist::search(const QString &query) const
+{
+    Q_D(const QMediaPlaylist);
+
+    const QBitArray matches = m_tracks.search(query);
+    QList<int> rows;
+    for(int i = 0; i < d->playlist.size(); i++) {
+        const TrackStore::TrackId id = d->playlist.at(i);
+        if(id < TrackStore::TrackId(matches.size()) && matches.testBit(id)) {
+            rows.append(i);
+        }
+    }
+    return rows;
+}
+
+/*!
+    Drops the references held by removed playlist entries \a ids, and the
+    metadata of tracks no longer in the playlist. Runs in the number of
+    removed entries, whatever the size of the playlist.
+ */
+void QMediaPlaylist::releaseMetadata(const QList<TrackStore::TrackId> &ids)
+{
+    QList<QUrl> removed;
+    for(TrackStore::TrackId id : ids) {
+        addToTotals(id, -1);
+        const QUrl url = m_tracks.url(id);
+        if(m_tracks.release(id)) {
             // Metadata not used, remove
-            m_mediaMetadata.remove(key);
+            MetaDataCache::remove(url);
+            removed.append(url);
         }
     }
+    emit totalsChanged();
+    // Stop parsing anything that is no longer in the playlist
+    m_metaDataLoader->cancel(removed);
+}
+
+
+/*!
+    Adds (or with a negative \a entries, removes) the contribution of track
+    \a id to the running totals, for \a entries playlist entries
+ */
+void QMediaPlaylist::addToTotals(TrackStore::TrackId id, int entries)
+{
+    m_totalDuration += entries * m_tracks.duration(id);
+    m_totalSize += entries * m_tracks.fileSize(id);
+    if(!m_tracks.hasDuration(id)) {
+        m_unknownDurations += entries;
+    }
 }
 
 
@@ -915,6 +1500,21 @@ void QMediaPlaylist::vacuumMetadata()
     between \a start and \a end positions inclusive.
  */
 
+/*!
+    \fn void QMediaPlaylist::orderChanged()
+
+    This signal is emitted after items have been moved in the playlist, or
+    the playqueue has been shuffled or unshuffled. Unlike mediaChanged(),
+    it is not emitted when only the metadata of items changed.
+ */
+
+/*!
+    \fn void QMediaPlaylist::totalsChanged()
+
+    This signal is emitted when totalDuration(), unknownDurationCount() or
+    totalSize() may have changed.
+ */
+
 /*!
     \fn void QMediaPlaylist::currentIndexChanged(int position)
 
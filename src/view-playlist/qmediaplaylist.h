@@ -7,6 +7,10 @@
 #include <QObject>
 #include <QMediaMetaData>
 
+#include "libraryindex.h"
+#include "metadataloader.h"
+#include "trackstore.h"
+
 QT_BEGIN_NAMESPACE
 
 class QMediaPlaylistPrivate;
@@ -30,6 +34,7 @@ public:
     PlaybackMode playbackMode() const;
     void setPlaybackMode(PlaybackMode mode);
     void setShuffle(bool shuffle);
+    bool isShuffled() const;
 
     // For playlist
     int currentIndex() const;
@@ -51,18 +56,30 @@ public:
     QMediaMetaData mediaMetadata(int index) const;
     QMediaMetaData queueMediaMetadata(int index) const;
 
+    // Direct access to the track table, avoiding a QMediaMetaData per call
+    const TrackStore &tracks() const;
+    TrackStore::TrackId mediaTrack(int index) const;
+
 
     int mediaCount() const;
     bool isEmpty() const;
+    // Running totals over the playlist, kept up to date on every change
     qint64 totalDuration() const;
+    bool isTotalDurationExact() const;
+    int unknownDurationCount() const;
+    qint64 totalSize() const;
 
     void addMedia(const QUrl &content);
     void addMedia(const QList<QUrl> &items);
+    void addMedia(const QList<QMediaMetaData> &items);
+    void addMedia(const LibraryIndex &library, const QList<LibraryIndex::TrackId> &tracks);
     bool insertMedia(int index, const QUrl &content);
     bool insertMedia(int index, const QList<QUrl> &items);
     bool moveMedia(int from, int to);
+    bool moveMedia(const QList<int> &rows, int to);
     bool removeMedia(int pos);
     bool removeMedia(int start, int end);
+    bool removeMedia(const QList<int> &rows);
     void clear();
 
     void load(const QUrl &location, const char *format = nullptr);
@@ -71,9 +88,19 @@ public:
     bool save(const QUrl &location, const char *format = nullptr) const;
     bool save(QIODevice *device, const char *format) const;
 
+    // Binary image of the playlist and its metadata, for restoring a session
+    bool saveSnapshot(QIODevice *device) const;
+    bool restoreSnapshot(const QByteArray &data);
+
     Error error() const;
     QString errorString() const;
 
+    // Parse metadata for playlist rows start..end before the rest
+    void prioritizeMetadata(int start, int end);
+
+    // Rows whose title, artist or album match every word of query, ascending
+    QList<int> search(const QString &query) const;
+
 public slots:
     void shuffle();
     void unshuffle();
@@ -97,6 +124,8 @@ signals:
     void mediaAboutToBeRemoved(int start, int end);
     void mediaRemoved(int start, int end);
     void mediaChanged(int start, int end);
+    void orderChanged();
+    void totalsChanged();
 
     void loaded();
     void loadFailed();
@@ -106,10 +135,25 @@ private:
     QMediaPlaylistPrivate *d_ptr;
     Q_DECLARE_PRIVATE(QMediaPlaylist)
 
-    // Metadata for files in the playlist
-    QMap<QUrl, QMediaMetaData> m_mediaMetadata;
-    void loadMetadata(const QUrl &url);
-    void vacuumMetadata();
+    // Tracks in the playlist and their metadata. Entries start as
+    // placeholders and are filled in by the loader.
+    TrackStore m_tracks;
+    MetaDataLoader *m_metaDataLoader = nullptr;
+    QList<TrackStore::TrackId> loadMetadata(const QList<QUrl> &urls,
+                                            const QList<QMediaMetaData> &provisional = {});
+    void applyMetadata(const QList<MetaDataLoader::Result> &batch);
+
+    // Row of each track, indexed by track id. Not maintained by edits: a
+    // stale entry is detected on lookup and the whole table rebuilt once.
+    mutable QList<int> m_trackRows;
+    int trackRow(TrackStore::TrackId id) const;
+
+    // Sums over the playlist entries, a track counting once per entry
+    qint64 m_totalDuration = 0;
+    int m_unknownDurations = 0;
+    qint64 m_totalSize = 0;
+    void addToTotals(TrackStore::TrackId id, int entries);
+    void releaseMetadata(const QList<TrackStore::TrackId> &ids);
 };
 
 QT_END_NAMESPACE
@@ -3,8 +3,20 @@
 
 #include "qmediaplaylist_p.h"
 
+#include <QRandomGenerator>
+
 QT_BEGIN_NAMESPACE
 
+namespace {
+// Fisher-Yates shuffle of list[begin, end)
+void shuffleRange(QList<int> &list, int begin, int end)
+{
+    for (int i = end - 1; i > begin; --i) {
+        list.swapItemsAt(i, begin + QRandomGenerator::global()->bounded(i - begin + 1));
+    }
+}
+} // namespace
+
 QMediaPlaylistPrivate::QMediaPlaylistPrivate() : error(QMediaPlaylist::NoError) { }
 
 QMediaPlaylistPrivate::~QMediaPlaylistPrivate()
@@ -22,8 +34,6 @@ void QMediaPlaylistPrivate::loadFailed(QMediaPlaylist::Error error, const QStrin
 
 void QMediaPlaylistPrivate::loadFinished()
 {
-    q_ptr->addMedia(parser->playlist);
-
     emit q_ptr->loaded();
 }
 
@@ -55,6 +65,9 @@ void QMediaPlaylistPrivate::ensureParser()
         return;
 
     parser = new QPlaylistFileParser(q_ptr);
+    // Appended batch by batch, so a large playlist shows up while it is parsed
+    QObject::connect(parser, &QPlaylistFileParser::itemsFound,
+                     [this](const QList<QMediaMetaData> &items) { q_ptr->addMedia(items); });
     QObject::connect(parser, &QPlaylistFileParser::finished, [this]() { loadFinished(); });
     QObject::connect(parser, &QPlaylistFileParser::error,
                      [this](QMediaPlaylist::Error err, const QString &errorMsg) {
@@ -82,8 +95,7 @@ void QMediaPlaylistPrivate::setCurrentPos(int pos)
     }
 
     // Sync currentPlayPos
-    QUrl item = playlist.at(m_currentPos);
-    m_currentQueuePos = playqueue.indexOf(item);
+    m_currentQueuePos = playqueue.indexOf(m_currentPos);
 }
 
 void QMediaPlaylistPrivate::setCurrentQueuePos(int pos)
@@ -96,8 +108,117 @@ void QMediaPlaylistPrivate::setCurrentQueuePos(int pos)
     }
 
     // Sync currentPos
-    QUrl item = playqueue.at(m_currentQueuePos);
-    m_currentPos = playlist.indexOf(item);
+    m_currentPos = playqueue.at(m_currentQueuePos);
+}
+
+void QMediaPlaylistPrivate::queueInserted(int start, int count, bool shuffled)
+{
+    for (int &row : playqueue) {
+        if (row >= start)
+            row += count;
+    }
+    if (m_currentPos >= start)
+        m_currentPos += count;
+
+    if (!shuffled) {
+        playqueue.insert(start, count, 0);
+        for (int i = 0; i < count; ++i)
+            playqueue[start + i] = start + i;
+        m_currentQueuePos = m_currentPos;
+        return;
+    }
+
+    QList<int> added(count);
+    for (int i = 0; i < count; ++i)
+        added[i] = start + i;
+    shuffleRange(added, 0, count);
+
+    // Merge the new rows into the upcoming part of the queue, picking from
+    // either side in proportion to what is left. Each new row ends up at a
+    // uniformly random upcoming position and the upcoming order is kept.
+    const int played = m_currentQueuePos + 1;
+    const QList<int> upcoming = playqueue.mid(played);
+    playqueue.resize(played);
+    playqueue.reserve(played + upcoming.size() + count);
+    int a = 0;
+    int b = 0;
+    while (a < upcoming.size() || b < count) {
+        const int left = int(upcoming.size()) - a + count - b;
+        if (QRandomGenerator::global()->bounded(left) < count - b)
+            playqueue.append(added.at(b++));
+        else
+            playqueue.append(upcoming.at(a++));
+    }
+}
+
+void QMediaPlaylistPrivate::queueRemoved(const QList<int> &rows)
+{
+    // New row of every old one, -1 for the removed ones
+    QList<int> newRows(playqueue.size());
+    int removed = 0;
+    for (int row = 0; row < newRows.size(); ++row) {
+        if (removed < rows.size() && rows.at(removed) == row) {
+            newRows[row] = -1;
+            ++removed;
+        } else {
+            newRows[row] = row - removed;
+        }
+    }
+
+    playqueue.removeIf([&newRows](int row) { return newRows.at(row) < 0; });
+    for (int &row : playqueue)
+        row = newRows.at(row);
+}
+
+void QMediaPlaylistPrivate::queueMoved(int from, int to, bool shuffled)
+{
+    for (int &row : playqueue) {
+        if (row == from)
+            row = to;
+        else if (from < to && row > from && row <= to)
+            --row;
+        else if (from > to && row >= to && row < from)
+            ++row;
+    }
+    // In playlist order the queue moves with the playlist
+    if (!shuffled)
+        playqueue.move(from, to);
+}
+
+void QMediaPlaylistPrivate::queueRemapped(const QList<int> &newRows, bool shuffled)
+{
+    if (!shuffled) {
+        resetQueue();
+        return;
+    }
+    for (int &row : playqueue)
+        row = newRows.at(row);
+}
+
+void QMediaPlaylistPrivate::shuffleQueue()
+{
+    const int size = playqueue.size();
+    if (size < 2)
+        return;
+
+    // Keep the current item in its slot: park it at the end, shuffle the
+    // others, then swap it back
+    const int current = m_currentQueuePos;
+    if (current < 0 || current >= size) {
+        shuffleRange(playqueue, 0, size);
+        return;
+    }
+    playqueue.swapItemsAt(current, size - 1);
+    shuffleRange(playqueue, 0, size - 1);
+    playqueue.swapItemsAt(current, size - 1);
+}
+
+void QMediaPlaylistPrivate::resetQueue()
+{
+    playqueue.resize(playlist.size());
+    for (int i = 0; i < playqueue.size(); ++i)
+        playqueue[i] = i;
+    m_currentQueuePos = m_currentPos;
 }
 
 QT_END_NAMESPACE
@@ -52,8 +52,18 @@ public:
     int nextQueuePosition(int steps) const;
     int prevQueuePosition(int steps) const;
 
-    QList<QUrl> playlist; // Displayed playlist
-    QList<QUrl> playqueue; // Actual playing queue
+    QList<TrackStore::TrackId> playlist; // Displayed playlist
+    QList<int> playqueue; // Actual playing queue, as rows of playlist
+
+    // Keep playqueue in step with changes to playlist, without rebuilding
+    // it: an inserted row lands at a random upcoming position when shuffled,
+    // and the part of the queue already played keeps its order.
+    void queueInserted(int start, int count, bool shuffled);
+    void queueRemoved(const QList<int> &rows); // rows sorted ascending
+    void queueMoved(int from, int to, bool shuffled);
+    void queueRemapped(const QList<int> &newRows, bool shuffled); // newRows[old row]
+    void shuffleQueue();
+    void resetQueue();
 
     int currentPos() const;
     int currentQueuePos() const;
@@ -5,14 +5,20 @@
 #include "qplaylistfileparser.h"
 
 #include <QDebug>
+#include <QDir>
+#include <QFile>
 #include <QFileInfo>
 #include <QIODevice>
 #include <QNetworkReply>
 #include <QNetworkRequest>
 #include <QPointer>
 
+#include <cstring>
+
 QT_BEGIN_NAMESPACE
 
+#define ITEM_BATCH_SIZE 256
+
 namespace {
 
 class ParserBase
@@ -32,13 +38,22 @@ public:
         return ok && !m_aborted;
     }
 
+    // Hands the items found since the last call to the playlist
+    void flush()
+    {
+        if (m_items.isEmpty() || m_aborted)
+            return;
+        Q_EMIT m_parent->itemsFound(m_items);
+        m_items.clear();
+    }
+
     virtual void abort() { m_aborted = true; }
     virtual ~ParserBase() = default;
 
 protected:
     virtual bool parseLineImpl(int lineIndex, const QString &line, const QUrl &root) = 0;
 
-    static QUrl expandToFullPath(const QUrl &root, const QString &line)
+    QUrl expandToFullPath(const QUrl &root, const QString &line)
     {
         // On Linux, backslashes are not converted to forward slashes :/
         if (line.startsWith(QLatin1String("//")) || line.startsWith(QLatin1String("\\\\"))) {
@@ -46,12 +61,20 @@ protected:
             return QUrl::fromLocalFile(line);
         }
 
+        if (root.isLocalFile() && line.startsWith(u'/')) {
+            // What QUrl::fromUserInput() returns for an absolute path, without
+            // parsing it as a URL or stat()ing the file
+            return QUrl::fromLocalFile(line);
+        }
+
         QUrl url(line);
         if (url.scheme().isEmpty()) {
             // Resolve it relative to root
-            if (root.isLocalFile())
-                return QUrl::fromUserInput(line, root.adjusted(QUrl::RemoveFilename).toLocalFile(),
-                                           QUrl::AssumeLocalFile);
+            if (root.isLocalFile()) {
+                if (m_rootPath.isNull())
+                    m_rootPath = root.adjusted(QUrl::RemoveFilename).toLocalFile();
+                return QUrl::fromLocalFile(QDir(m_rootPath).absoluteFilePath(line));
+            }
             return root.resolved(url);
         }
         if (url.scheme().length() == 1)
@@ -61,10 +84,19 @@ protected:
         return url;
     }
 
-    void newItemFound(const QVariant &content) { Q_EMIT m_parent->newItem(content); }
+    void newItemFound(const QMediaMetaData &item)
+    {
+        m_items.append(item);
+        if (m_items.size() >= ITEM_BATCH_SIZE)
+            flush();
+    }
 
     QPlaylistFileParser *m_parent;
     bool m_aborted;
+
+private:
+    QList<QMediaMetaData> m_items;
+    QString m_rootPath;
 };
 
 class M3UParser : public ParserBase
@@ -108,22 +140,20 @@ public:
                     if (artistStart > 0) {
                         int titleStart = getSplitIndex(line, artistStart);
                         if (titleStart > artistStart) {
-                            m_extraInfo[QMediaMetaData::Author] =
+                            // The key the rest of the player reads the artist from
+                            m_extraInfo[QMediaMetaData::AlbumArtist] =
                                     lineView.mid(artistStart + 1, titleStart - artistStart - 1)
                                             .trimmed()
-                                            .toString()
-                                            .replace(QLatin1String("--"), QLatin1String("-"));
+                                            .toString();
                             m_extraInfo[QMediaMetaData::Title] =
                                     lineView.mid(titleStart + 1)
                                             .trimmed()
-                                            .toString()
-                                            .replace(QLatin1String("--"), QLatin1String("-"));
+                                            .toString();
                         } else {
                             m_extraInfo[QMediaMetaData::Title] =
                                     lineView.mid(artistStart + 1)
                                             .trimmed()
-                                            .toString()
-                                            .replace(QLatin1String("--"), QLatin1String("-"));
+                                            .toString();
                         }
                     }
                 }
@@ -131,31 +161,22 @@ public:
                 m_extendedFormat = true;
             }
         } else {
-            QUrl url = expandToFullPath(root, line);
-            m_extraInfo[QMediaMetaData::Url] = url;
-            m_parent->playlist.append(url);
-            newItemFound(QVariant::fromValue(m_extraInfo));
+            m_extraInfo[QMediaMetaData::Url] = expandToFullPath(root, line);
+            newItemFound(m_extraInfo);
             m_extraInfo.clear();
         }
 
         return true;
     }
 
+    // Index of the '-' splitting artist from title: the first " - ", so a
+    // '-' within a name, as in "Jay-Z", is kept
     int getSplitIndex(const QString &line, int startPos)
     {
         if (startPos < 0)
             startPos = 0;
-        const QChar *buf = line.data();
-        for (int i = startPos; i < line.length(); ++i) {
-            if (buf[i] == u'-') {
-                if (i == line.length() - 1)
-                    return i;
-                ++i;
-                if (buf[i] != u'-')
-                    return i - 1;
-            }
-        }
-        return -1;
+        const int separator = line.indexOf(QLatin1String(" - "), startPos);
+        return separator < 0 ? -1 : separator + 1;
     }
 
 private:
@@ -216,9 +237,9 @@ public:
         if (value.isEmpty())
             return true;
 
-        QUrl path = expandToFullPath(root, value);
-        m_parent->playlist.append(path);
-        newItemFound(path);
+        QMediaMetaData item;
+        item.insert(QMediaMetaData::Url, expandToFullPath(root, value));
+        newItemFound(item);
 
         return true;
     }
@@ -243,7 +264,6 @@ public:
         : q_ptr(q),
           m_stream(nullptr),
           m_type(QPlaylistFileParser::UNKNOWN),
-          m_scanIndex(0),
           m_lineIndex(-1),
           m_utf8(false),
           m_aborted(false)
@@ -251,6 +271,7 @@ public:
     }
 
     void handleData();
+    void parseFile(const QString &path);
     void handleParserFinished();
     void abort();
     void reset();
@@ -277,60 +298,110 @@ public:
             m_mimeType = QString();
         }
     } m_pendingJob;
-    int m_scanIndex;
     int m_lineIndex;
     bool m_utf8;
     bool m_aborted;
 
 private:
-    bool processLine(int startIndex, int length);
+    bool createParser(const char *data, quint32 size);
+    bool processLines(const char *data, qsizetype size, bool atEnd, qsizetype *consumed);
+    bool processLine(const char *data, qsizetype length);
 };
 
 #define LINE_LIMIT 4096
-#define READ_LIMIT 64
+#define READ_LIMIT 65536
 
-bool QPlaylistFileParserPrivate::processLine(int startIndex, int length)
+bool QPlaylistFileParserPrivate::createParser(const char *data, quint32 size)
 {
     Q_Q(QPlaylistFileParser);
-    m_lineIndex++;
+    const QString urlString = m_root.toString();
+    const QString &suffix = !urlString.isEmpty() ? QFileInfo(urlString).suffix() : urlString;
+    QString mimeType;
+    if (m_source)
+        mimeType = m_source->header(QNetworkRequest::ContentTypeHeader).toString();
+    m_type = QPlaylistFileParser::findPlaylistType(
+            suffix, !mimeType.isEmpty() ? mimeType : m_mimeType, data, size);
+
+    switch (m_type) {
+    case QPlaylistFileParser::UNKNOWN:
+        emit q->error(QMediaPlaylist::FormatError,
+                      QMediaPlaylist::tr("%1 playlist type is unknown").arg(m_root.toString()));
+        q->abort();
+        return false;
+    case QPlaylistFileParser::M3U:
+        m_currentParser.reset(new M3UParser(q));
+        break;
+    case QPlaylistFileParser::M3U8:
+        m_currentParser.reset(new M3UParser(q));
+        m_utf8 = true;
+        break;
+    case QPlaylistFileParser::PLS:
+        m_currentParser.reset(new PLSParser(q));
+        break;
+    }
+
+    Q_ASSERT(!m_currentParser.isNull());
+    return true;
+}
+
+// Parses the lines in [data, data + size), including a last one without a
+// line break if atEnd. Sets consumed to the bytes parsed; the rest is the
+// start of a line that continues in the next block. Returns false once
+// parsing has stopped.
+bool QPlaylistFileParserPrivate::processLines(const char *data, qsizetype size, bool atEnd,
+                                              qsizetype *consumed)
+{
+    Q_Q(QPlaylistFileParser);
+    // Either '\r' or '\n' ends a line. memchr() is vectorised by the C
+    // library, and remembering the next match of each means the data is
+    // scanned once per character rather than once per line.
+    const auto find = [data, size](qsizetype from, char c) {
+        const void *p = memchr(data + from, c, size_t(size - from));
+        return p ? static_cast<const char *>(p) - data : size;
+    };
+
+    qsizetype start = 0;
+    qsizetype nextCr = -1;
+    qsizetype nextLf = -1;
+    while (start < size && !m_aborted) {
+        if (nextCr < start)
+            nextCr = find(start, '\r');
+        if (nextLf < start)
+            nextLf = find(start, '\n');
+        const qsizetype end = qMin(nextCr, nextLf);
+        if (end == size && !atEnd)
+            break;
 
-    if (!m_currentParser) {
-        const QString urlString = m_root.toString();
-        const QString &suffix = !urlString.isEmpty() ? QFileInfo(urlString).suffix() : urlString;
-        QString mimeType;
-        if (m_source)
-            mimeType = m_source->header(QNetworkRequest::ContentTypeHeader).toString();
-        m_type = QPlaylistFileParser::findPlaylistType(
-                suffix, !mimeType.isEmpty() ? mimeType : m_mimeType, m_buffer.constData(),
-                quint32(m_buffer.size()));
-
-        switch (m_type) {
-        case QPlaylistFileParser::UNKNOWN:
+        const qsizetype length = end - start;
+        if (length >= LINE_LIMIT) {
             emit q->error(QMediaPlaylist::FormatError,
-                          QMediaPlaylist::tr("%1 playlist type is unknown").arg(m_root.toString()));
+                          QMediaPlaylist::tr("invalid line in playlist file"));
             q->abort();
-            return false;
-        case QPlaylistFileParser::M3U:
-            m_currentParser.reset(new M3UParser(q));
-            break;
-        case QPlaylistFileParser::M3U8:
-            m_currentParser.reset(new M3UParser(q));
-            m_utf8 = true;
-            break;
-        case QPlaylistFileParser::PLS:
-            m_currentParser.reset(new PLSParser(q));
             break;
         }
-
-        Q_ASSERT(!m_currentParser.isNull());
+        if (length > 0) {
+            if (!m_currentParser && !createParser(data, quint32(qMin(size, qsizetype(LINE_LIMIT)))))
+                break;
+            if (!processLine(data + start, length))
+                break;
+        }
+        start = end + 1;
     }
 
+    *consumed = qMin(start, size);
+    return !m_aborted;
+}
+
+bool QPlaylistFileParserPrivate::processLine(const char *data, qsizetype length)
+{
+    m_lineIndex++;
+
     QString line;
 
     if (m_utf8) {
-        line = QString::fromUtf8(m_buffer.constData() + startIndex, length).trimmed();
+        line = QString::fromUtf8(data, length).trimmed();
     } else {
-        line = QString::fromLatin1(m_buffer.constData() + startIndex, length).trimmed();
+        line = QString::fromLatin1(data, length).trimmed();
     }
     if (line.isEmpty())
         return true;
@@ -343,58 +414,56 @@ void QPlaylistFileParserPrivate::handleData()
 {
     Q_Q(QPlaylistFileParser);
     while (m_stream->bytesAvailable() && !m_aborted) {
-        int expectedBytes =
-                qMin(READ_LIMIT,
-                     int(qMin(m_stream->bytesAvailable(), qint64(LINE_LIMIT - m_buffer.size()))));
-        m_buffer.push_back(m_stream->read(expectedBytes));
-        int processedBytes = 0;
-        while (m_scanIndex < m_buffer.length() && !m_aborted) {
-            char s = m_buffer[m_scanIndex];
-            if (s == '\r' || s == '\n') {
-                int l = m_scanIndex - processedBytes;
-                if (l > 0) {
-                    if (!processLine(processedBytes, l))
-                        break;
-                }
-                processedBytes = m_scanIndex + 1;
-                if (!m_stream) {
-                    // some error happened, so exit parsing
-                    return;
-                }
-            }
-            m_scanIndex++;
+        m_buffer.append(m_stream->read(READ_LIMIT));
+        // Parse the remainder as the last line once everything is read
+        const bool atEnd = !m_stream->bytesAvailable() && (!m_source || !m_source->isFinished());
+
+        qsizetype consumed = 0;
+        const bool ok = processLines(m_buffer.constData(), m_buffer.size(), atEnd, &consumed);
+        if (!m_stream) {
+            // some error happened, so exit parsing
+            return;
         }
-
-        if (m_aborted)
+        if (!ok || atEnd)
             break;
 
-        if (m_buffer.length() - processedBytes >= LINE_LIMIT) {
+        m_buffer.remove(0, consumed);
+        if (m_buffer.size() >= LINE_LIMIT) {
             emit q->error(QMediaPlaylist::FormatError,
                           QMediaPlaylist::tr("invalid line in playlist file"));
             q->abort();
             break;
         }
+    }
 
-        if (!m_stream->bytesAvailable() && (!m_source || !m_source->isFinished())) {
-            // last line
-            processLine(processedBytes, -1);
-            break;
-        }
+    handleParserFinished();
+}
 
-        Q_ASSERT(m_buffer.length() == m_scanIndex);
-        if (processedBytes == 0)
-            continue;
+// Local files skip QNetworkAccessManager and are parsed in one pass over a
+// mapping of the whole file.
+void QPlaylistFileParserPrivate::parseFile(const QString &path)
+{
+    Q_Q(QPlaylistFileParser);
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit q->error(QMediaPlaylist::AccessDeniedError,
+                      QMediaPlaylist::tr("%1 could not be opened").arg(path));
+        return;
+    }
 
-        int copyLength = m_buffer.length() - processedBytes;
-        if (copyLength > 0) {
-            Q_ASSERT(copyLength <= READ_LIMIT);
-            m_buffer = m_buffer.right(copyLength);
-        } else {
-            m_buffer.clear();
-        }
-        m_scanIndex = 0;
+    QByteArray contents;
+    qint64 size = file.size();
+    const char *data = size > 0 ? reinterpret_cast<const char *>(file.map(0, size)) : nullptr;
+    if (!data) {
+        // Not mappable (e.g. a pipe or special file): read it instead
+        contents = file.readAll();
+        data = contents.constData();
+        size = contents.size();
     }
 
+    qsizetype consumed = 0;
+    processLines(data, size, true, &consumed);
+    // Items must be handed over before the mapping goes away with file
     handleParserFinished();
 }
 
@@ -502,7 +571,6 @@ void QPlaylistFileParser::start(QIODevice *stream, const QString &mimeType)
         return;
     }
 
-    playlist.clear();
     d->reset();
     d->m_mimeType = mimeType;
     d->m_stream = stream;
@@ -530,15 +598,17 @@ void QPlaylistFileParser::start(const QUrl &request, const QString &mimeType)
     d->reset();
     d->m_root = url;
     d->m_mimeType = mimeType;
+    if (url.isLocalFile()) {
+        d->parseFile(url.toLocalFile());
+        return;
+    }
+
     d->m_source.reset(d->m_mgr.get(QNetworkRequest(request)));
     d->m_stream = d->m_source.get();
     connect(d->m_source.data(), SIGNAL(readyRead()), this, SLOT(handleData()));
     connect(d->m_source.data(), SIGNAL(finished()), this, SLOT(handleData()));
     connect(d->m_source.data(), SIGNAL(errorOccurred(QNetworkReply::NetworkError)), this,
             SLOT(handleError()));
-
-    if (url.isLocalFile())
-        d->handleData();
 }
 
 void QPlaylistFileParser::abort()
@@ -551,8 +621,6 @@ void QPlaylistFileParser::abort()
 
     if (d->m_stream)
         disconnect(d->m_stream, SIGNAL(readyRead()), this, SLOT(handleData()));
-
-    playlist.clear();
 }
 
 void QPlaylistFileParser::handleData()
@@ -570,6 +638,7 @@ void QPlaylistFileParserPrivate::handleParserFinished()
                       QMediaPlaylist::tr("Empty file provided"));
 
     if (isParserValid && !m_aborted) {
+        m_currentParser->flush();
         m_currentParser.reset();
         emit q->finished();
     }
@@ -600,7 +669,6 @@ void QPlaylistFileParserPrivate::reset()
     m_mimeType.clear();
     m_stream = nullptr;
     m_type = QPlaylistFileParser::UNKNOWN;
-    m_scanIndex = 0;
     m_lineIndex = -1;
     m_utf8 = false;
     m_aborted = false;
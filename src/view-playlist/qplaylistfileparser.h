@@ -18,6 +18,7 @@
 #include "qmediaplaylist.h"
 #include "qtmultimediaglobal.h"
 
+#include <QMediaMetaData>
 #include <QObject>
 
 QT_BEGIN_NAMESPACE
@@ -47,10 +48,10 @@ public:
     void start(QIODevice *stream, const QString &mimeType = QString());
     void abort();
 
-    QList<QUrl> playlist;
-
 signals:
-    void newItem(const QVariant &content);
+    // Entries found so far, in order, a few hundred at a time. Each has its
+    // Url; extended M3U entries also carry the #EXTINF duration, artist and title.
+    void itemsFound(const QList<QMediaMetaData> &items);
     void finished();
     void error(QMediaPlaylist::Error err, const QString &errorMsg);
 
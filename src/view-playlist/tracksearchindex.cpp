@@ -0,0 +1,176 @@
+#include "tracksearchindex.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+// Below this, stale postings cost less than rebuilding the lists
+constexpr qsizetype MIN_COMPACT_POSTINGS = 4096;
+
+// Up to three UTF-16 units and their count, so "ab" as a word start and
+// "ab" inside a trigram can't be confused
+quint64 packKey(const QChar *chars, int length)
+{
+    quint64 key = quint64(length) << 48;
+    for (int i = 0; i < length; ++i) {
+        key |= quint64(chars[i].unicode()) << (32 - 16 * i);
+    }
+    return key;
+}
+
+bool isWordStart(const QString &text, qsizetype i)
+{
+    return text.at(i).isLetterOrNumber() && (i == 0 || !text.at(i - 1).isLetterOrNumber());
+}
+} // namespace
+
+void TrackSearchIndex::update(TrackId id, const QString &title, const QString &artist, const QString &album)
+{
+    const QString text = fold(title) + u'\n' + fold(artist) + u'\n' + fold(album);
+    if (id >= TrackId(m_texts.size())) {
+        m_texts.resize(id + 1);
+    }
+    if (m_texts.at(id) == text) {
+        return;
+    }
+
+    // Keys the track already has postings for keep them
+    const QList<quint64> oldKeys = keys(m_texts.at(id));
+    const QList<quint64> newKeys = keys(text);
+    QList<quint64> added;
+    std::set_difference(newKeys.cbegin(), newKeys.cend(), oldKeys.cbegin(), oldKeys.cend(),
+                        std::back_inserter(added));
+    m_stalePostings += oldKeys.size() - (newKeys.size() - added.size());
+
+    m_texts[id] = text;
+    addPostings(id, added);
+    compact();
+}
+
+void TrackSearchIndex::remove(TrackId id)
+{
+    if (id >= TrackId(m_texts.size()) || m_texts.at(id).isEmpty()) {
+        return;
+    }
+    m_stalePostings += keys(m_texts.at(id)).size();
+    m_texts[id].clear();
+    compact();
+}
+
+void TrackSearchIndex::clear()
+{
+    m_texts.clear();
+    m_postings.clear();
+    m_postingCount = 0;
+    m_stalePostings = 0;
+}
+
+QBitArray TrackSearchIndex::search(const QString &query) const
+{
+    QBitArray result(m_texts.size());
+    const QStringList words = fold(query).simplified().split(u' ', Qt::SkipEmptyParts);
+    if (words.isEmpty()) {
+        return result;
+    }
+
+    // The rarest key of any word; a key nothing has rules out every track
+    const QList<TrackId> *candidates = nullptr;
+    for (const QString &word : words) {
+        const int length = qMin(word.size(), qsizetype(3));
+        for (qsizetype i = 0; i + length <= word.size(); ++i) {
+            const auto it = m_postings.constFind(packKey(word.constData() + i, length));
+            if (it == m_postings.constEnd()) {
+                return result;
+            }
+            if (candidates == nullptr || it->size() < candidates->size()) {
+                candidates = &it.value();
+            }
+            if (length < 3) {
+                // Only the word start is indexed for short words
+                break;
+            }
+        }
+    }
+
+    for (TrackId id : *candidates) {
+        const QString &text = m_texts.at(id);
+        const bool all = std::all_of(words.cbegin(), words.cend(),
+                                     [&text](const QString &word) { return matches(text, word); });
+        if (all) {
+            result.setBit(id);
+        }
+    }
+    return result;
+}
+
+void TrackSearchIndex::addPostings(TrackId id, const QList<quint64> &keys)
+{
+    for (quint64 key : keys) {
+        m_postings[key].append(id);
+    }
+    m_postingCount += keys.size();
+}
+
+void TrackSearchIndex::compact()
+{
+    if (m_stalePostings < MIN_COMPACT_POSTINGS || m_stalePostings * 2 < m_postingCount) {
+        return;
+    }
+    m_postings.clear();
+    m_postingCount = 0;
+    m_stalePostings = 0;
+    for (TrackId id = 0; id < TrackId(m_texts.size()); ++id) {
+        addPostings(id, keys(m_texts.at(id)));
+    }
+}
+
+// Lower case without diacritics, so "beyonce" finds "Beyoncé"
+QString TrackSearchIndex::fold(const QString &text)
+{
+    const QString decomposed = text.normalized(QString::NormalizationForm_KD);
+    QString folded;
+    folded.reserve(decomposed.size());
+    for (QChar c : decomposed) {
+        if (c.category() != QChar::Mark_NonSpacing) {
+            folded.append(c.toCaseFolded());
+        }
+    }
+    return folded;
+}
+
+// Sorted, without duplicates. Keys don't span the '\n' between fields.
+QList<quint64> TrackSearchIndex::keys(const QString &text)
+{
+    QList<quint64> keys;
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        if (text.at(i) == u'\n') {
+            continue;
+        }
+        const bool second = i + 1 < text.size() && text.at(i + 1) != u'\n';
+        if (second && i + 2 < text.size() && text.at(i + 2) != u'\n') {
+            keys.append(packKey(text.constData() + i, 3));
+        }
+        if (isWordStart(text, i)) {
+            keys.append(packKey(text.constData() + i, 1));
+            if (second) {
+                keys.append(packKey(text.constData() + i, 2));
+            }
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+bool TrackSearchIndex::matches(const QString &text, const QString &word)
+{
+    if (word.size() >= 3) {
+        return text.contains(word);
+    }
+    for (qsizetype i = text.indexOf(word); i >= 0; i = text.indexOf(word, i + 1)) {
+        if (isWordStart(text, i)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,45 @@
+#ifndef TRACKSEARCHINDEX_H
+#define TRACKSEARCHINDEX_H
+
+#include <QBitArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+// In-memory search over the title, artist and album of each track.
+//
+// Text is folded (case and diacritics) and indexed by every trigram, and by
+// the first one and two characters of every word, so a query of any length
+// starts from a single posting list. The shortest list of the query's words
+// gives the candidates, and each candidate is checked against its folded
+// text, so the answer costs one pass over that list, not over the tracks.
+//
+// Updates only append: postings left behind by a changed or removed track
+// fail the check, and are dropped together once they outnumber the live ones.
+class TrackSearchIndex
+{
+public:
+    using TrackId = quint32;
+
+    void update(TrackId id, const QString &title, const QString &artist, const QString &album);
+    void remove(TrackId id);
+    void clear();
+
+    // Tracks matching every word of query, as a bit per id. A word of three
+    // or more characters matches anywhere, a shorter one the start of a word.
+    QBitArray search(const QString &query) const;
+
+private:
+    QList<QString> m_texts; // folded fields separated by '\n', by id
+    QHash<quint64, QList<TrackId>> m_postings;
+    qsizetype m_postingCount = 0;
+    qsizetype m_stalePostings = 0;
+
+    void addPostings(TrackId id, const QList<quint64> &keys);
+    void compact();
+    static QString fold(const QString &text);
+    static QList<quint64> keys(const QString &text);
+    static bool matches(const QString &text, const QString &word);
+};
+
+#endif // TRACKSEARCHINDEX_H
@@ -0,0 +1,313 @@
+#include "trackstore.h"
+
+TrackStore::StringPool::StringPool()
+{
+    // Index 0 is the empty string, so unset columns need no lookup
+    m_strings.append(QString());
+}
+
+quint32 TrackStore::StringPool::intern(const QString &string)
+{
+    if (string.isEmpty()) {
+        return 0;
+    }
+    auto it = m_index.constFind(string);
+    if (it != m_index.constEnd()) {
+        return it.value();
+    }
+    const quint32 index = m_strings.size();
+    m_strings.append(string);
+    m_index.insert(string, index);
+    return index;
+}
+
+const QString &TrackStore::StringPool::at(quint32 index) const
+{
+    return m_strings.at(index);
+}
+
+TrackStore::TrackId TrackStore::intern(const QUrl &url, bool *added)
+{
+    auto it = m_byUrl.constFind(url);
+    if (it != m_byUrl.constEnd()) {
+        if (added) {
+            *added = false;
+        }
+        return it.value();
+    }
+
+    TrackId id;
+    if (!m_free.isEmpty()) {
+        id = m_free.takeLast();
+    } else {
+        id = m_urls.size();
+        m_urls.append(QUrl());
+        m_refCounts.append(0);
+        m_titles.append(QString());
+        m_artists.append(0);
+        m_albums.append(0);
+        m_genres.append(0);
+        m_durations.append(NO_DURATION);
+        m_bitRates.append(0);
+        m_sampleRates.append(0);
+        m_trackNumbers.append(0);
+        m_years.append(0);
+        m_fileSizes.append(0);
+        m_flags.append(0);
+    }
+    m_urls[id] = url;
+    m_byUrl.insert(url, id);
+    ++m_size;
+    if (added) {
+        *added = true;
+    }
+    return id;
+}
+
+TrackStore::TrackId TrackStore::find(const QUrl &url) const
+{
+    return m_byUrl.value(url, INVALID_TRACK);
+}
+
+void TrackStore::retain(TrackId id)
+{
+    ++m_refCounts[id];
+}
+
+bool TrackStore::release(TrackId id)
+{
+    if (id >= TrackId(m_urls.size()) || m_urls.at(id).isEmpty()) {
+        return false;
+    }
+    if (m_refCounts.at(id) > 1) {
+        --m_refCounts[id];
+        return false;
+    }
+    m_byUrl.remove(m_urls.at(id));
+    m_urls[id] = QUrl();
+    m_refCounts[id] = 0;
+    m_fileSizes[id] = 0;
+    resetRow(id);
+    m_search.remove(id);
+    m_free.append(id);
+    --m_size;
+    return true;
+}
+
+void TrackStore::clear()
+{
+    // The string pool is kept: the same artists are likely to come back
+    m_byUrl.clear();
+    m_free.clear();
+    m_search.clear();
+    m_size = 0;
+    m_urls.clear();
+    m_refCounts.clear();
+    m_titles.clear();
+    m_artists.clear();
+    m_albums.clear();
+    m_genres.clear();
+    m_durations.clear();
+    m_bitRates.clear();
+    m_sampleRates.clear();
+    m_trackNumbers.clear();
+    m_years.clear();
+    m_fileSizes.clear();
+    m_flags.clear();
+}
+
+int TrackStore::size() const
+{
+    return m_size;
+}
+
+const QUrl &TrackStore::url(TrackId id) const
+{
+    return m_urls.at(id);
+}
+
+const QString &TrackStore::title(TrackId id) const
+{
+    return m_titles.at(id);
+}
+
+const QString &TrackStore::artist(TrackId id) const
+{
+    return m_pool.at(m_artists.at(id));
+}
+
+const QString &TrackStore::album(TrackId id) const
+{
+    return m_pool.at(m_albums.at(id));
+}
+
+const QString &TrackStore::genre(TrackId id) const
+{
+    return m_pool.at(m_genres.at(id));
+}
+
+int TrackStore::trackNumber(TrackId id) const
+{
+    return m_trackNumbers.at(id);
+}
+
+int TrackStore::year(TrackId id) const
+{
+    return m_years.at(id);
+}
+
+qint64 TrackStore::duration(TrackId id) const
+{
+    const quint32 duration = m_durations.at(id);
+    return duration == NO_DURATION ? 0 : duration;
+}
+
+bool TrackStore::hasDuration(TrackId id) const
+{
+    return m_durations.at(id) != NO_DURATION;
+}
+
+int TrackStore::bitRate(TrackId id) const
+{
+    return m_bitRates.at(id);
+}
+
+int TrackStore::sampleRate(TrackId id) const
+{
+    return m_sampleRates.at(id);
+}
+
+qint64 TrackStore::fileSize(TrackId id) const
+{
+    return m_fileSizes.at(id);
+}
+
+void TrackStore::setFileSize(TrackId id, qint64 size)
+{
+    m_fileSizes[id] = size;
+}
+
+int TrackStore::refCount(TrackId id) const
+{
+    return m_refCounts.at(id);
+}
+
+bool TrackStore::isComplete(TrackId id) const
+{
+    return m_flags.at(id) & CompleteFlag;
+}
+
+QMediaMetaData TrackStore::metaData(TrackId id) const
+{
+    QMediaMetaData metaData;
+    metaData.insert(QMediaMetaData::Url, m_urls.at(id));
+    if (!m_titles.at(id).isEmpty()) {
+        metaData.insert(QMediaMetaData::Title, m_titles.at(id));
+    }
+    if (m_artists.at(id)) {
+        metaData.insert(QMediaMetaData::AlbumArtist, artist(id));
+    }
+    if (m_albums.at(id)) {
+        metaData.insert(QMediaMetaData::AlbumTitle, album(id));
+    }
+    if (m_genres.at(id)) {
+        metaData.insert(QMediaMetaData::Genre, genre(id));
+    }
+    if (m_trackNumbers.at(id)) {
+        metaData.insert(QMediaMetaData::TrackNumber, qint64(m_trackNumbers.at(id)));
+    }
+    if (m_years.at(id)) {
+        metaData.insert(QMediaMetaData::Date, qint64(m_years.at(id)));
+    }
+    if (hasDuration(id)) {
+        metaData.insert(QMediaMetaData::Duration, duration(id));
+        metaData.insert(QMediaMetaData::AudioBitRate, qint64(m_bitRates.at(id)));
+        metaData.insert(QMediaMetaData::Comment, QString::number(m_sampleRates.at(id))); // Using Comment as sample rate
+    }
+    return metaData;
+}
+
+void TrackStore::setMetaData(TrackId id, const QMediaMetaData &metaData, bool complete)
+{
+    resetRow(id);
+    m_flags[id] = complete ? CompleteFlag : 0;
+
+    m_titles[id] = metaData.value(QMediaMetaData::Title).toString();
+    m_artists[id] = m_pool.intern(metaData.value(QMediaMetaData::AlbumArtist).toString());
+    m_albums[id] = m_pool.intern(metaData.value(QMediaMetaData::AlbumTitle).toString());
+    m_genres[id] = m_pool.intern(metaData.value(QMediaMetaData::Genre).toString());
+    m_trackNumbers[id] = quint16(qBound(0LL, metaData.value(QMediaMetaData::TrackNumber).toLongLong(), 0xffffLL));
+    m_years[id] = quint16(qBound(0LL, metaData.value(QMediaMetaData::Date).toLongLong(), 0xffffLL));
+
+    const QVariant duration = metaData.value(QMediaMetaData::Duration);
+    if (duration.isValid()) {
+        m_durations[id] = quint32(qBound(0LL, duration.toLongLong(), qint64(NO_DURATION) - 1));
+        m_bitRates[id] = quint32(qMax(0LL, metaData.value(QMediaMetaData::AudioBitRate).toLongLong()));
+        // parseMetaData() stores the sample rate in Comment
+        m_sampleRates[id] = metaData.value(QMediaMetaData::Comment).toString().toUInt();
+    }
+    m_search.update(id, m_titles.at(id), artist(id), album(id));
+}
+
+QBitArray TrackStore::search(const QString &query) const
+{
+    return m_search.search(query);
+}
+
+void TrackStore::writeTrack(QDataStream &out, TrackId id) const
+{
+    // Strings rather than pool indexes: the pool is rebuilt on reading
+    out << m_urls.at(id) << m_titles.at(id) << artist(id) << album(id) << genre(id)
+        << m_durations.at(id) << m_bitRates.at(id) << m_sampleRates.at(id)
+        << m_trackNumbers.at(id) << m_years.at(id) << m_fileSizes.at(id) << m_flags.at(id);
+}
+
+TrackStore::TrackId TrackStore::readTrack(QDataStream &in)
+{
+    QUrl url;
+    QString title;
+    QString artist;
+    QString album;
+    QString genre;
+    quint32 duration = NO_DURATION;
+    quint32 bitRate = 0;
+    quint32 sampleRate = 0;
+    quint16 trackNumber = 0;
+    quint16 year = 0;
+    qint64 fileSize = 0;
+    quint8 flags = 0;
+    in >> url >> title >> artist >> album >> genre >> duration >> bitRate >> sampleRate
+        >> trackNumber >> year >> fileSize >> flags;
+    if (in.status() != QDataStream::Ok || url.isEmpty()) {
+        return INVALID_TRACK;
+    }
+
+    const TrackId id = intern(url);
+    m_titles[id] = title;
+    m_artists[id] = m_pool.intern(artist);
+    m_albums[id] = m_pool.intern(album);
+    m_genres[id] = m_pool.intern(genre);
+    m_durations[id] = duration;
+    m_bitRates[id] = bitRate;
+    m_sampleRates[id] = sampleRate;
+    m_trackNumbers[id] = trackNumber;
+    m_years[id] = year;
+    m_fileSizes[id] = fileSize;
+    m_flags[id] = flags;
+    m_search.update(id, title, artist, album);
+    return id;
+}
+
+void TrackStore::resetRow(TrackId id)
+{
+    m_titles[id] = QString();
+    m_artists[id] = 0;
+    m_albums[id] = 0;
+    m_genres[id] = 0;
+    m_durations[id] = NO_DURATION;
+    m_bitRates[id] = 0;
+    m_sampleRates[id] = 0;
+    m_trackNumbers[id] = 0;
+    m_years[id] = 0;
+    m_flags[id] = 0;
+}
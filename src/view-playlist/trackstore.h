@@ -0,0 +1,119 @@
+#ifndef TRACKSTORE_H
+#define TRACKSTORE_H
+
+#include <QDataStream>
+#include <QHash>
+#include <QList>
+#include <QMediaMetaData>
+#include <QString>
+#include <QUrl>
+
+#include "tracksearchindex.h"
+
+// Column-oriented table of the tracks referenced by a playlist.
+//
+// Each track is a 32-bit id indexing a set of parallel columns. Artist,
+// album and genre are interned, since a library repeats them on every track
+// of an album; numbers are stored in fixed-width columns instead of a
+// QVariant hash per track. The playlist and playqueue then only hold ids.
+//
+// A url maps to a single id, so the same file added twice shares its row.
+// Rows are reference counted by playlist membership: a track is dropped when
+// its last entry is released, and its id is reused by later tracks.
+//
+// Title, artist and album are also kept in a search index, updated with
+// every change to a row.
+class TrackStore
+{
+public:
+    using TrackId = quint32;
+    static constexpr TrackId INVALID_TRACK = 0xffffffff;
+
+    // Id of the track for url, adding an empty one if needed. Interning
+    // does not take a reference.
+    TrackId intern(const QUrl &url, bool *added = nullptr);
+    TrackId find(const QUrl &url) const;
+    void retain(TrackId id);
+    // Returns true if this dropped the last reference and removed the track
+    bool release(TrackId id);
+    void clear();
+
+    int size() const;
+
+    const QUrl &url(TrackId id) const;
+    const QString &title(TrackId id) const;
+    const QString &artist(TrackId id) const;
+    const QString &album(TrackId id) const;
+    const QString &genre(TrackId id) const;
+    int trackNumber(TrackId id) const;
+    int year(TrackId id) const;
+    qint64 duration(TrackId id) const; // ms, 0 if not known
+    bool hasDuration(TrackId id) const;
+    int bitRate(TrackId id) const;
+    int sampleRate(TrackId id) const;
+    qint64 fileSize(TrackId id) const; // bytes, 0 if not known
+    void setFileSize(TrackId id, qint64 size);
+    int refCount(TrackId id) const;
+    // Whether the row holds a full parse (tags and audio properties) rather
+    // than a placeholder, provisional or tags-only metadata
+    bool isComplete(TrackId id) const;
+
+    // Metadata in the form the rest of the player uses
+    QMediaMetaData metaData(TrackId id) const;
+    void setMetaData(TrackId id, const QMediaMetaData &metaData, bool complete);
+
+    // Tracks whose title, artist or album match every word of query, as a
+    // bit per id; see TrackSearchIndex
+    QBitArray search(const QString &query) const;
+
+    // Binary form of a track's row, for saving a session. readTrack()
+    // interns the url without taking a reference; it returns INVALID_TRACK
+    // if the stream is bad.
+    void writeTrack(QDataStream &out, TrackId id) const;
+    TrackId readTrack(QDataStream &in);
+
+private:
+    static constexpr quint32 NO_DURATION = 0xffffffff;
+
+    enum Flag : quint8 {
+        CompleteFlag = 0x01
+    };
+
+    // Strings shared by many tracks, stored once. Entries are never removed:
+    // their number is bounded by the distinct artists, albums and genres seen.
+    class StringPool
+    {
+    public:
+        StringPool();
+        quint32 intern(const QString &string);
+        const QString &at(quint32 index) const;
+
+    private:
+        QList<QString> m_strings;
+        QHash<QString, quint32> m_index;
+    };
+
+    StringPool m_pool;
+    TrackSearchIndex m_search;
+    QHash<QUrl, TrackId> m_byUrl;
+    QList<TrackId> m_free;
+    int m_size = 0;
+
+    QList<QUrl> m_urls; // empty for released ids
+    QList<quint32> m_refCounts;
+    QList<QString> m_titles;
+    QList<quint32> m_artists;
+    QList<quint32> m_albums;
+    QList<quint32> m_genres;
+    QList<quint32> m_durations; // ms
+    QList<quint32> m_bitRates;
+    QList<quint32> m_sampleRates;
+    QList<quint16> m_trackNumbers;
+    QList<quint16> m_years;
+    QList<qint64> m_fileSizes;
+    QList<quint8> m_flags;
+
+    void resetRow(TrackId id);
+};
+
+#endif // TRACKSTORE_H
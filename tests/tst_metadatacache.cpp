@@ -0,0 +1,91 @@
+#include "metadatacache.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QUrl>
+
+namespace {
+// More than the in-memory cache holds, so the first ones are evicted
+constexpr int FILE_COUNT = 600;
+
+// A tenth of a second of 8 kHz mono silence
+bool writeWav(const QString &path)
+{
+    constexpr quint32 dataSize = 800 * 2;
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData("RIFF", 4);
+    out << quint32(36 + dataSize);
+    out.writeRawData("WAVEfmt ", 8);
+    out << quint32(16) << quint16(1) << quint16(1) << quint32(8000) << quint32(16000) << quint16(2)
+        << quint16(16);
+    out.writeRawData("data", 4);
+    out << dataSize;
+    file.write(QByteArray(dataSize, '\0'));
+    return out.status() == QDataStream::Ok;
+}
+} // namespace
+
+class tst_MetaDataCache : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void lookUpEvictedAppends();
+};
+
+void tst_MetaDataCache::initTestCase()
+{
+    // Keeps the persistent store out of the user's cache directory
+    QStandardPaths::setTestModeEnabled(true);
+    QFile::remove(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/metadata.cache");
+}
+
+void tst_MetaDataCache::lookUpEvictedAppends()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QList<QUrl> urls;
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        const QString path = dir.filePath(QStringLiteral("%1.wav").arg(i));
+        QVERIFY(writeWav(path));
+        urls.append(QUrl::fromLocalFile(path));
+    }
+
+    for (const QUrl &url : std::as_const(urls)) {
+        QVERIFY(!MetaDataCache::parse(url).isEmpty());
+    }
+    const MetaDataCache::Statistics parsed = MetaDataCache::statistics();
+    QCOMPARE(parsed.misses, quint64(FILE_COUNT));
+    QCOMPARE(parsed.stored, FILE_COUNT);
+
+    // The first ones are no longer in memory and come from the store
+    for (const QUrl &url : std::as_const(urls)) {
+        const QMediaMetaData metaData = MetaDataCache::parse(url);
+        QCOMPARE(metaData.value(QMediaMetaData::Url).toUrl(), url);
+    }
+    const MetaDataCache::Statistics looked = MetaDataCache::statistics();
+    QCOMPARE(looked.misses, quint64(FILE_COUNT));
+    QCOMPARE(looked.hits, parsed.hits + FILE_COUNT);
+    QCOMPARE(looked.stored, FILE_COUNT);
+
+    // Nothing was appended twice
+    QFile store(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/metadata.cache");
+    const qint64 size = store.size();
+    for (const QUrl &url : std::as_const(urls)) {
+        MetaDataCache::parse(url);
+    }
+    QCOMPARE(store.size(), size);
+}
+
+QTEST_GUILESS_MAIN(tst_MetaDataCache)
+
+#include "tst_metadatacache.moc"
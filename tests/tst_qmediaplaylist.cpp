@@ -0,0 +1,163 @@
+#include "qmediaplaylist.h"
+
+#include <QBuffer>
+#include <QMediaMetaData>
+#include <QSet>
+#include <QTest>
+#include <QUrl>
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+constexpr int PLAYLIST_SIZE = 12;
+
+QUrl trackUrl(int track)
+{
+    return QUrl::fromLocalFile(QStringLiteral("/nonexistent/tst_qmediaplaylist/%1.flac").arg(track));
+}
+
+void fill(QMediaPlaylist &playlist)
+{
+    QList<QMediaMetaData> items;
+    for (int track = 0; track < PLAYLIST_SIZE; ++track) {
+        QMediaMetaData metaData;
+        metaData.insert(QMediaMetaData::Url, trackUrl(track));
+        metaData.insert(QMediaMetaData::Duration, qint64(1000));
+        items.append(metaData);
+    }
+    playlist.addMedia(items);
+}
+
+// What is wrong with the playqueue and current position of playlist, empty
+// if they agree with its rows
+QString inconsistency(const QMediaPlaylist &playlist)
+{
+    QSet<QUrl> rows;
+    QSet<QUrl> queued;
+    for (int row = 0; row < playlist.mediaCount(); ++row) {
+        rows.insert(playlist.media(row));
+        queued.insert(playlist.queueMedia(row));
+    }
+    if (rows != queued || playlist.queueMedia(playlist.mediaCount()).isValid()) {
+        return QStringLiteral("playqueue does not hold the playlist rows");
+    }
+    if (playlist.currentIndex() >= playlist.mediaCount()) {
+        return QStringLiteral("current index %1 past the end").arg(playlist.currentIndex());
+    }
+    if (playlist.currentIndex() >= 0
+        && playlist.queueMedia(playlist.currentQueueIndex()) != playlist.media(playlist.currentIndex())) {
+        return QStringLiteral("current queue index does not match the current index");
+    }
+    if (playlist.totalDuration() != playlist.mediaCount() * 1000) {
+        return QStringLiteral("total duration %1 for %2 rows").arg(playlist.totalDuration()).arg(playlist.mediaCount());
+    }
+    return QString();
+}
+} // namespace
+
+class tst_QMediaPlaylist : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void removeScatteredRows_data();
+    void removeScatteredRows();
+    void saveAndLoadM3uText();
+};
+
+void tst_QMediaPlaylist::removeScatteredRows_data()
+{
+    QTest::addColumn<bool>("shuffled");
+    QTest::addColumn<int>("current");
+    QTest::addColumn<QList<int>>("rows");
+    QTest::addColumn<int>("expectedCurrent");
+
+    QTest::newRow("current removed") << false << 5 << QList<int>{9, 1, 5, 2, 11} << -1;
+    QTest::newRow("current after runs") << false << 7 << QList<int>{10, 0, 3, 4} << 4;
+    QTest::newRow("current before runs") << false << 1 << QList<int>{3, 8, 9} << 1;
+    QTest::newRow("shuffled, current removed") << true << 5 << QList<int>{9, 1, 5, 2, 11} << -1;
+    QTest::newRow("shuffled, current kept") << true << 7 << QList<int>{10, 0, 3, 4, 6} << 3;
+}
+
+void tst_QMediaPlaylist::removeScatteredRows()
+{
+    QFETCH(bool, shuffled);
+    QFETCH(int, current);
+    QFETCH(QList<int>, rows);
+    QFETCH(int, expectedCurrent);
+
+    QMediaPlaylist playlist;
+    fill(playlist);
+    playlist.setCurrentIndex(current);
+    playlist.setShuffle(shuffled);
+    const QUrl currentUrl = playlist.currentMedia();
+
+    // One pass over the playlist: the totals change once, and each run is
+    // then reported while the current index is still the one played
+    int totalsChanges = 0;
+    connect(&playlist, &QMediaPlaylist::totalsChanged, this, [&]() { ++totalsChanges; });
+    QList<int> removedRows;
+    connect(&playlist, &QMediaPlaylist::mediaAboutToBeRemoved, this, [&](int start, int end) {
+        QCOMPARE(playlist.currentIndex(), current);
+        for (int row = end; row >= start; --row) {
+            removedRows.append(row);
+        }
+    });
+    int notifications = 0;
+    connect(&playlist, &QMediaPlaylist::mediaRemoved, this, [&]() { ++notifications; });
+
+    QVERIFY(playlist.removeMedia(rows));
+
+    const QString problem = inconsistency(playlist);
+    QVERIFY2(problem.isEmpty(), qPrintable(problem));
+    QCOMPARE(totalsChanges, 1);
+    QVERIFY(notifications > 1);
+    // The runs cover the rows removed, from the last one
+    QList<int> expectedRows = rows;
+    std::sort(expectedRows.begin(), expectedRows.end(), std::greater<int>());
+    QCOMPARE(removedRows, expectedRows);
+    QCOMPARE(playlist.mediaCount(), PLAYLIST_SIZE - rows.size());
+    QCOMPARE(playlist.currentIndex(), expectedCurrent);
+    if (expectedCurrent >= 0) {
+        QCOMPARE(playlist.currentMedia(), currentUrl);
+    }
+
+    // The remaining rows keep their order
+    int row = 0;
+    for (int track = 0; track < PLAYLIST_SIZE; ++track) {
+        if (!rows.contains(track)) {
+            QCOMPARE(playlist.media(row++), trackUrl(track));
+        }
+    }
+}
+
+void tst_QMediaPlaylist::saveAndLoadM3uText()
+{
+    QMediaMetaData metaData;
+    metaData.insert(QMediaMetaData::Url, trackUrl(0));
+    metaData.insert(QMediaMetaData::AlbumArtist, QStringLiteral("Jay-Z"));
+    metaData.insert(QMediaMetaData::Title, QStringLiteral("Hard Knock Life - Ghetto Anthem"));
+    metaData.insert(QMediaMetaData::Duration, qint64(238000));
+    QMediaPlaylist playlist;
+    playlist.addMedia(QList<QMediaMetaData>{metaData});
+
+    QBuffer buffer;
+    buffer.open(QIODevice::ReadWrite);
+    QVERIFY(playlist.save(&buffer, "m3u8"));
+    // Written as is, for other players to read
+    QVERIFY(buffer.data().contains("#EXTINF:238,Jay-Z - Hard Knock Life - Ghetto Anthem\n"));
+
+    QMediaPlaylist loaded;
+    buffer.seek(0);
+    loaded.load(&buffer, "m3u8");
+    QCOMPARE(loaded.mediaCount(), 1);
+    const QMediaMetaData read = loaded.mediaMetadata(0);
+    QCOMPARE(read.value(QMediaMetaData::Url).toUrl(), trackUrl(0));
+    QCOMPARE(read.value(QMediaMetaData::AlbumArtist).toString(), QStringLiteral("Jay-Z"));
+    QCOMPARE(read.value(QMediaMetaData::Title).toString(), QStringLiteral("Hard Knock Life - Ghetto Anthem"));
+}
+
+QTEST_GUILESS_MAIN(tst_QMediaPlaylist)
+
+#include "tst_qmediaplaylist.moc"